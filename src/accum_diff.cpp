@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cli_util.h"
+#include "forward.h"
+#include "gguf_loader.h"
+#include "kernels/accum.h"
+#include "weights.h"
+
+namespace {
+
+using cieft::kernels::Accum;
+
+// Hidden states (and logits, if the LM head is loaded) after every token, for one policy.
+struct Run {
+  std::vector<std::vector<float>> hidden;
+  std::vector<std::vector<float>> logits;
+  double seconds = 0.0;
+};
+
+Run run_policy(const cieft::Weights& w, const cieft::ModelConfig& cfg, const std::vector<std::uint32_t>& tokens,
+               Accum accum) {
+  cieft::ForwardContext ctx(cfg, static_cast<std::uint32_t>(w.layers.size()));
+  ctx.configure({.accum = accum}, nullptr);
+  const bool lm_head = w.global.output.has_value();
+  Run r;
+  std::vector<float> x(cfg.d_model);
+  for (std::size_t pos = 0; pos < tokens.size(); pos++) {
+    const auto t0 = std::chrono::steady_clock::now();
+    cieft::gather_column(w.global.token_embd, tokens[pos], x.data());
+    ctx.step(w, static_cast<std::uint32_t>(pos), x.data());
+    r.hidden.push_back(x);
+    if (lm_head) {
+      std::vector<float> logits(cfg.vocab_size);
+      ctx.logits(w, x.data(), logits.data());
+      r.logits.push_back(std::move(logits));
+    }
+    r.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  }
+  return r;
+}
+
+struct Divergence {
+  double max_abs = 0.0;
+  double rel_rms = 0.0;  // rms(a - ref) / rms(ref)
+};
+
+Divergence compare(const std::vector<float>& a, const std::vector<float>& ref) {
+  Divergence d;
+  double err = 0.0;
+  double norm = 0.0;
+  for (std::size_t i = 0; i < a.size(); i++) {
+    const double e = static_cast<double>(a[i]) - static_cast<double>(ref[i]);
+    d.max_abs = std::max(d.max_abs, std::abs(e));
+    err += e * e;
+    norm += static_cast<double>(ref[i]) * static_cast<double>(ref[i]);
+  }
+  d.rel_rms = norm > 0.0 ? std::sqrt(err / norm) : std::sqrt(err);
+  return d;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  try {
+    if (argc < 2) {
+      std::cerr << "usage: " << (argc > 0 ? argv[0] : "accum_diff")
+                << " <model.gguf> --tokens <id,id,...> [--layers N] [--max-seq N] [--lm-head] [--threads N]\n";
+      return 2;
+    }
+
+    const std::string path = argv[1];
+    std::vector<std::uint32_t> tokens;
+    std::uint32_t n_layers = 0;  // 0 = all
+    std::uint32_t max_seq = 0;
+    bool lm_head = false;
+    cieft::LoadOptions load_opts;
+
+    for (int i = 2; i < argc; i++) {
+      const std::string_view a = argv[i];
+      auto next = [&]() -> std::string {
+        if (i + 1 >= argc) throw std::runtime_error(std::string(a) + " requires an argument");
+        return argv[++i];
+      };
+      if (a == "--tokens") {
+        tokens = cieft::parse_tokens(next());
+      } else if (a == "--layers") {
+        n_layers = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--max-seq") {
+        max_seq = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--lm-head") {
+        lm_head = true;
+      } else if (a == "--threads") {
+        load_opts.n_threads = static_cast<std::uint32_t>(std::stoul(next()));
+      } else {
+        throw std::runtime_error("unknown arg: " + std::string(a));
+      }
+    }
+    if (tokens.empty()) {
+      throw std::runtime_error("missing --tokens");
+    }
+
+    const cieft::GGUFLoader loader(path);
+    if (n_layers == 0 || n_layers > loader.config().n_layers) {
+      n_layers = loader.config().n_layers;
+    }
+    std::vector<std::uint32_t> layer_ids(n_layers);
+    std::iota(layer_ids.begin(), layer_ids.end(), 0u);
+    const auto w = cieft::load_weights(loader, layer_ids, lm_head, load_opts);
+
+    cieft::ModelConfig cfg = w.cfg;
+    if (max_seq != 0) {
+      cfg.context_length = max_seq;
+    }
+    if (tokens.size() > (cfg.context_length != 0 ? cfg.context_length : 2048)) {
+      throw std::runtime_error("sequence longer than --max-seq / context_length");
+    }
+    for (const auto t : tokens) {
+      if (t >= cfg.vocab_size) {
+        throw std::runtime_error("token id out of range for vocab");
+      }
+    }
+
+    // Every policy sees the same tokens, so divergence does not compound through sampling.
+    const Run ref = run_policy(w, cfg, tokens, Accum::Double);
+    std::cout << "double: " << std::fixed << std::setprecision(3) << ref.seconds * 1000.0 / tokens.size()
+              << " ms/token (reference)\n";
+    for (const Accum accum : {Accum::Float, Accum::Compensated}) {
+      const Run r = run_policy(w, cfg, tokens, accum);
+      Divergence hidden;
+      Divergence logits;
+      std::size_t argmax_match = 0;
+      for (std::size_t pos = 0; pos < tokens.size(); pos++) {
+        const Divergence h = compare(r.hidden[pos], ref.hidden[pos]);
+        hidden.max_abs = std::max(hidden.max_abs, h.max_abs);
+        hidden.rel_rms = std::max(hidden.rel_rms, h.rel_rms);
+        if (lm_head) {
+          const Divergence l = compare(r.logits[pos], ref.logits[pos]);
+          logits.max_abs = std::max(logits.max_abs, l.max_abs);
+          logits.rel_rms = std::max(logits.rel_rms, l.rel_rms);
+          argmax_match += cieft::argmax(r.logits[pos]) == cieft::argmax(ref.logits[pos]) ? 1 : 0;
+        }
+      }
+      std::cout << cieft::kernels::accum_name(accum) << ": " << std::setprecision(3)
+                << r.seconds * 1000.0 / tokens.size() << " ms/token hidden max_abs=" << std::scientific
+                << std::setprecision(3) << hidden.max_abs << " rel_rms=" << hidden.rel_rms;
+      if (lm_head) {
+        std::cout << " logits max_abs=" << logits.max_abs << " rel_rms=" << logits.rel_rms
+                  << " argmax_match=" << argmax_match << "/" << tokens.size();
+      }
+      std::cout << std::fixed << "\n";
+    }
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
+}
@@ -1,13 +1,18 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <stdexcept>
 #include <utility>
 
+#include <sys/mman.h>
+
 namespace cieft {
 
+constexpr std::size_t kHugePageSize = 2 * 1024 * 1024;
+
 class AlignedBuffer {
  public:
   AlignedBuffer() = default;
@@ -25,15 +30,64 @@ class AlignedBuffer {
     if (rc != 0 || p == nullptr) {
       throw std::runtime_error("posix_memalign failed");
     }
-    return AlignedBuffer(p, bytes);
+    return AlignedBuffer(p, bytes, Kind::Heap);
   }
 
-  ~AlignedBuffer() {
-    if (ptr_ != nullptr) {
-      ::free(ptr_);
+  // Anonymous mapping aligned to 2 MiB and rounded up to whole huge pages, with
+  // MADV_HUGEPAGE where available (a plain page-aligned mapping elsewhere). With `hugetlb`,
+  // first tries explicit 2 MiB pages from the reserved pool (MAP_HUGETLB, Linux) and falls
+  // back to the above when none are available.
+  static AlignedBuffer allocate_huge(std::size_t bytes, bool hugetlb = false) {
+    if (bytes == 0) {
+      throw std::runtime_error("AlignedBuffer::allocate_huge: bytes=0");
+    }
+    const std::size_t len = (bytes + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+
+#ifdef MAP_HUGETLB
+    if (hugetlb) {
+      void* p = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p != MAP_FAILED) {
+        return AlignedBuffer(p, len, Kind::HugeTLB);
+      }
+    }
+#else
+    (void)hugetlb;
+#endif
+
+    // Over-map by one huge page and trim so the start is 2 MiB aligned.
+    const std::size_t span = len + kHugePageSize;
+    void* raw = ::mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+      throw std::runtime_error("mmap (anonymous) failed");
+    }
+    const auto base = reinterpret_cast<std::uintptr_t>(raw);
+    const std::uintptr_t aligned = (base + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+    if (aligned > base) {
+      ::munmap(raw, aligned - base);
+    }
+    const std::uintptr_t tail = base + span - (aligned + len);
+    if (tail > 0) {
+      ::munmap(reinterpret_cast<void*>(aligned + len), tail);
+    }
+
+    void* p = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+    ::madvise(p, len, MADV_HUGEPAGE);
+#endif
+    return AlignedBuffer(p, len, Kind::Mapped);
+  }
+
+  // Non-owning view of memory that outlives the buffer (e.g. a read-only file mapping).
+  // No alignment guarantee beyond what `ptr` already has.
+  static AlignedBuffer borrow(const void* ptr, std::size_t bytes) {
+    if (ptr == nullptr || bytes == 0) {
+      throw std::runtime_error("AlignedBuffer::borrow: empty range");
     }
+    return AlignedBuffer(const_cast<void*>(ptr), bytes, Kind::Borrowed);
   }
 
+  ~AlignedBuffer() { release(); }
+
   AlignedBuffer(const AlignedBuffer&) = delete;
   AlignedBuffer& operator=(const AlignedBuffer&) = delete;
 
@@ -42,26 +96,48 @@ class AlignedBuffer {
     if (this == &other) {
       return *this;
     }
-    if (ptr_ != nullptr) {
-      ::free(ptr_);
-    }
+    release();
     ptr_ = other.ptr_;
     bytes_ = other.bytes_;
+    kind_ = other.kind_;
     other.ptr_ = nullptr;
     other.bytes_ = 0;
+    other.kind_ = Kind::Heap;
     return *this;
   }
 
   void* data() { return ptr_; }
   const void* data() const { return ptr_; }
   std::size_t bytes() const { return bytes_; }
+  bool owned() const { return kind_ != Kind::Borrowed; }
+  bool hugetlb() const { return kind_ == Kind::HugeTLB; }
 
  private:
-  AlignedBuffer(void* ptr, std::size_t bytes) : ptr_(ptr), bytes_(bytes) {}
+  enum class Kind {
+    Heap,      // posix_memalign
+    Mapped,    // anonymous mmap
+    HugeTLB,   // anonymous mmap of explicit huge pages
+    Borrowed,  // not ours to free
+  };
+
+  AlignedBuffer(void* ptr, std::size_t bytes, Kind kind) : ptr_(ptr), bytes_(bytes), kind_(kind) {}
+
+  void release() {
+    if (ptr_ == nullptr) {
+      return;
+    }
+    if (kind_ == Kind::Heap) {
+      ::free(ptr_);
+    } else if (kind_ == Kind::Mapped || kind_ == Kind::HugeTLB) {
+      ::munmap(ptr_, bytes_);
+    }
+    ptr_ = nullptr;
+    bytes_ = 0;
+  }
 
   void* ptr_ = nullptr;
   std::size_t bytes_ = 0;
+  Kind kind_ = Kind::Heap;
 };
 
 }  // namespace cieft
-
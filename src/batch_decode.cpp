@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "batch_decoder.h"
+#include "cli_util.h"
+#include "forward.h"
+#include "gguf_loader.h"
+#include "weights.h"
+
+namespace {
+
+void print_stats(const char* name, const cieft::BatchDecoderStats& st, bool groups) {
+  std::cout << name << ": " << st.tokens << " positions in " << st.steps << " steps, " << std::fixed
+            << std::setprecision(3) << st.elapsed_s << "s, " << std::setprecision(1)
+            << static_cast<double>(st.tokens) / st.elapsed_s << " tok/s";
+  if (groups && st.elapsed_s > 0.0) {
+    // Busy times summing past 100% are the overlap.
+    std::cout << "; matmul group " << std::setprecision(0) << 100.0 * st.matmul_s / st.elapsed_s
+              << "% busy, attention group " << 100.0 * st.attention_s / st.elapsed_s << "% busy";
+  }
+  std::cout << "\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  try {
+    if (argc < 2) {
+      std::cerr << "usage: " << (argc > 0 ? argv[0] : "batch_decode")
+                << " <model.gguf> --prompts <id,id,...;id,...> [--batch B] [--generate N]\n"
+                << "       [--matmul-threads N] [--attention-threads N] [--serial] [--threads N] [--max-seq N] "
+                   "[--compare]\n";
+      return 2;
+    }
+
+    const std::string path = argv[1];
+    std::vector<std::vector<std::uint32_t>> prompts;
+    std::uint32_t batch = 0;  // 0 = one sequence per prompt
+    std::uint32_t generate = 0;
+    std::uint32_t max_seq = 0;
+    bool compare = false;
+    cieft::BatchDecoderOptions opts;
+    cieft::LoadOptions load_opts;
+
+    for (int i = 2; i < argc; i++) {
+      const std::string_view a = argv[i];
+      auto next = [&]() -> std::string {
+        if (i + 1 >= argc) throw std::runtime_error(std::string(a) + " requires an argument");
+        return argv[++i];
+      };
+      if (a == "--prompts") {
+        prompts = cieft::parse_prompts(next());
+      } else if (a == "--batch") {
+        batch = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--generate") {
+        generate = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--matmul-threads") {
+        opts.matmul_threads = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--attention-threads") {
+        opts.attention_threads = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--serial") {
+        opts.ping_pong = false;
+      } else if (a == "--threads") {
+        load_opts.n_threads = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--max-seq") {
+        max_seq = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--compare") {
+        compare = true;
+      } else {
+        throw std::runtime_error("unknown arg: " + std::string(a));
+      }
+    }
+    if (prompts.empty()) {
+      throw std::runtime_error("missing --prompts");
+    }
+    // --batch repeats the prompts cyclically.
+    if (batch != 0) {
+      const std::size_t n = prompts.size();
+      prompts.resize(batch);
+      for (std::size_t b = n; b < batch; b++) {
+        prompts[b] = prompts[b % n];
+      }
+    }
+
+    const cieft::GGUFLoader loader(path);
+    std::vector<std::uint32_t> layer_ids(loader.config().n_layers);
+    std::iota(layer_ids.begin(), layer_ids.end(), 0u);
+    const cieft::Weights w = cieft::load_weights(loader, layer_ids, true, load_opts);
+    cieft::ModelConfig cfg = w.cfg;
+    if (max_seq != 0) {
+      cfg.context_length = max_seq;
+    }
+    const auto n_seqs = static_cast<std::uint32_t>(prompts.size());
+
+    cieft::BatchDecoderStats st;
+    std::vector<std::vector<std::uint32_t>> out;
+    {
+      cieft::BatchDecoder dec(w, cfg, n_seqs, opts);
+      out = dec.run(prompts, generate, &st);
+    }
+    std::cout << "batch: " << n_seqs << " sequences, "
+              << opts.matmul_threads << " matmul + " << opts.attention_threads << " attention threads\n";
+    print_stats(opts.ping_pong ? "ping-pong" : "serial", st, opts.ping_pong);
+    for (std::size_t b = 0; b < out.size(); b++) {
+      std::cout << "seq " << b << ": " << cieft::join(out[b]) << "\n";
+    }
+
+    // The other schedule on the same threads, then every sequence alone through one
+    // ForwardContext, as `decode` does.
+    if (compare) {
+      cieft::BatchDecoderOptions other = opts;
+      other.ping_pong = !opts.ping_pong;
+      cieft::BatchDecoderStats other_st;
+      std::vector<std::vector<std::uint32_t>> other_out;
+      {
+        cieft::BatchDecoder dec(w, cfg, n_seqs, other);
+        other_out = dec.run(prompts, generate, &other_st);
+      }
+      print_stats(other.ping_pong ? "ping-pong" : "serial", other_st, other.ping_pong);
+
+      const auto ref = cieft::reference_decode(w, cfg, prompts, generate);
+      std::size_t match = 0;
+      for (std::size_t b = 0; b < prompts.size(); b++) {
+        match += ref[b] == out[b] && ref[b] == other_out[b] ? 1 : 0;
+      }
+      const double serial_s = opts.ping_pong ? other_st.elapsed_s : st.elapsed_s;
+      const double pp_s = opts.ping_pong ? st.elapsed_s : other_st.elapsed_s;
+      std::cout << "ping-pong speedup over serial: " << std::setprecision(2) << serial_s / pp_s
+                << "x; sequences matching single-context decode in both: " << match << "/" << prompts.size()
+                << "\n";
+    }
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
+}
@@ -0,0 +1,252 @@
+#include "batch_decoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "cli_util.h"
+
+namespace cieft {
+
+namespace {
+
+double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+}  // namespace
+
+BatchDecoder::BatchDecoder(const Weights& w, const ModelConfig& cfg, std::uint32_t n_seqs,
+                           const BatchDecoderOptions& opts)
+    : w_(w), cfg_(cfg), opts_(opts) {
+  const auto n_layers = static_cast<std::uint32_t>(w.layers.size());
+  if (n_layers == 0 || !w.global.output || !w.global.output_norm) {
+    throw std::runtime_error("BatchDecoder: needs every layer and the LM head");
+  }
+  if (n_seqs == 0 || opts.matmul_threads == 0 || opts.attention_threads == 0) {
+    throw std::runtime_error("BatchDecoder: n_seqs and thread counts must be non-zero");
+  }
+
+  // Kernels run single-threaded inside a sequence's task; the groups split the batch.
+  for (std::uint32_t b = 0; b < n_seqs; b++) {
+    ctx_.push_back(std::make_unique<ForwardContext>(cfg_, n_layers));
+    ctx_.back()->configure(opts.plan, nullptr);
+  }
+  tokens_.resize(n_seqs);
+  prompt_len_.resize(n_seqs);
+  total_len_.resize(n_seqs);
+  x_.assign(n_seqs, std::vector<float>(cfg.d_model));
+  logits_.assign(n_seqs, std::vector<float>(cfg.vocab_size));
+
+  if (!opts.ping_pong) {
+    matmul_pool_ = std::make_unique<ThreadPool>(opts.matmul_threads + opts.attention_threads);
+    return;
+  }
+  matmul_pool_ = std::make_unique<ThreadPool>(opts.matmul_threads);
+  attention_pool_ = std::make_unique<ThreadPool>(opts.attention_threads);
+  attention_thread_ = std::thread([this] { attention_loop(); });
+}
+
+BatchDecoder::~BatchDecoder() {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (attention_thread_.joinable()) {
+    attention_thread_.join();
+  }
+}
+
+// A micro-batch of one sequence hands the whole group to that sequence's kernels: matmuls
+// split their columns over its threads (or as many as `plan.tuning` measured best) and
+// attention runs a task per kv head. Larger micro-batches run a sequence per task.
+void BatchDecoder::run_phase(ThreadPool& group, const std::vector<std::uint32_t>& seqs, std::uint32_t layer,
+                             LayerPhase phase) {
+  if (seqs.size() == 1) {
+    const std::uint32_t b = seqs.front();
+    ctx_[b]->step_layer(layer, phase, w_.layers[layer], pos_, x_[b].data(), &group);
+    return;
+  }
+  group.parallel_for(seqs.size(), [&](std::size_t k) {
+    const std::uint32_t b = seqs[k];
+    ctx_[b]->step_layer(layer, phase, w_.layers[layer], pos_, x_[b].data(), nullptr);
+  });
+}
+
+void BatchDecoder::attention_loop() {
+  for (;;) {
+    const std::vector<std::uint32_t>* seqs = nullptr;
+    std::uint32_t layer = 0;
+    {
+      std::unique_lock<std::mutex> lk(mu_);
+      cv_.wait(lk, [&] { return stop_ || job_pending_; });
+      if (stop_) {
+        return;
+      }
+      seqs = job_seqs_;
+      layer = job_layer_;
+    }
+    std::exception_ptr err;
+    const auto t0 = std::chrono::steady_clock::now();
+    try {
+      run_phase(*attention_pool_, *seqs, layer, LayerPhase::Attention);
+    } catch (...) {
+      err = std::current_exception();
+    }
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      attention_busy_s_ += seconds_since(t0);
+      if (err && !error_) {
+        error_ = err;
+      }
+      job_pending_ = false;
+    }
+    cv_.notify_all();
+  }
+}
+
+void BatchDecoder::attention_begin(const std::vector<std::uint32_t>* seqs, std::uint32_t layer) {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    job_seqs_ = seqs;
+    job_layer_ = layer;
+    job_pending_ = true;
+  }
+  cv_.notify_all();
+}
+
+void BatchDecoder::attention_wait() {
+  std::unique_lock<std::mutex> lk(mu_);
+  cv_.wait(lk, [&] { return !job_pending_; });
+  if (error_) {
+    const std::exception_ptr e = std::exchange(error_, nullptr);
+    std::rethrow_exception(e);
+  }
+}
+
+void BatchDecoder::step_serial(const std::vector<std::uint32_t>& live) {
+  for (std::uint32_t l = 0; l < w_.layers.size(); l++) {
+    for (const LayerPhase phase : {LayerPhase::QKV, LayerPhase::Attention, LayerPhase::Output}) {
+      run_phase(*matmul_pool_, live, l, phase);
+    }
+  }
+}
+
+// Tick t: the matmul group finishes layer t/2 - 1 and starts layer t/2 of micro-batch t % 2;
+// the attention group runs layer (t-1)/2 of the other micro-batch, whose QKV phase ran on
+// tick t-1 and whose Output phase waits for tick t+1.
+void BatchDecoder::step_ping_pong(const std::vector<std::uint32_t>& live, BatchDecoderStats& stats) {
+  const std::size_t half = (live.size() + 1) / 2;
+  const std::vector<std::uint32_t> mb[2] = {{live.begin(), live.begin() + static_cast<std::ptrdiff_t>(half)},
+                                            {live.begin() + static_cast<std::ptrdiff_t>(half), live.end()}};
+  const auto n_layers = static_cast<std::uint32_t>(w_.layers.size());
+
+  for (std::uint32_t t = 0; t < 2 * n_layers + 2; t++) {
+    bool attending = false;
+    if (t >= 1 && (t - 1) / 2 < n_layers && !mb[(t - 1) % 2].empty()) {
+      attention_begin(&mb[(t - 1) % 2], (t - 1) / 2);
+      attending = true;
+    }
+    const auto& seqs = mb[t % 2];
+    const std::uint32_t l = t / 2;
+    const auto t0 = std::chrono::steady_clock::now();
+    try {
+      if (!seqs.empty() && l >= 1) {
+        run_phase(*matmul_pool_, seqs, l - 1, LayerPhase::Output);
+      }
+      if (!seqs.empty() && l < n_layers) {
+        run_phase(*matmul_pool_, seqs, l, LayerPhase::QKV);
+      }
+    } catch (...) {
+      // The attention job still reads this step's state; let it finish first.
+      if (attending) {
+        try {
+          attention_wait();
+        } catch (...) {
+        }
+      }
+      throw;
+    }
+    stats.matmul_s += seconds_since(t0);
+    if (attending) {
+      attention_wait();
+    }
+  }
+}
+
+std::vector<std::vector<std::uint32_t>> BatchDecoder::run(const std::vector<std::vector<std::uint32_t>>& prompts,
+                                                          std::uint32_t generate, BatchDecoderStats* stats) {
+  if (prompts.empty() || prompts.size() > ctx_.size()) {
+    throw std::runtime_error("BatchDecoder::run: 1.." + std::to_string(ctx_.size()) + " sequences");
+  }
+  const std::uint32_t max_seq = cfg_.context_length != 0 ? cfg_.context_length : 2048;
+  for (std::size_t b = 0; b < prompts.size(); b++) {
+    if (prompts[b].empty() || prompts[b].size() + generate > max_seq) {
+      throw std::runtime_error("BatchDecoder::run: empty prompt or sequence longer than context_length");
+    }
+    for (const auto t : prompts[b]) {
+      if (t >= cfg_.vocab_size) {
+        throw std::runtime_error("BatchDecoder::run: token id out of range for vocab");
+      }
+    }
+    tokens_[b] = prompts[b];
+    prompt_len_[b] = static_cast<std::uint32_t>(prompts[b].size());
+    total_len_[b] = prompt_len_[b] + generate;
+  }
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    attention_busy_s_ = 0.0;
+  }
+
+  BatchDecoderStats st;
+  const auto t0 = std::chrono::steady_clock::now();
+  std::vector<std::uint32_t> live;
+  for (pos_ = 0;; pos_++) {
+    live.clear();
+    for (std::uint32_t b = 0; b < prompts.size(); b++) {
+      if (pos_ < total_len_[b]) {
+        live.push_back(b);
+      }
+    }
+    if (live.empty()) {
+      break;
+    }
+    for (const std::uint32_t b : live) {
+      gather_column(w_.global.token_embd, tokens_[b][pos_], x_[b].data());
+    }
+    if (opts_.ping_pong) {
+      step_ping_pong(live, st);
+    } else {
+      step_serial(live);
+    }
+
+    // Next token: the following prompt token, or the greedy pick once the prompt is consumed.
+    const auto t_head = std::chrono::steady_clock::now();
+    matmul_pool_->parallel_for(live.size(), [&](std::size_t k) {
+      const std::uint32_t b = live[k];
+      const std::uint32_t next = pos_ + 1;
+      if (next >= prompt_len_[b] && next < total_len_[b]) {
+        ctx_[b]->logits(w_, x_[b].data(), logits_[b].data());
+        tokens_[b].push_back(argmax(logits_[b]));
+      }
+    });
+    if (opts_.ping_pong) {
+      st.matmul_s += seconds_since(t_head);
+    }
+    st.tokens += live.size();
+    st.steps += 1;
+  }
+
+  if (stats != nullptr) {
+    st.elapsed_s = seconds_since(t0);
+    std::lock_guard<std::mutex> lk(mu_);
+    st.attention_s = attention_busy_s_;
+    *stats = st;
+  }
+  return std::vector<std::vector<std::uint32_t>>(tokens_.begin(), tokens_.begin() + prompts.size());
+}
+
+}  // namespace cieft
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "forward.h"
+#include "layer_plan.h"
+#include "thread_pool.h"
+#include "weights.h"
+
+namespace cieft {
+
+struct BatchDecoderOptions {
+  // Split each step's batch into two micro-batches and overlap one's attention with the
+  // other's matmuls. Off, every layer runs the whole batch phase after phase on one pool.
+  bool ping_pong = true;
+
+  // Worker groups. With `ping_pong` the matmul group is driven by the caller and the
+  // attention group by a thread of its own; without it one pool gets both counts.
+  std::uint32_t matmul_threads = 1;
+  std::uint32_t attention_threads = 1;
+
+  PlanOptions plan;  // kernels; `plan.tuning` must outlive the decoder
+};
+
+// Counters of one `BatchDecoder::run`.
+struct BatchDecoderStats {
+  std::uint64_t tokens = 0;  // sequence positions decoded
+  std::uint64_t steps = 0;   // batch steps (one position of every live sequence)
+  double elapsed_s = 0.0;
+  double matmul_s = 0.0;     // ping-pong: the matmul group's busy time (QKV, Output, LM head)
+  double attention_s = 0.0;  // ping-pong: the attention group's busy time
+};
+
+// Batched greedy decoding, every sequence one position per step. Each sequence has its own
+// `ForwardContext`; within a worker group the sequences of a micro-batch run as separate
+// tasks with single-threaded kernels, so results match decoding each sequence alone.
+//
+// With `ping_pong` the live sequences are split into micro-batches A and B and each layer
+// into its `LayerPhase`s. The matmul group alternates A and B, running a micro-batch's
+// Output phase of one layer and QKV phase of the next back to back, while the attention
+// group runs the other micro-batch's Attention phase:
+//
+//   tick:       0       1        2             3             ...
+//   matmul:     QKV0 A  QKV0 B   Out0+QKV1 A   Out0+QKV1 B
+//   attention:  -       Att0 A   Att0 B        Att1 A
+//
+// so weight streaming and KV-cache streaming overlap instead of alternating.
+class BatchDecoder {
+ public:
+  // `w` must hold every layer and the LM head and outlive the decoder. `n_seqs` is the
+  // most sequences one `run` may decode.
+  BatchDecoder(const Weights& w, const ModelConfig& cfg, std::uint32_t n_seqs, const BatchDecoderOptions& opts);
+  ~BatchDecoder();
+
+  BatchDecoder(const BatchDecoder&) = delete;
+  BatchDecoder& operator=(const BatchDecoder&) = delete;
+
+  // Decodes each prompt, then `generate` greedy tokens after it. Returns every sequence's
+  // tokens (prompt followed by generated).
+  std::vector<std::vector<std::uint32_t>> run(const std::vector<std::vector<std::uint32_t>>& prompts,
+                                              std::uint32_t generate, BatchDecoderStats* stats = nullptr);
+
+ private:
+  void step_serial(const std::vector<std::uint32_t>& live);
+  void step_ping_pong(const std::vector<std::uint32_t>& live, BatchDecoderStats& stats);
+  void run_phase(ThreadPool& group, const std::vector<std::uint32_t>& seqs, std::uint32_t layer, LayerPhase phase);
+
+  void attention_loop();
+  void attention_begin(const std::vector<std::uint32_t>* seqs, std::uint32_t layer);
+  void attention_wait();
+
+  const Weights& w_;
+  ModelConfig cfg_;
+  BatchDecoderOptions opts_;
+  std::vector<std::unique_ptr<ForwardContext>> ctx_;  // per sequence
+  std::unique_ptr<ThreadPool> matmul_pool_;           // every phase when not ping-ponging
+  std::unique_ptr<ThreadPool> attention_pool_;
+
+  // State of the current `run`, per sequence.
+  std::vector<std::vector<std::uint32_t>> tokens_;
+  std::vector<std::uint32_t> prompt_len_;
+  std::vector<std::uint32_t> total_len_;
+  std::vector<std::vector<float>> x_;
+  std::vector<std::vector<float>> logits_;
+  std::uint32_t pos_ = 0;
+
+  // Hand-off to the attention thread: one job at a time.
+  std::thread attention_thread_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  const std::vector<std::uint32_t>* job_seqs_ = nullptr;
+  std::uint32_t job_layer_ = 0;
+  bool job_pending_ = false;
+  bool stop_ = false;
+  double attention_busy_s_ = 0.0;
+  std::exception_ptr error_;
+};
+
+}  // namespace cieft
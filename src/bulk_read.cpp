@@ -0,0 +1,219 @@
+#include "bulk_read.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace cieft {
+
+namespace {
+
+// O_DIRECT needs block-aligned offsets, lengths and buffers; 4 KiB covers common devices.
+constexpr std::uint64_t kBlock = 4096;
+
+std::uint64_t floor_block(std::uint64_t v) { return v / kBlock * kBlock; }
+std::uint64_t ceil_block(std::uint64_t v) { return (v + kBlock - 1) / kBlock * kBlock; }
+
+int open_for_read(const std::string& path, bool want_direct, bool* direct) {
+  *direct = false;
+#ifdef O_DIRECT
+  if (want_direct) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+    if (fd >= 0) {
+      *direct = true;
+      return fd;
+    }
+  }
+#endif
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("open failed: " + path);
+  }
+#if defined(F_NOCACHE)
+  if (want_direct && ::fcntl(fd, F_NOCACHE, 1) == 0) {
+    *direct = true;
+  }
+#else
+  (void)want_direct;
+#endif
+  return fd;
+}
+
+}  // namespace
+
+BulkReader::BulkReader(const std::string& path, const std::vector<Range>& ranges, const BulkReadOptions& opts)
+    : path_(path) {
+  if (ranges.empty()) {
+    throw std::runtime_error("BulkReader: no ranges");
+  }
+
+  std::vector<Range> sorted = ranges;
+  std::sort(sorted.begin(), sorted.end());
+  for (const auto& [off, len] : sorted) {
+    const std::uint64_t b = floor_block(off);
+    const std::uint64_t e = ceil_block(off + len);
+    if (!extents_.empty() && b <= extents_.back().file_end) {
+      extents_.back().file_end = std::max(extents_.back().file_end, e);
+    } else {
+      extents_.push_back(Extent{.file_begin = b, .file_end = e});
+    }
+  }
+
+  const std::uint64_t chunk_bytes = std::max<std::uint64_t>(kBlock, ceil_block(opts.chunk_bytes));
+  std::size_t staging_bytes = 0;
+  for (auto& ext : extents_) {
+    ext.staging_off = staging_bytes;
+    for (std::uint64_t b = ext.file_begin; b < ext.file_end; b += chunk_bytes) {
+      chunks_.push_back(Chunk{
+          .file_begin = b,
+          .file_end = std::min(ext.file_end, b + chunk_bytes),
+          .staging_off = static_cast<std::size_t>(ext.staging_off + (b - ext.file_begin)),
+      });
+    }
+    staging_bytes += static_cast<std::size_t>(ext.file_end - ext.file_begin);
+  }
+
+  staging_ = opts.hugepages ? AlignedBuffer::allocate_huge(staging_bytes) : AlignedBuffer::allocate(staging_bytes, kBlock);
+  done_.assign(chunks_.size(), 0);
+  fd_ = open_for_read(path_, opts.direct, &direct_);
+  start_ = std::chrono::steady_clock::now();
+
+  const std::size_t n_threads = std::clamp<std::size_t>(opts.io_threads, 1, chunks_.size());
+  threads_.reserve(n_threads);
+  for (std::size_t i = 0; i < n_threads; i++) {
+    threads_.emplace_back([this] { io_loop(); });
+  }
+}
+
+BulkReader::~BulkReader() {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    next_chunk_ = chunks_.size();
+  }
+  for (auto& t : threads_) {
+    if (t.joinable()) {
+      t.join();
+    }
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+const std::uint8_t* BulkReader::data_at(std::uint64_t file_offset) const {
+  auto it = std::upper_bound(extents_.begin(), extents_.end(), file_offset,
+                             [](std::uint64_t off, const Extent& e) { return off < e.file_begin; });
+  if (it == extents_.begin() || file_offset >= std::prev(it)->file_end) {
+    throw std::runtime_error("BulkReader::data_at: offset not in a requested range");
+  }
+  --it;
+  return static_cast<const std::uint8_t*>(staging_.data()) + it->staging_off + (file_offset - it->file_begin);
+}
+
+std::size_t BulkReader::chunk_index(std::uint64_t file_offset) const {
+  auto it = std::upper_bound(chunks_.begin(), chunks_.end(), file_offset,
+                             [](std::uint64_t off, const Chunk& c) { return off < c.file_begin; });
+  if (it == chunks_.begin() || file_offset >= std::prev(it)->file_end) {
+    throw std::runtime_error("BulkReader: offset not in a requested range");
+  }
+  return static_cast<std::size_t>(std::prev(it) - chunks_.begin());
+}
+
+void BulkReader::wait(std::uint64_t file_offset, std::uint64_t len) {
+  if (len == 0) {
+    return;
+  }
+  const std::size_t c0 = chunk_index(file_offset);
+  const std::size_t c1 = chunk_index(file_offset + len - 1);
+
+  std::unique_lock<std::mutex> lk(mu_);
+  cv_.wait(lk, [&] {
+    return error_ || std::all_of(done_.begin() + c0, done_.begin() + c1 + 1, [](char d) { return d != 0; });
+  });
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+}
+
+BulkReadStats BulkReader::finish() {
+  for (auto& t : threads_) {
+    if (t.joinable()) {
+      t.join();
+    }
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+
+  std::lock_guard<std::mutex> lk(mu_);
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+  return BulkReadStats{.bytes = bytes_, .seconds = seconds_, .direct = direct_};
+}
+
+void BulkReader::io_loop() {
+  auto* staging = static_cast<std::uint8_t*>(staging_.data());
+
+  for (;;) {
+    std::size_t ci = 0;
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      if (error_ || next_chunk_ >= chunks_.size()) {
+        return;
+      }
+      ci = next_chunk_++;
+    }
+
+    const Chunk& c = chunks_[ci];
+    std::uint8_t* dst = staging + c.staging_off;
+    std::size_t n = static_cast<std::size_t>(c.file_end - c.file_begin);
+    std::uint64_t off = c.file_begin;
+    std::uint64_t got = 0;
+    try {
+      while (n > 0) {
+        const ssize_t r = ::pread(fd_, dst, n, static_cast<off_t>(off));
+        if (r < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          throw std::runtime_error("pread failed: " + path_ + ": " + std::strerror(errno));
+        }
+        if (r == 0) {
+          // Block padding past EOF.
+          std::memset(dst, 0, n);
+          break;
+        }
+        dst += r;
+        n -= static_cast<std::size_t>(r);
+        off += static_cast<std::uint64_t>(r);
+        got += static_cast<std::uint64_t>(r);
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lk(mu_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+      cv_.notify_all();
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      done_[ci] = 1;
+      bytes_ += got;
+      seconds_ = std::max(seconds_, std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count());
+    }
+    cv_.notify_all();
+  }
+}
+
+}  // namespace cieft
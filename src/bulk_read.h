@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "aligned_alloc.h"
+
+namespace cieft {
+
+struct BulkReadOptions {
+  std::uint32_t io_threads = 8;            // reads in flight
+  std::size_t chunk_bytes = 4 * 1024 * 1024;
+  bool direct = true;     // O_DIRECT (F_NOCACHE on macOS); falls back to buffered reads
+  bool hugepages = true;  // stage into 2 MiB-aligned MADV_HUGEPAGE memory
+};
+
+struct BulkReadStats {
+  std::uint64_t bytes = 0;  // bytes read from the file (incl. alignment padding)
+  double seconds = 0.0;     // first read issued .. last read completed
+  bool direct = false;      // whether reads bypassed the page cache
+};
+
+// Reads a set of file ranges into one anonymous staging region with many concurrent
+// `pread`s, bypassing the page cache. Consumers `wait` for the bytes they need and can
+// start on them while later chunks are still in flight. Reads start in the constructor.
+class BulkReader {
+ public:
+  using Range = std::pair<std::uint64_t, std::uint64_t>;  // file offset, length
+
+  BulkReader(const std::string& path, const std::vector<Range>& ranges, const BulkReadOptions& opts = {});
+  ~BulkReader();
+
+  BulkReader(const BulkReader&) = delete;
+  BulkReader& operator=(const BulkReader&) = delete;
+
+  // Staging address of `file_offset`, which must lie inside a requested range. The bytes
+  // are only valid after `wait` covering them returned.
+  const std::uint8_t* data_at(std::uint64_t file_offset) const;
+
+  // Blocks until [file_offset, file_offset+len) has landed; rethrows read errors.
+  void wait(std::uint64_t file_offset, std::uint64_t len);
+
+  // Joins the I/O threads (rethrowing their first error) and returns final numbers.
+  BulkReadStats finish();
+
+ private:
+  struct Extent {
+    std::uint64_t file_begin = 0;  // block aligned
+    std::uint64_t file_end = 0;    // block aligned
+    std::size_t staging_off = 0;
+  };
+  struct Chunk {
+    std::uint64_t file_begin = 0;
+    std::uint64_t file_end = 0;
+    std::size_t staging_off = 0;
+  };
+
+  void io_loop();
+  std::size_t chunk_index(std::uint64_t file_offset) const;
+
+  std::string path_;
+  int fd_ = -1;
+  bool direct_ = false;
+  std::vector<Extent> extents_;
+  std::vector<Chunk> chunks_;
+  AlignedBuffer staging_;
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::vector<char> done_;
+  std::size_t next_chunk_ = 0;
+  std::exception_ptr error_;
+  std::uint64_t bytes_ = 0;
+  double seconds_ = 0.0;
+  std::chrono::steady_clock::time_point start_;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace cieft
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cieft {
+
+// "1,2,3" -> {1, 2, 3}; empty fields are skipped.
+inline std::vector<std::uint32_t> parse_tokens(const std::string& s) {
+  std::vector<std::uint32_t> out;
+  std::size_t start = 0;
+  while (start <= s.size()) {
+    const std::size_t end = std::min(s.find(',', start), s.size());
+    if (end > start) {
+      out.push_back(static_cast<std::uint32_t>(std::stoul(s.substr(start, end - start))));
+    }
+    start = end + 1;
+  }
+  return out;
+}
+
+// "1,2,3;4,5" -> {{1, 2, 3}, {4, 5}}
+inline std::vector<std::vector<std::uint32_t>> parse_prompts(const std::string& s) {
+  std::vector<std::vector<std::uint32_t>> out;
+  std::size_t start = 0;
+  while (start <= s.size()) {
+    const std::size_t end = std::min(s.find(';', start), s.size());
+    if (end > start) {
+      out.push_back(parse_tokens(s.substr(start, end - start)));
+    }
+    start = end + 1;
+  }
+  return out;
+}
+
+// Index of the largest logit (the first one on ties).
+inline std::uint32_t argmax(const std::vector<float>& v) {
+  return static_cast<std::uint32_t>(std::max_element(v.begin(), v.end()) - v.begin());
+}
+
+// {1, 2, 3} -> "1,2,3"
+inline std::string join(const std::vector<std::uint32_t>& v) {
+  std::string out;
+  for (std::size_t i = 0; i < v.size(); i++) {
+    if (i != 0) {
+      out += ',';
+    }
+    out += std::to_string(v[i]);
+  }
+  return out;
+}
+
+}  // namespace cieft
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "aligned_alloc.h"
+
+namespace cieft {
+
+// How a decode context allocates its activations and KV cache.
+struct ContextOptions {
+  bool hugepages = false;  // 2 MiB-aligned anonymous mapping with MADV_HUGEPAGE
+  bool prefault = true;    // touch (zero) every page at construction, so decode never faults
+};
+
+// Bump allocator over one page-aligned region; every piece starts on a cache line. A
+// default-constructed arena only measures: `take` returns nullptr and counts bytes, so
+// the same carving code sizes the region first and then hands out real pointers.
+class ContextArena {
+ public:
+  static constexpr std::size_t kPieceAlignment = 64;
+
+  ContextArena() = default;
+
+  ContextArena(std::size_t bytes, const ContextOptions& opts) : capacity_(bytes) {
+    if (bytes == 0) {
+      return;
+    }
+    buf_ = opts.hugepages ? AlignedBuffer::allocate_huge(bytes) : AlignedBuffer::allocate(bytes, 4096);
+    if (opts.prefault) {
+      std::memset(buf_.data(), 0, buf_.bytes());
+    }
+  }
+
+  bool measuring() const { return buf_.data() == nullptr; }
+  std::size_t used() const { return used_; }
+  std::size_t mapped_bytes() const { return buf_.bytes(); }
+
+  float* take(std::size_t n_floats) {
+    const std::size_t bytes = (n_floats * sizeof(float) + kPieceAlignment - 1) / kPieceAlignment * kPieceAlignment;
+    const std::size_t off = used_;
+    used_ += bytes;
+    if (measuring()) {
+      return nullptr;
+    }
+    if (used_ > capacity_) {
+      throw std::runtime_error("ContextArena: out of space");
+    }
+    return reinterpret_cast<float*>(static_cast<std::uint8_t*>(buf_.data()) + off);
+  }
+
+ private:
+  AlignedBuffer buf_;
+  std::size_t capacity_ = 0;
+  std::size_t used_ = 0;
+};
+
+}  // namespace cieft
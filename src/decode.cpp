@@ -0,0 +1,398 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cli_util.h"
+#include "forward.h"
+#include "gguf_loader.h"
+#include "layer_plan.h"
+#include "layer_stream.h"
+#include "lazy_layers.h"
+#include "numa.h"
+#include "prefetch.h"
+#include "progressive.h"
+#include "thread_pool.h"
+#include "tuning.h"
+#include "weight_cache.h"
+#include "weights.h"
+
+int main(int argc, char** argv) {
+  try {
+    if (argc < 2) {
+      std::cerr << "usage: " << (argc > 0 ? argv[0] : "decode")
+                << " <model.gguf> --tokens <id,id,...> [--layers N] [--max-seq N] [--lm-head] [--generate N]\n"
+                << "  load: [--threads N] [--borrow-f32] [--bulk-io] [--io-threads N] [--cache-dir DIR] [--progressive]\n"
+                << "        [--fold-weights] [--arena none|thp|hugetlb] [--precision <substr>=<type>]... [--precision-file PATH]\n"
+                << "  prefetch: [--prefetch-depth K] [--prefetch-mode madvise|touch]\n"
+                << "  stream: [--stream-layers N] [--stream-threads N]\n"
+                << "  lazy: [--lazy-budget-mib N]\n"
+                << "  context: [--ctx-hugepage] [--ctx-no-prefault] [--dump-plan]\n"
+                << "  kernels: [--tune-profile PATH] [--autotune] [--accum double|float|compensated]\n"
+                << "  numa: [--numa] [--numa-nodes N]\n"
+                << "  scheduler: [--pool-stats]\n"
+                << "  mmap: [--mmap-populate] [--madvise normal|seq|random|willneed] [--hugepage] [--mlock]\n";
+      return 2;
+    }
+
+    const std::string path = argv[1];
+    std::vector<std::uint32_t> tokens;
+    std::uint32_t n_layers = 0;  // 0 = all
+    std::uint32_t max_seq = 0;
+    std::uint32_t generate = 0;
+    bool lm_head = false;
+    std::uint32_t prefetch_depth = 0;
+    cieft::PrefetchMode prefetch_mode = cieft::PrefetchMode::Madvise;
+    std::uint32_t stream_layers = 0;  // 0 = load every layer up front
+    cieft::StreamOptions stream_opts;
+    bool lazy = false;
+    cieft::LazyOptions lazy_opts;
+    cieft::LoadOptions load_opts;
+    std::string cache_dir;
+    bool progressive = false;
+    cieft::MapOptions map_opts;
+    cieft::ContextOptions ctx_opts;
+    bool dump_plan = false;
+    std::string tune_profile;
+    bool autotune = false;
+    cieft::kernels::Accum accum = cieft::kernels::Accum::Double;
+    bool numa = false;
+    std::uint32_t numa_nodes = 0;  // 0 = as detected
+    bool pool_stats = false;
+
+    for (int i = 2; i < argc; i++) {
+      const std::string_view a = argv[i];
+      auto next = [&]() -> std::string {
+        if (i + 1 >= argc) throw std::runtime_error(std::string(a) + " requires an argument");
+        return argv[++i];
+      };
+      if (a == "--tokens") {
+        tokens = cieft::parse_tokens(next());
+      } else if (a == "--layers") {
+        n_layers = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--max-seq") {
+        max_seq = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--lm-head") {
+        lm_head = true;
+      } else if (a == "--generate") {
+        generate = static_cast<std::uint32_t>(std::stoul(next()));
+        lm_head = true;
+      } else if (a == "--threads") {
+        load_opts.n_threads = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--borrow-f32") {
+        load_opts.borrow_f32 = true;
+      } else if (a == "--cache-dir") {
+        cache_dir = next();
+      } else if (a == "--progressive") {
+        progressive = true;
+      } else if (a == "--arena") {
+        const auto arena = cieft::parse_weight_arena(next());
+        if (!arena) throw std::runtime_error("unknown --arena value: " + std::string(argv[i]));
+        load_opts.arena = *arena;
+      } else if (a == "--precision") {
+        load_opts.precision.add(next());
+      } else if (a == "--precision-file") {
+        load_opts.precision.add_file(next());
+      } else if (a == "--fold-weights") {
+        load_opts.fold_weights = true;
+        stream_opts.fold_weights = true;
+        lazy_opts.fold_weights = true;
+      } else if (a == "--bulk-io") {
+        load_opts.bulk_io = true;
+      } else if (a == "--io-threads") {
+        load_opts.bulk.io_threads = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--prefetch-depth") {
+        prefetch_depth = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--prefetch-mode") {
+        const auto m = cieft::parse_prefetch_mode(next());
+        if (!m) throw std::runtime_error("unknown --prefetch-mode value: " + std::string(argv[i]));
+        prefetch_mode = *m;
+      } else if (a == "--stream-layers") {
+        stream_layers = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--stream-threads") {
+        stream_opts.dequant_threads = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--lazy-budget-mib") {
+        lazy = true;
+        lazy_opts.budget_bytes = static_cast<std::size_t>(std::stoull(next())) * 1024 * 1024;
+      } else if (a == "--ctx-hugepage") {
+        ctx_opts.hugepages = true;
+      } else if (a == "--ctx-no-prefault") {
+        ctx_opts.prefault = false;
+      } else if (a == "--dump-plan") {
+        dump_plan = true;
+      } else if (a == "--tune-profile") {
+        tune_profile = next();
+      } else if (a == "--autotune") {
+        autotune = true;
+      } else if (a == "--accum") {
+        const auto p = cieft::kernels::parse_accum(next());
+        if (!p) throw std::runtime_error("unknown --accum value: " + std::string(argv[i]));
+        accum = *p;
+      } else if (a == "--numa") {
+        numa = true;
+      } else if (a == "--numa-nodes") {
+        numa = true;
+        numa_nodes = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--pool-stats") {
+        pool_stats = true;
+      } else if (a == "--mmap-populate") {
+        map_opts.populate = true;
+      } else if (a == "--madvise") {
+        const auto advice = cieft::parse_map_advice(next());
+        if (!advice) throw std::runtime_error("unknown --madvise value: " + std::string(argv[i]));
+        map_opts.advice = *advice;
+      } else if (a == "--hugepage") {
+        map_opts.hugepage = true;
+      } else if (a == "--mlock") {
+        map_opts.lock = true;
+      } else {
+        throw std::runtime_error("unknown arg: " + std::string(a));
+      }
+    }
+    if (tokens.empty()) {
+      throw std::runtime_error("missing --tokens");
+    }
+    if (progressive && (stream_layers != 0 || !cache_dir.empty())) {
+      throw std::runtime_error("--progressive cannot be combined with --stream-layers or --cache-dir");
+    }
+    if (lazy && (stream_layers != 0 || progressive)) {
+      throw std::runtime_error("--lazy-budget-mib cannot be combined with --stream-layers or --progressive");
+    }
+    if (!load_opts.precision.empty() && (stream_layers != 0 || lazy || !cache_dir.empty())) {
+      throw std::runtime_error("--precision applies to load_weights only; drop --stream-layers, --lazy-budget-mib and --cache-dir");
+    }
+
+    // With --numa the compute pool exists before loading: its thread-to-node split decides
+    // which node each weight column range is placed on.
+    std::unique_ptr<cieft::ThreadPool> pool;
+    if (numa) {
+      const auto topo = cieft::NumaTopology::detect();
+      pool = std::make_unique<cieft::ThreadPool>(load_opts.n_threads);
+      const std::uint32_t pinned =
+          cieft::assign_pool_to_nodes(*pool, topo, numa_nodes != 0 ? numa_nodes : topo.nodes());
+      // Columns are only bound to nodes that exist; a larger --numa-nodes just splits work.
+      if (pool->numa_nodes() == topo.nodes()) {
+        load_opts.numa_node_ids = topo.node_ids;
+      }
+      std::cout << "numa: " << topo.describe() << ", pool of " << pool->size() << " split over "
+                << pool->numa_nodes() << " node(s), " << pinned << " thread(s) pinned\n";
+    }
+
+    const cieft::GGUFLoader loader(path, map_opts);
+    const auto file_cfg = loader.config();
+    if (n_layers == 0 || n_layers > file_cfg.n_layers) {
+      n_layers = file_cfg.n_layers;
+    }
+    std::vector<std::uint32_t> layer_ids(n_layers);
+    std::iota(layer_ids.begin(), layer_ids.end(), 0u);
+
+    cieft::LoadProgress load_progress;
+    load_opts.progress = [&](const cieft::LoadProgress& p) { load_progress = p; };
+    // When streaming or lazy, only globals are loaded up front; layers come from the source.
+    const auto& load_ids = stream_layers != 0 || lazy ? std::vector<std::uint32_t>{} : layer_ids;
+    const auto t_load = std::chrono::steady_clock::now();
+    bool cache_hit = false;
+    cieft::Weights loaded;
+    std::unique_ptr<cieft::ProgressiveWeights> progressive_src;
+    const cieft::Weights* weights = &loaded;
+    if (progressive) {
+      // Layers are handed to the forward pass as they finish loading.
+      progressive_src = std::make_unique<cieft::ProgressiveWeights>(loader, layer_ids, lm_head, load_opts);
+      weights = &progressive_src->wait_embedding();
+    } else {
+      loaded = cache_dir.empty()
+                   ? cieft::load_weights(loader, load_ids, lm_head, load_opts)
+                   : cieft::load_weights_cached(loader, load_ids, lm_head, load_opts, cache_dir, &cache_hit);
+      if (cache_hit) {
+        std::cout << "load: weight cache hit, "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - t_load).count() << "s\n";
+      } else {
+        std::cout << cieft::format_load_progress(load_progress) << "\n";
+      }
+      if (load_progress.numa_tensors != 0) {
+        std::cout << "numa: placed " << load_progress.numa_tensors << " matrices over " << load_opts.numa_node_ids.size()
+                  << " nodes, " << load_progress.numa_refused << " range(s) refused\n";
+      }
+    }
+
+    cieft::ModelConfig cfg = weights->cfg;
+    if (max_seq != 0) {
+      cfg.context_length = max_seq;
+    }
+    const std::uint32_t seq_cap = cfg.context_length != 0 ? cfg.context_length : 2048;
+    if (tokens.size() + generate > seq_cap) {
+      throw std::runtime_error("sequence longer than --max-seq / context_length");
+    }
+
+    std::unique_ptr<cieft::LayerPrefetcher> prefetch;
+    if (prefetch_depth > 0) {
+      prefetch = std::make_unique<cieft::LayerPrefetcher>(loader, layer_ids, prefetch_depth, prefetch_mode);
+      prefetch->request(0);
+    }
+
+    std::unique_ptr<cieft::LayerSource> source;
+    cieft::LayerStreamer* streamer = nullptr;
+    cieft::LazyLayers* lazy_src = nullptr;
+    if (stream_layers != 0) {
+      stream_opts.resident_layers = stream_layers;
+      auto s = std::make_unique<cieft::LayerStreamer>(loader, weights->cfg, layer_ids, stream_opts);
+      streamer = s.get();
+      source = std::move(s);
+    } else if (lazy) {
+      lazy_opts.dequant_threads = load_opts.n_threads;
+      auto l = std::make_unique<cieft::LazyLayers>(loader, weights->cfg, layer_ids, lazy_opts);
+      lazy_src = l.get();
+      source = std::move(l);
+    } else if (!progressive_src) {
+      source = std::make_unique<cieft::ResidentLayers>(*weights);
+    }
+    cieft::LayerSource& layers = progressive_src ? *progressive_src : *source;
+
+    // A usable profile is loaded as is; otherwise (or with --autotune) every matvec shape of
+    // the model is benchmarked and the result written back to --tune-profile.
+    std::optional<cieft::TuningProfile> tuning;
+    if (!tune_profile.empty() || autotune) {
+      if (!pool) {
+        pool = std::make_unique<cieft::ThreadPool>(load_opts.n_threads);
+      }
+      if (!autotune) {
+        tuning = cieft::TuningProfile::load(tune_profile, pool->size());
+      }
+      if (!tuning) {
+        const auto t_tune = std::chrono::steady_clock::now();
+        const auto shapes = cieft::model_matvec_shapes(cfg, lm_head, progressive_src ? nullptr : weights);
+        tuning = cieft::autotune_matvec(shapes, *pool, {.verbose = true});
+        std::cout << "autotune: " << shapes.size() << " shapes in " << std::fixed << std::setprecision(2)
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - t_tune).count() << "s\n";
+        if (!tune_profile.empty()) {
+          tuning->save(tune_profile);
+        }
+      } else {
+        std::cout << tuning->describe();
+      }
+    }
+
+    // Per-worker scheduler counters need a compute pool even without tuning or NUMA.
+    if (pool_stats && !pool) {
+      pool = std::make_unique<cieft::ThreadPool>(load_opts.n_threads);
+    }
+    if (pool) {
+      pool->reset_stats();  // count decoding only, not autotuning
+    }
+
+    const cieft::PlanOptions plan_opts{.tuning = tuning ? &*tuning : nullptr, .accum = accum};
+    if (dump_plan) {
+      cieft::PlanOptions o = plan_opts;
+      o.folded = load_opts.fold_weights;
+      std::cout << cieft::LayerPlan::compile(cfg, o).describe();
+    }
+    cieft::ForwardContext ctx(cfg, n_layers, ctx_opts);
+    ctx.configure(plan_opts, pool.get());
+    std::cout << "context: " << std::fixed << std::setprecision(1)
+              << static_cast<double>(ctx.arena_bytes()) / (1024.0 * 1024.0) << " MiB arena (activations + KV)"
+              << (ctx_opts.hugepages ? ", hugepage" : "") << "\n";
+    std::vector<float> x(cfg.d_model);
+    std::vector<float> logits(lm_head ? cfg.vocab_size : 0);
+
+    const std::size_t total = tokens.size() + generate;
+    double decode_s = 0.0;
+    for (std::size_t pos = 0; pos < total; pos++) {
+      const std::uint32_t token = tokens[pos];
+      if (token >= cfg.vocab_size) {
+        throw std::runtime_error("token id out of range for vocab");
+      }
+
+      const cieft::StreamStats st0 = streamer ? streamer->stats() : cieft::StreamStats{};
+      const cieft::LazyStats lz0 = lazy_src ? lazy_src->stats() : cieft::LazyStats{};
+      const auto t0 = std::chrono::steady_clock::now();
+      cieft::gather_column(weights->global.token_embd, token, x.data());
+      ctx.step(layers, static_cast<std::uint32_t>(pos), x.data(), prefetch.get());
+      if (lm_head) {
+        ctx.logits(progressive_src ? progressive_src->wait_all() : *weights, x.data(), logits.data());
+      }
+      const auto t1 = std::chrono::steady_clock::now();
+      const double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+      decode_s += ms / 1000.0;
+      if (pos == 0) {
+        std::cout << "first token: " << std::fixed << std::setprecision(3)
+                  << std::chrono::duration<double>(t1 - t_load).count() << "s after load start\n";
+      }
+
+      std::cout << "pos=" << pos << " token=" << token << " " << std::fixed << std::setprecision(3) << ms << " ms";
+      if (lm_head) {
+        const std::uint32_t next = cieft::argmax(logits);
+        std::cout << " argmax=" << next;
+        if (pos + 1 >= tokens.size() && pos + 1 < total) {
+          tokens.push_back(next);
+        }
+      }
+      if (streamer) {
+        const cieft::StreamStats st1 = streamer->stats();
+        const double mib = static_cast<double>(st1.bytes_read - st0.bytes_read) / (1024.0 * 1024.0);
+        const double read_s = st1.read_s - st0.read_s;
+        std::cout << " read=" << std::setprecision(1) << mib << " MiB"
+                  << " disk=" << (read_s > 0.0 ? mib / read_s : 0.0) << " MiB/s"
+                  << " stall=" << std::setprecision(3) << (st1.stall_s - st0.stall_s) * 1000.0 << " ms";
+      }
+      if (lazy_src) {
+        const cieft::LazyStats& lz1 = lazy_src->stats();
+        std::cout << " misses=" << (lz1.misses - lz0.misses) << " evictions=" << (lz1.evictions - lz0.evictions)
+                  << " dequant=" << std::setprecision(3) << (lz1.dequant_s - lz0.dequant_s) * 1000.0 << " ms";
+      }
+      std::cout << "\n";
+    }
+
+    // Streamed and lazy layers are not in `weights`, so the footprint covers resident loads.
+    if (!streamer && !lazy_src) {
+      const auto footprint = cieft::weight_footprint(progressive_src ? progressive_src->wait_all() : *weights);
+      std::cout << cieft::format_weight_footprint(footprint, decode_s > 0.0 ? static_cast<double>(total) / decode_s : 0.0);
+    }
+    if (progressive_src) {
+      progressive_src->wait_all();
+      const auto st = progressive_src->stats();
+      std::cout << cieft::format_load_progress(load_progress) << "\n"
+                << "progressive: embedding=" << std::setprecision(3) << st.embedding_s
+                << "s layer0=" << st.first_layer_s << "s all=" << st.all_s << "s stall=" << st.stall_s << "s\n";
+    }
+    if (streamer) {
+      const auto st = streamer->stats();
+      std::cout << "stream: slots=" << streamer->slots() << " layers_loaded=" << st.layers_loaded
+                << " MiB=" << std::setprecision(1) << static_cast<double>(st.bytes_read) / (1024.0 * 1024.0)
+                << " read_s=" << std::setprecision(3) << st.read_s << " dequant_s=" << st.dequant_s
+                << " stall_s=" << st.stall_s << "\n";
+    }
+    if (lazy_src) {
+      const auto& st = lazy_src->stats();
+      constexpr double kMiB = 1024.0 * 1024.0;
+      std::cout << "lazy: budget_MiB=" << std::setprecision(1) << static_cast<double>(lazy_opts.budget_bytes) / kMiB
+                << " resident_MiB=" << static_cast<double>(st.resident_bytes) / kMiB
+                << " peak_MiB=" << static_cast<double>(st.peak_bytes) / kMiB << " hits=" << st.hits
+                << " misses=" << st.misses << " evictions=" << st.evictions << " dequant_s=" << std::setprecision(3)
+                << st.dequant_s << "\n";
+    }
+    if (pool_stats) {
+      if (!load_progress.workers.empty()) {
+        std::cout << "load pool:\n" << cieft::format_worker_stats(load_progress.workers);
+      }
+      std::cout << "compute pool:\n" << cieft::format_worker_stats(pool->stats());
+    }
+    if (prefetch) {
+      const auto st = prefetch->stats();
+      std::cout << "prefetch: depth=" << prefetch->depth() << " requests=" << st.requests
+                << " MiB=" << std::setprecision(1) << static_cast<double>(st.bytes) / (1024.0 * 1024.0)
+                << " pages_touched=" << st.pages_touched << "\n";
+    }
+
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
+}
@@ -0,0 +1,22 @@
+#include "ggml_quants.h"
+
+#include <cassert>
+#include <cstdint>
+
+#include "ggml_fp16.h"
+
+namespace cieft::ggml {
+
+void dequantize_row_q8_0(const block_q8_0* x, float* y, std::int64_t k) {
+  assert(k % QK8_0 == 0);
+  const std::int64_t nb = k / QK8_0;
+
+  for (std::int64_t i = 0; i < nb; i++) {
+    const float d = fp16_to_fp32(x[i].d);
+    for (int j = 0; j < QK8_0; ++j) {
+      *y++ = x[i].qs[j] * d;
+    }
+  }
+}
+
+}  // namespace cieft::ggml
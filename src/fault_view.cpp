@@ -0,0 +1,212 @@
+#include "fault_view.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "weights.h"
+
+#if defined(__linux__) && __has_include(<linux/userfaultfd.h>)
+#include <linux/userfaultfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#define CIEFT_HAVE_USERFAULTFD 1
+#endif
+
+namespace cieft {
+
+namespace {
+
+#ifdef CIEFT_HAVE_USERFAULTFD
+int open_userfaultfd() {
+#ifdef UFFD_USER_MODE_ONLY
+  // Needs no privilege even with vm.unprivileged_userfaultfd=0.
+  const int fd = static_cast<int>(::syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY));
+  if (fd >= 0) {
+    return fd;
+  }
+#endif
+  return static_cast<int>(::syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK));
+}
+#endif
+
+}  // namespace
+
+FaultingTensorView::FaultingTensorView(const TensorView& t, const FaultViewOptions& opts) : src_(t), opts_(opts) {
+  numel_ = 1;
+  for (const auto d : t.dims) {
+    numel_ *= d;
+  }
+  if (t.dims.empty() || numel_ == 0) {
+    throw std::runtime_error("FaultingTensorView: empty tensor " + std::string(t.name));
+  }
+  // Validates type and size against the source bytes.
+  dequantize_elements(src_, 0, 0, nullptr);
+
+  if (start_on_demand()) {
+    data_ = static_cast<const float*>(region_);
+    return;
+  }
+
+  eager_ = AlignedBuffer::allocate(static_cast<std::size_t>(numel_ * sizeof(float)), 64);
+  dequantize_elements(src_, 0, numel_, static_cast<float*>(eager_.data()));
+  data_ = static_cast<const float*>(eager_.data());
+  stats_.resident_bytes = stats_.peak_resident_bytes = eager_.bytes();
+}
+
+FaultingTensorView::~FaultingTensorView() {
+  if (handler_.joinable()) {
+    const char c = 0;
+    while (::write(wake_[1], &c, 1) < 0 && errno == EINTR) {
+    }
+    handler_.join();
+  }
+  if (region_ != nullptr) {
+    ::munmap(region_, region_bytes_);
+  }
+  for (const int fd : {uffd_, wake_[0], wake_[1]}) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+}
+
+FaultViewStats FaultingTensorView::stats() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return stats_;
+}
+
+bool FaultingTensorView::start_on_demand() {
+#ifdef CIEFT_HAVE_USERFAULTFD
+  page_bytes_ = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  const std::uint64_t page_elems = page_bytes_ / sizeof(float);
+  // Every page must start on a quantization block so it can be filled independently.
+  if (page_elems % dequant_block_elements(src_.ggml_type) != 0) {
+    return false;
+  }
+
+  const int fd = open_userfaultfd();
+  if (fd < 0) {
+    return false;
+  }
+  uffdio_api api{};
+  api.api = UFFD_API;
+  if (::ioctl(fd, UFFDIO_API, &api) != 0) {
+    ::close(fd);
+    return false;
+  }
+
+  const std::uint64_t bytes = numel_ * sizeof(float);
+  region_bytes_ = static_cast<std::size_t>((bytes + page_bytes_ - 1) / page_bytes_ * page_bytes_);
+  region_ = ::mmap(nullptr, region_bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (region_ == MAP_FAILED) {
+    region_ = nullptr;
+    ::close(fd);
+    throw std::runtime_error("mmap (anonymous) failed");
+  }
+
+  uffdio_register reg{};
+  reg.range.start = reinterpret_cast<std::uintptr_t>(region_);
+  reg.range.len = region_bytes_;
+  reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+  if (::ioctl(fd, UFFDIO_REGISTER, &reg) != 0 || ::pipe(wake_) != 0) {
+    ::munmap(region_, region_bytes_);
+    region_ = nullptr;
+    ::close(fd);
+    return false;
+  }
+
+  uffd_ = fd;
+  scratch_.resize(page_elems);
+  handler_ = std::thread([this] { handler_loop(); });
+  return true;
+#else
+  return false;
+#endif
+}
+
+void FaultingTensorView::handler_loop() {
+#ifdef CIEFT_HAVE_USERFAULTFD
+  pollfd fds[2] = {{uffd_, POLLIN, 0}, {wake_[0], POLLIN, 0}};
+  for (;;) {
+    if (::poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::perror("FaultingTensorView: poll");
+      std::abort();
+    }
+    if (fds[1].revents != 0) {
+      return;
+    }
+    uffd_msg msg{};
+    const ssize_t n = ::read(uffd_, &msg, sizeof(msg));
+    if (n != static_cast<ssize_t>(sizeof(msg))) {
+      continue;  // EAGAIN: another wakeup consumed it
+    }
+    if (msg.event == UFFD_EVENT_PAGEFAULT) {
+      fill_page(static_cast<std::uintptr_t>(msg.arg.pagefault.address));
+    }
+  }
+#endif
+}
+
+void FaultingTensorView::fill_page(std::uintptr_t addr) {
+#ifdef CIEFT_HAVE_USERFAULTFD
+  const auto base = reinterpret_cast<std::uintptr_t>(region_);
+  const std::size_t page = (addr - base) / page_bytes_;
+  const std::uintptr_t page_addr = base + page * page_bytes_;
+
+  std::uint64_t evicted = 0;
+  std::size_t resident = filled_.size() * page_bytes_;
+  while (opts_.max_resident_bytes != 0 && !filled_.empty() && resident + page_bytes_ > opts_.max_resident_bytes) {
+    ::madvise(reinterpret_cast<void*>(base + filled_.front() * page_bytes_), page_bytes_, MADV_DONTNEED);
+    filled_.pop_front();
+    resident -= page_bytes_;
+    evicted += 1;
+  }
+
+  const auto t0 = std::chrono::steady_clock::now();
+  const std::uint64_t e0 = static_cast<std::uint64_t>(page) * scratch_.size();
+  const std::uint64_t e1 = std::min<std::uint64_t>(numel_, e0 + scratch_.size());
+  dequantize_elements(src_, e0, e1, scratch_.data());
+  std::fill(scratch_.begin() + static_cast<std::ptrdiff_t>(e1 - e0), scratch_.end(), 0.0f);
+  const double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  uffdio_copy copy{};
+  copy.dst = page_addr;
+  copy.src = reinterpret_cast<std::uintptr_t>(scratch_.data());
+  copy.len = page_bytes_;
+  // Held across the copy so a reader resumed by it sees the updated stats.
+  std::lock_guard<std::mutex> lk(mu_);
+  // EEXIST: several threads faulted on the same page and an earlier message filled it.
+  const bool filled = ::ioctl(uffd_, UFFDIO_COPY, &copy) == 0;
+  if (!filled && errno != EEXIST) {
+    // The faulting thread cannot be released any other way.
+    std::perror("FaultingTensorView: UFFDIO_COPY");
+    std::abort();
+  }
+  if (filled) {
+    filled_.push_back(page);
+    resident += page_bytes_;
+  }
+  stats_.faults += filled ? 1 : 0;
+  stats_.evictions += evicted;
+  stats_.resident_bytes = resident;
+  stats_.peak_resident_bytes = std::max(stats_.peak_resident_bytes, resident);
+  stats_.dequant_s += dt;
+#else
+  (void)addr;
+#endif
+}
+
+}  // namespace cieft
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "aligned_alloc.h"
+#include "gguf_loader.h"
+
+namespace cieft {
+
+struct FaultViewOptions {
+  std::size_t max_resident_bytes = 0;  // filled float32 pages kept; 0 = unlimited
+};
+
+struct FaultViewStats {
+  std::uint64_t faults = 0;     // pages dequantized on first touch (or re-touch after eviction)
+  std::uint64_t evictions = 0;  // pages dropped to stay under max_resident_bytes
+  std::size_t resident_bytes = 0;
+  std::size_t peak_resident_bytes = 0;
+  double dequant_s = 0.0;
+};
+
+// Read-only float32 view of a (possibly quantized) tensor that costs memory only for what
+// is read. A virtual region of numel floats is reserved and registered with userfaultfd; a
+// handler thread fills each page on first touch by dequantizing the blocks behind it
+// straight from the mapping. Past `max_resident_bytes`, the oldest filled pages are dropped
+// (FIFO; touches after a fill are invisible to us) and fault in again if read.
+//
+// Where userfaultfd is unavailable (non-Linux, or denied by the kernel) the view falls back
+// to dequantizing the whole tensor up front; `on_demand()` tells which one you got. Faults
+// are resolved for user-space accesses only: do not hand `data()` to syscalls.
+class FaultingTensorView {
+ public:
+  explicit FaultingTensorView(const TensorView& t, const FaultViewOptions& opts = {});
+  ~FaultingTensorView();
+
+  FaultingTensorView(const FaultingTensorView&) = delete;
+  FaultingTensorView& operator=(const FaultingTensorView&) = delete;
+
+  const float* data() const { return data_; }
+  std::uint64_t numel() const { return numel_; }
+  const std::vector<std::uint64_t>& dims() const { return src_.dims; }
+  bool on_demand() const { return uffd_ >= 0; }
+
+  FaultViewStats stats() const;
+
+ private:
+  bool start_on_demand();
+  void handler_loop();
+  void fill_page(std::uintptr_t addr);
+
+  TensorView src_;
+  FaultViewOptions opts_;
+  std::uint64_t numel_ = 0;
+  const float* data_ = nullptr;
+
+  // On-demand mode.
+  std::size_t page_bytes_ = 0;
+  void* region_ = nullptr;
+  std::size_t region_bytes_ = 0;
+  int uffd_ = -1;
+  int wake_[2] = {-1, -1};
+  std::vector<float> scratch_;        // handler thread only
+  std::deque<std::size_t> filled_;    // handler thread only; page indices, oldest first
+  std::thread handler_;
+
+  // Fallback mode.
+  AlignedBuffer eager_;
+
+  mutable std::mutex mu_;
+  FaultViewStats stats_;
+};
+
+}  // namespace cieft
@@ -0,0 +1,107 @@
+#include "forward.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "cli_util.h"
+#include "kernels/matvec.h"
+
+namespace cieft {
+
+ForwardContext::ForwardContext(const ModelConfig& cfg, std::uint32_t n_layers, const ContextOptions& opts) : cfg_(cfg) {
+  if (n_layers == 0) {
+    throw std::runtime_error("ForwardContext: n_layers=0");
+  }
+  // One arena: the LM-head buffer, layer 0's KV and scratch, then every other layer's KV.
+  // Layers run one after another, so they all share layer 0's scratch.
+  ContextArena measure;
+  measure.take(cfg_.d_model);
+  const std::size_t bytes = measure.used() + Layer0Context::arena_bytes(cfg_, true) +
+                            static_cast<std::size_t>(n_layers - 1) * Layer0Context::arena_bytes(cfg_, false);
+  arena_ = ContextArena(bytes, opts);
+
+  x_norm_ = arena_.take(cfg_.d_model);
+  layers_.reserve(n_layers);
+  for (std::uint32_t i = 0; i < n_layers; i++) {
+    layers_.emplace_back(cfg_, arena_, i == 0 ? nullptr : &layers_.front());
+  }
+}
+
+void ForwardContext::configure(const PlanOptions& opts, ThreadPool* pool) {
+  for (auto& layer : layers_) {
+    layer.configure(opts, pool);
+  }
+  const auto choice = opts.tuning != nullptr ? opts.tuning->find(cfg_.d_model, cfg_.vocab_size) : std::nullopt;
+  lm_head_ = choice ? *choice : MatVecChoice{.threads = kPoolThreads};
+  lm_head_packed_ =
+      opts.tuning != nullptr ? opts.tuning->packed_threads(cfg_.d_model, cfg_.vocab_size) : PackedThreads{};
+  lm_norm_ = kernels::select_rmsnorm_f32(opts.accum, false);
+  lm_matvec_ = opts.accum == kernels::Accum::Double ? kernels::kMatVecVariants[lm_head_.variant].set
+                                                     : kernels::select_matvec_acc_f32(opts.accum, false);
+  pool_ = pool;
+}
+
+void ForwardContext::step(LayerSource& layers, std::uint32_t pos, float* x_d_model, LayerPrefetcher* prefetch) {
+  if (layers.size() != layers_.size()) {
+    throw std::runtime_error("ForwardContext::step: layer count mismatch");
+  }
+  for (std::size_t i = 0; i < layers_.size(); i++) {
+    if (prefetch != nullptr) {
+      prefetch->on_layer_begin(i);
+    }
+    layers_[i].step(layers.acquire(i), pos, x_d_model);
+    layers.release(i);
+  }
+}
+
+void ForwardContext::step(const Weights& w, std::uint32_t pos, float* x_d_model, LayerPrefetcher* prefetch) {
+  ResidentLayers layers(w);
+  step(layers, pos, x_d_model, prefetch);
+}
+
+void ForwardContext::step_layer(std::size_t i, const LayerWeights& layer, std::uint32_t pos, float* x_d_model) {
+  layers_.at(i).step(layer, pos, x_d_model);
+}
+
+void ForwardContext::step_layer(std::size_t i, LayerPhase phase, const LayerWeights& layer, std::uint32_t pos,
+                                float* x_d_model, ThreadPool* pool) {
+  layers_.at(i).step(phase, layer, pos, x_d_model, pool);
+}
+
+void ForwardContext::logits(const Weights& w, const float* x_d_model, float* out_vocab) {
+  if (!w.global.output_norm || !w.global.output) {
+    throw std::runtime_error("ForwardContext::logits: LM head not loaded");
+  }
+  lm_norm_(x_d_model, w.global.output_norm->data(), cfg_.d_model, cfg_.rms_epsilon, x_norm_);
+  const std::uint32_t threads = tensor_threads(*w.global.output, lm_head_.threads, lm_head_packed_);
+  matvec_tensor(*w.global.output, lm_matvec_, false, threads, pool_, x_norm_, out_vocab);
+}
+
+std::vector<std::vector<std::uint32_t>> reference_decode(const Weights& w, const ModelConfig& cfg,
+                                                         const std::vector<std::vector<std::uint32_t>>& prompts,
+                                                         std::uint32_t generate) {
+  std::vector<std::vector<std::uint32_t>> out;
+  std::vector<float> x(cfg.d_model);
+  std::vector<float> logits(cfg.vocab_size);
+  for (const auto& prompt : prompts) {
+    ForwardContext ctx(cfg, cfg.n_layers);
+    std::vector<std::uint32_t> tokens = prompt;
+    const std::size_t total = tokens.size() + generate;
+    for (std::size_t pos = 0; pos < total; pos++) {
+      gather_column(w.global.token_embd, tokens[pos], x.data());
+      ctx.step(w, static_cast<std::uint32_t>(pos), x.data());
+      if (pos + 1 >= tokens.size() && pos + 1 < total) {
+        ctx.logits(w, x.data(), logits.data());
+        tokens.push_back(argmax(logits));
+      }
+    }
+    out.push_back(std::move(tokens));
+  }
+  return out;
+}
+
+}  // namespace cieft
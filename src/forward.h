@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gguf_loader.h"
+#include "layer0.h"
+#include "prefetch.h"
+#include "tuning.h"
+#include "weights.h"
+
+namespace cieft {
+
+// Supplies layer weights to the forward pass in execution order. `acquire(i)` may block
+// until layer `i` is usable; `release(i)` tells the source the layer is no longer needed
+// for this token.
+class LayerSource {
+ public:
+  virtual ~LayerSource() = default;
+
+  virtual std::size_t size() const = 0;
+  virtual const LayerWeights& acquire(std::size_t i) = 0;
+  virtual void release(std::size_t i) { (void)i; }
+};
+
+// All layers already resident in a `Weights`.
+class ResidentLayers final : public LayerSource {
+ public:
+  explicit ResidentLayers(const Weights& w) : w_(w) {}
+
+  std::size_t size() const override { return w_.layers.size(); }
+  const LayerWeights& acquire(std::size_t i) override { return w_.layers.at(i); }
+
+ private:
+  const Weights& w_;
+};
+
+// Runs every layer of a `Weights` for one token at a time. Each layer keeps its own
+// `Layer0Context` (and therefore its own KV cache); all of them, plus the activations,
+// live in one arena allocated up front, so decoding allocates nothing.
+class ForwardContext {
+ public:
+  ForwardContext(const ModelConfig& cfg, std::uint32_t n_layers, const ContextOptions& opts = {});
+
+  std::uint32_t n_layers() const { return static_cast<std::uint32_t>(layers_.size()); }
+  std::size_t arena_bytes() const { return arena_.mapped_bytes(); }
+
+  // Compiles every layer's plans with `opts` (tuned matvec kernels and thread counts,
+  // accumulation policy) and applies the same choices to the LM head, splitting matmuls
+  // across `pool`. The tuning profile and pool must outlive the context.
+  void configure(const PlanOptions& opts, ThreadPool* pool);
+
+  // Runs the source's layers in order, in-place on `x` (length d_model). If `prefetch` is
+  // given, it is told which layer is about to run so it can read ahead of it.
+  void step(LayerSource& layers, std::uint32_t pos, float* x_d_model, LayerPrefetcher* prefetch = nullptr);
+  void step(const Weights& w, std::uint32_t pos, float* x_d_model, LayerPrefetcher* prefetch = nullptr);
+
+  // Runs only layer `i` of this context (with its KV cache) on `x`. `step` is this for every
+  // layer in order; calling it per layer lets several contexts interleave layer by layer.
+  void step_layer(std::size_t i, const LayerWeights& layer, std::uint32_t pos, float* x_d_model);
+  // One phase of layer `i`, on `pool` (see `Layer0Context::step`). Layers share scratch, so
+  // a context finishes one layer's phases before starting the next layer's.
+  void step_layer(std::size_t i, LayerPhase phase, const LayerWeights& layer, std::uint32_t pos, float* x_d_model,
+                  ThreadPool* pool);
+
+  // Final RMSNorm + LM head. Requires weights loaded with `load_lm_head`.
+  void logits(const Weights& w, const float* x_d_model, float* out_vocab);
+
+ private:
+  ModelConfig cfg_;
+  ContextArena arena_;
+  std::vector<Layer0Context> layers_;
+  float* x_norm_ = nullptr;
+  MatVecChoice lm_head_;
+  PackedThreads lm_head_packed_;
+  kernels::RmsNormFn lm_norm_ = kernels::select_rmsnorm_f32(kernels::Accum::Double, false);
+  MatVecFn lm_matvec_ = kernels::kMatVecVariants[0].set;
+  ThreadPool* pool_ = nullptr;
+};
+
+// Greedy-decodes every prompt alone through one unconfigured `ForwardContext`, as `decode`
+// does: the prompt tokens, then `generate` argmax picks. Batched decoders are checked
+// against it. `w` must hold every layer and the LM head.
+std::vector<std::vector<std::uint32_t>> reference_decode(const Weights& w, const ModelConfig& cfg,
+                                                         const std::vector<std::vector<std::uint32_t>>& prompts,
+                                                         std::uint32_t generate);
+
+}  // namespace cieft
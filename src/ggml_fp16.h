@@ -34,5 +34,28 @@ inline float fp16_to_fp32(std::uint16_t h) {
   return std::bit_cast<float>(bits);
 }
 
+// Round-to-nearest-even, with overflow to inf and NaN preserved (the FP16 library's
+// branch-free scheme, as used by ggml).
+inline std::uint16_t fp32_to_fp16(float f) {
+  constexpr float kScaleToInf = 0x1.0p+112f;
+  constexpr float kScaleToZero = 0x1.0p-110f;
+  float base = ((f < 0 ? -f : f) * kScaleToInf) * kScaleToZero;
+
+  const std::uint32_t w = std::bit_cast<std::uint32_t>(f);
+  const std::uint32_t shl1_w = w + w;
+  const std::uint32_t sign = w & 0x80000000u;
+  std::uint32_t bias = shl1_w & 0xFF000000u;
+  if (bias < 0x71000000u) {
+    bias = 0x71000000u;
+  }
+
+  base = std::bit_cast<float>((bias >> 1) + 0x07800000u) + base;
+  const std::uint32_t bits = std::bit_cast<std::uint32_t>(base);
+  const std::uint32_t exp_bits = (bits >> 13) & 0x00007C00u;
+  const std::uint32_t mantissa_bits = bits & 0x00000FFFu;
+  const std::uint32_t nonsign = exp_bits + mantissa_bits;
+  return static_cast<std::uint16_t>((sign >> 16) | (shl1_w > 0xFF000000u ? 0x7E00u : nonsign));
+}
+
 }  // namespace cieft::ggml
 
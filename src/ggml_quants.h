@@ -7,6 +7,13 @@ namespace cieft::ggml {
 
 constexpr int QK_K = 256;
 constexpr int K_SCALE_SIZE = 12;
+constexpr int QK8_0 = 32;
+
+struct block_q8_0 {
+  std::uint16_t d;
+  std::int8_t qs[QK8_0];
+};
+static_assert(sizeof(block_q8_0) == 34);
 
 struct block_q4_K {
   std::uint16_t d;
@@ -24,8 +31,14 @@ struct block_q6_K {
 };
 static_assert(sizeof(block_q6_K) == 210);
 
+void dequantize_row_q8_0(const block_q8_0* x, float* y, std::int64_t k);
 void dequantize_row_q4_k(const block_q4_K* x, float* y, std::int64_t k);
 void dequantize_row_q6_k(const block_q6_K* x, float* y, std::int64_t k);
 
+// Reference quantizers (ggml's `quantize_row_*_ref`); `k` is a multiple of the block size.
+void quantize_row_q8_0(const float* x, block_q8_0* y, std::int64_t k);
+void quantize_row_q4_k(const float* x, block_q4_K* y, std::int64_t k);
+void quantize_row_q6_k(const float* x, block_q6_K* y, std::int64_t k);
+
 }  // namespace cieft::ggml
 
@@ -225,6 +225,9 @@ std::optional<GGMLTypeTraits> ggml_type_traits(std::uint32_t ggml_type) {
       return GGMLTypeTraits{.name = "F32", .block_size = 1, .type_size = 4};
     case 1:  // GGML_TYPE_F16
       return GGMLTypeTraits{.name = "F16", .block_size = 1, .type_size = 2};
+    case 8:  // GGML_TYPE_Q8_0
+      // QK8_0=32, sizeof(block_q8_0)=sizeof(ggml_half)+QK8_0 = 34 bytes
+      return GGMLTypeTraits{.name = "Q8_0", .block_size = 32, .type_size = 34};
     case 12:  // GGML_TYPE_Q4_K
       // QK_K=256, sizeof(block_q4_K)=2*sizeof(ggml_half)+K_SCALE_SIZE+QK_K/2 = 144 bytes
       return GGMLTypeTraits{.name = "Q4_K", .block_size = 256, .type_size = 144};
@@ -292,8 +295,10 @@ File parse(const std::uint8_t* data, std::size_t size) {
   for (std::uint64_t i = 0; i < out.header.metadata_kv_count; i++) {
     KV kv;
     kv.key = r.read_string();
+    kv.raw_offset = r.pos();
     const auto t = static_cast<ValueType>(r.read<std::uint32_t>());
     kv.value = read_value(r, t);
+    kv.raw_size = r.pos() - kv.raw_offset;
 
     out.kv_index_by_key.emplace(kv.key, out.metadata.size());
     out.metadata.push_back(std::move(kv));
@@ -52,6 +52,11 @@ struct Value {
 struct KV {
   std::string key;
   Value value;
+
+  // Where the encoded value (type tag + payload) sits in the file, so writers can copy
+  // values verbatim (arrays are only summarized in `value`).
+  std::size_t raw_offset = 0;
+  std::size_t raw_size = 0;
 };
 
 struct Header {
@@ -2,10 +2,13 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <cstdio>
+#include <exception>
 #include <limits>
 #include <numeric>
 #include <stdexcept>
 #include <string_view>
+#include <thread>
 #include <vector>
 
 namespace cieft {
@@ -89,42 +92,126 @@ std::optional<float> to_f32(const gguf::Value& v) {
 
 }  // namespace
 
-GGUFLoader::GGUFLoader(const std::string& path) : mapped_(path), gguf_(gguf::parse(mapped_.data(), mapped_.size())) {
-  tensor_size_from_offsets_.assign(gguf_.tensors.size(), 0);
+std::vector<std::string> split_gguf_paths(const std::string& path) {
+  // <prefix>-NNNNN-of-MMMMM.gguf
+  constexpr std::string_view kExt = ".gguf";
+  constexpr std::size_t kDigits = 5;
+  constexpr std::size_t kTail = 1 + kDigits + 4 + kDigits + kExt.size();  // "-NNNNN-of-MMMMM.gguf"
+  if (path.size() < kTail) {
+    return {path};
+  }
+  const std::size_t t = path.size() - kTail;
+  const std::string_view tail = std::string_view(path).substr(t);
+  auto digits = [](std::string_view d) {
+    return std::all_of(d.begin(), d.end(), [](char c) { return c >= '0' && c <= '9'; });
+  };
+  if (tail[0] != '-' || !digits(tail.substr(1, kDigits)) || tail.substr(1 + kDigits, 4) != "-of-" ||
+      !digits(tail.substr(5 + kDigits, kDigits)) || tail.substr(5 + 2 * kDigits) != kExt) {
+    return {path};
+  }
+
+  const std::string prefix = path.substr(0, t);
+  const std::string count = std::string(tail.substr(5 + kDigits, kDigits));
+  const unsigned long n = std::stoul(count);
+  if (n == 0) {
+    throw std::runtime_error("invalid split count in " + path);
+  }
+  std::vector<std::string> out;
+  out.reserve(n);
+  for (unsigned long i = 1; i <= n; i++) {
+    char no[kDigits + 1];
+    std::snprintf(no, sizeof(no), "%05lu", i);
+    out.push_back(prefix + "-" + no + "-of-" + count + std::string(kExt));
+  }
+  return out;
+}
+
+GGUFLoader::Shard::Shard(const std::string& path, const MapOptions& map_opts)
+    : mapped(path, map_opts), file(gguf::parse(mapped.data(), mapped.size())) {
+  tensor_size_from_offsets.assign(file.tensors.size(), 0);
 
-  std::vector<std::size_t> idx(gguf_.tensors.size());
+  std::vector<std::size_t> idx(file.tensors.size());
   std::iota(idx.begin(), idx.end(), 0);
   std::sort(idx.begin(), idx.end(), [&](std::size_t a, std::size_t b) {
-    return gguf_.tensors[a].offset < gguf_.tensors[b].offset;
+    return file.tensors[a].offset < file.tensors[b].offset;
   });
 
   for (std::size_t i = 0; i < idx.size(); i++) {
     const std::size_t cur = idx[i];
-    const std::uint64_t cur_abs = checked_add_u64(static_cast<std::uint64_t>(gguf_.data_section_offset),
-                                                  gguf_.tensors[cur].offset);
-    std::uint64_t next_abs = static_cast<std::uint64_t>(mapped_.size());
+    const std::uint64_t cur_abs = checked_add_u64(static_cast<std::uint64_t>(file.data_section_offset),
+                                                  file.tensors[cur].offset);
+    std::uint64_t next_abs = static_cast<std::uint64_t>(mapped.size());
     if (i + 1 < idx.size()) {
       const std::size_t nxt = idx[i + 1];
-      next_abs = checked_add_u64(static_cast<std::uint64_t>(gguf_.data_section_offset), gguf_.tensors[nxt].offset);
+      next_abs = checked_add_u64(static_cast<std::uint64_t>(file.data_section_offset), file.tensors[nxt].offset);
     }
     if (next_abs < cur_abs) {
       throw std::runtime_error("tensor offsets not monotonic");
     }
-    tensor_size_from_offsets_[cur] = next_abs - cur_abs;
+    tensor_size_from_offsets[cur] = next_abs - cur_abs;
+  }
+}
+
+GGUFLoader::GGUFLoader(const std::string& path, const MapOptions& map_opts) {
+  const std::vector<std::string> paths = split_gguf_paths(path);
+  shards_.resize(paths.size());
+
+  // Shards are independent; with populate/mlock mapping one is real I/O, so do them at once.
+  if (paths.size() == 1) {
+    shards_[0] = std::make_unique<Shard>(paths[0], map_opts);
+  } else {
+    std::vector<std::exception_ptr> errors(paths.size());
+    std::vector<std::thread> threads;
+    threads.reserve(paths.size());
+    for (std::size_t i = 0; i < paths.size(); i++) {
+      threads.emplace_back([&, i] {
+        try {
+          shards_[i] = std::make_unique<Shard>(paths[i], map_opts);
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    for (const auto& e : errors) {
+      if (e) {
+        std::rethrow_exception(e);
+      }
+    }
+
+    const auto declared = kv_u32("split.count");
+    if (declared && *declared != paths.size()) {
+      throw std::runtime_error("split.count does not match shard file names: " + path);
+    }
+  }
+
+  for (std::size_t s = 0; s < shards_.size(); s++) {
+    const auto& tensors = shards_[s]->file.tensors;
+    for (std::size_t i = 0; i < tensors.size(); i++) {
+      const std::string_view name = tensors[i].name;
+      if (!index_.emplace(name, std::make_pair(static_cast<std::uint32_t>(s), i)).second) {
+        throw std::runtime_error("tensor appears in more than one shard: " + std::string(name));
+      }
+      names_.push_back(name);
+    }
   }
 }
 
 std::optional<TensorView> GGUFLoader::maybe_get_tensor(std::string_view name) const {
-  auto it = gguf_.tensor_index_by_name.find(std::string(name));
-  if (it == gguf_.tensor_index_by_name.end()) {
+  auto it = index_.find(name);
+  if (it == index_.end()) {
     return std::nullopt;
   }
-  const auto& ti = gguf_.tensors[it->second];
+  const auto [shard, tensor] = it->second;
+  const Shard& sh = *shards_[shard];
+  const auto& ti = sh.file.tensors[tensor];
 
-  const std::uint64_t abs_off = checked_add_u64(static_cast<std::uint64_t>(gguf_.data_section_offset), ti.offset);
-  const auto nbytes = gguf::tensor_nbytes(ti).value_or(tensor_size_from_offsets_[it->second]);
+  const std::uint64_t abs_off = checked_add_u64(static_cast<std::uint64_t>(sh.file.data_section_offset), ti.offset);
+  const auto nbytes = gguf::tensor_nbytes(ti).value_or(sh.tensor_size_from_offsets[tensor]);
 
-  if (abs_off > mapped_.size() || abs_off + nbytes > mapped_.size()) {
+  if (abs_off > sh.mapped.size() || abs_off + nbytes > sh.mapped.size()) {
     throw std::runtime_error("tensor view out of bounds: " + std::string(name));
   }
 
@@ -132,12 +219,21 @@ std::optional<TensorView> GGUFLoader::maybe_get_tensor(std::string_view name) co
       .name = ti.name,
       .dims = ti.dims,
       .ggml_type = ti.ggml_type,
-      .data = mapped_.data() + abs_off,
+      .data = sh.mapped.data() + abs_off,
       .nbytes = nbytes,
       .file_offset = abs_off,
+      .shard = shard,
   };
 }
 
+bool GGUFLoader::advise(const TensorView& t, MapAdvice advice) const {
+  return mapped_file(t.shard).advise(static_cast<std::size_t>(t.file_offset), static_cast<std::size_t>(t.nbytes), advice);
+}
+
+void GGUFLoader::lock(const TensorView& t) const {
+  mapped_file(t.shard).lock(static_cast<std::size_t>(t.file_offset), static_cast<std::size_t>(t.nbytes));
+}
+
 TensorView GGUFLoader::get_tensor(std::string_view name) const {
   if (auto tv = maybe_get_tensor(name)) {
     return *tv;
@@ -146,35 +242,39 @@ TensorView GGUFLoader::get_tensor(std::string_view name) const {
 }
 
 std::optional<std::uint32_t> GGUFLoader::kv_u32(std::string_view key) const {
-  auto it = gguf_.kv_index_by_key.find(std::string(key));
-  if (it == gguf_.kv_index_by_key.end()) {
+  const auto& meta = file();
+  auto it = meta.kv_index_by_key.find(std::string(key));
+  if (it == meta.kv_index_by_key.end()) {
     return std::nullopt;
   }
-  return to_u32(gguf_.metadata[it->second].value);
+  return to_u32(meta.metadata[it->second].value);
 }
 
 std::optional<std::uint64_t> GGUFLoader::kv_u64(std::string_view key) const {
-  auto it = gguf_.kv_index_by_key.find(std::string(key));
-  if (it == gguf_.kv_index_by_key.end()) {
+  const auto& meta = file();
+  auto it = meta.kv_index_by_key.find(std::string(key));
+  if (it == meta.kv_index_by_key.end()) {
     return std::nullopt;
   }
-  return to_u64(gguf_.metadata[it->second].value);
+  return to_u64(meta.metadata[it->second].value);
 }
 
 std::optional<float> GGUFLoader::kv_f32(std::string_view key) const {
-  auto it = gguf_.kv_index_by_key.find(std::string(key));
-  if (it == gguf_.kv_index_by_key.end()) {
+  const auto& meta = file();
+  auto it = meta.kv_index_by_key.find(std::string(key));
+  if (it == meta.kv_index_by_key.end()) {
     return std::nullopt;
   }
-  return to_f32(gguf_.metadata[it->second].value);
+  return to_f32(meta.metadata[it->second].value);
 }
 
 std::optional<std::string_view> GGUFLoader::kv_string(std::string_view key) const {
-  auto it = gguf_.kv_index_by_key.find(std::string(key));
-  if (it == gguf_.kv_index_by_key.end()) {
+  const auto& meta = file();
+  auto it = meta.kv_index_by_key.find(std::string(key));
+  if (it == meta.kv_index_by_key.end()) {
     return std::nullopt;
   }
-  const auto& v = gguf_.metadata[it->second].value;
+  const auto& v = meta.metadata[it->second].value;
   if (!std::holds_alternative<std::string>(v.payload)) {
     return std::nullopt;
   }
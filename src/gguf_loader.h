@@ -2,9 +2,12 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "gguf.h"
@@ -33,15 +36,31 @@ struct TensorView {
   std::uint32_t ggml_type = 0;
   const std::uint8_t* data = nullptr;  // tensor bytes in file (not dequantized)
   std::uint64_t nbytes = 0;
-  std::uint64_t file_offset = 0;  // absolute file offset
+  std::uint64_t file_offset = 0;  // absolute offset within its shard's file
+  std::uint32_t shard = 0;        // which file of a split model holds the bytes
 };
 
+// Paths of every shard of a split model given any one of them, using the
+// `<name>-00001-of-00003.gguf` naming. Returns `{path}` for an unsplit file.
+std::vector<std::string> split_gguf_paths(const std::string& path);
+
+// Maps a GGUF model. `path` may name any shard of a split model; all shards are then mapped
+// (in parallel) and their tensors presented as one index. Metadata comes from the first
+// shard, which carries the full KV set.
 class GGUFLoader {
  public:
-  explicit GGUFLoader(const std::string& path);
+  explicit GGUFLoader(const std::string& path, const MapOptions& map_opts = {});
+
+  std::size_t shard_count() const { return shards_.size(); }
+  const gguf::File& file(std::size_t shard = 0) const { return shards_.at(shard)->file; }
+  const MappedFile& mapped_file(std::size_t shard = 0) const { return shards_.at(shard)->mapped; }
+
+  // Every tensor name across all shards, shard by shard in file order.
+  const std::vector<std::string_view>& tensor_names() const { return names_; }
 
-  const gguf::File& file() const { return gguf_; }
-  const MappedFile& mapped_file() const { return mapped_; }
+  // Per-tensor mapping policy (see MappedFile::advise / lock).
+  bool advise(const TensorView& t, MapAdvice advice) const;
+  void lock(const TensorView& t) const;
 
   std::optional<TensorView> maybe_get_tensor(std::string_view name) const;
   TensorView get_tensor(std::string_view name) const;
@@ -54,9 +73,17 @@ class GGUFLoader {
   ModelConfig config() const;
 
  private:
-  MappedFile mapped_;
-  gguf::File gguf_;
-  std::vector<std::uint64_t> tensor_size_from_offsets_;
+  struct Shard {
+    Shard(const std::string& path, const MapOptions& map_opts);
+
+    MappedFile mapped;
+    gguf::File file;
+    std::vector<std::uint64_t> tensor_size_from_offsets;
+  };
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::unordered_map<std::string_view, std::pair<std::uint32_t, std::size_t>> index_;  // name -> shard, tensor
+  std::vector<std::string_view> names_;
 };
 
 }  // namespace cieft
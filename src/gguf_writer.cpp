@@ -0,0 +1,161 @@
+#include "gguf_writer.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "reader.h"
+#include "thread_pool.h"
+
+namespace cieft::gguf {
+
+namespace {
+
+constexpr std::uint32_t kVersion = 3;
+
+template <typename T>
+void put(std::string& out, const T& v) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+void put_string(std::string& out, std::string_view s) {
+  put<std::uint64_t>(out, s.size());
+  out.append(s);
+}
+
+}  // namespace
+
+void Writer::set_alignment(std::uint32_t alignment) {
+  if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+    throw std::runtime_error("gguf::Writer: alignment must be a power of 2");
+  }
+  alignment_ = alignment;
+  set_u32("general.alignment", alignment);
+}
+
+void Writer::set_raw(const std::string& key, std::string raw) {
+  if (raw.size() < sizeof(std::uint32_t)) {
+    throw std::runtime_error("gguf::Writer: encoded value too short for " + key);
+  }
+  if (auto it = kv_index_.find(key); it != kv_index_.end()) {
+    kvs_[it->second].second = std::move(raw);
+    return;
+  }
+  kv_index_.emplace(key, kvs_.size());
+  kvs_.emplace_back(key, std::move(raw));
+}
+
+void Writer::set_u32(const std::string& key, std::uint32_t v) {
+  std::string raw;
+  put<std::uint32_t>(raw, static_cast<std::uint32_t>(ValueType::Uint32));
+  put<std::uint32_t>(raw, v);
+  set_raw(key, std::move(raw));
+}
+
+std::size_t Writer::add_tensor(std::string name, std::vector<std::uint64_t> dims, std::uint32_t ggml_type,
+                               std::uint64_t nbytes) {
+  tensors_.push_back(Tensor{.name = std::move(name), .dims = std::move(dims), .ggml_type = ggml_type, .nbytes = nbytes});
+  return tensors_.size() - 1;
+}
+
+std::uint64_t Writer::tensor_offset(std::size_t i) const {
+  std::uint64_t off = 0;
+  for (std::size_t k = 0; k < i; k++) {
+    off = align_up(off + tensors_[k].nbytes, alignment_);
+  }
+  return off;
+}
+
+void Writer::write(const std::string& path,
+                   const std::function<void(std::size_t, std::uint8_t*)>& fill,
+                   ThreadPool* pool) const {
+  std::string header;
+  header.append("GGUF", 4);
+  put<std::uint32_t>(header, kVersion);
+  put<std::uint64_t>(header, tensors_.size());
+  put<std::uint64_t>(header, kvs_.size());
+  for (const auto& [key, raw] : kvs_) {
+    put_string(header, key);
+    header.append(raw);
+  }
+
+  std::vector<std::uint64_t> offsets(tensors_.size());
+  std::uint64_t off = 0;
+  for (std::size_t i = 0; i < tensors_.size(); i++) {
+    const Tensor& t = tensors_[i];
+    offsets[i] = off;
+    off = align_up(off + t.nbytes, alignment_);
+
+    put_string(header, t.name);
+    put<std::uint32_t>(header, static_cast<std::uint32_t>(t.dims.size()));
+    for (const auto d : t.dims) {
+      put<std::uint64_t>(header, d);
+    }
+    put<std::uint32_t>(header, t.ggml_type);
+    put<std::uint64_t>(header, offsets[i]);
+  }
+
+  const std::size_t data_start = align_up(header.size(), alignment_);
+  std::size_t total = data_start;
+  if (!tensors_.empty()) {
+    total += static_cast<std::size_t>(offsets.back() + tensors_.back().nbytes);
+  }
+
+  const std::string tmp = path + ".tmp." + std::to_string(::getpid());
+  const int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("cannot create " + tmp + ": " + std::strerror(errno));
+  }
+  auto fail = [&](const std::string& what) {
+    const std::string msg = what + ": " + tmp + ": " + std::strerror(errno);
+    ::close(fd);
+    std::remove(tmp.c_str());
+    throw std::runtime_error(msg);
+  };
+  if (::ftruncate(fd, static_cast<off_t>(total)) != 0) {
+    fail("ftruncate failed");
+  }
+  void* mapped = ::mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapped == MAP_FAILED) {
+    fail("mmap failed");
+  }
+  auto* base = static_cast<std::uint8_t*>(mapped);
+  std::memcpy(base, header.data(), header.size());
+
+  try {
+    auto one = [&](std::size_t i) { fill(i, base + data_start + offsets[i]); };
+    if (pool != nullptr) {
+      pool->parallel_for(tensors_.size(), one);
+    } else {
+      for (std::size_t i = 0; i < tensors_.size(); i++) {
+        one(i);
+      }
+    }
+  } catch (...) {
+    ::munmap(mapped, total);
+    ::close(fd);
+    std::remove(tmp.c_str());
+    throw;
+  }
+
+  const bool synced = ::msync(mapped, total, MS_SYNC) == 0;
+  ::munmap(mapped, total);
+  if (!synced) {
+    fail("msync failed");
+  }
+  ::close(fd);
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    throw std::runtime_error("rename failed: " + path);
+  }
+}
+
+}  // namespace cieft::gguf
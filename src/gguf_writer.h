@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "gguf.h"
+
+namespace cieft {
+class ThreadPool;
+}
+
+namespace cieft::gguf {
+
+// Builds a GGUF v3 file: metadata, tensor table, then tensor data with every tensor at a
+// multiple of the file alignment. Tensors are written in the order they were added.
+class Writer {
+ public:
+  // Sets `general.alignment` too. Must be a power of two; the GGUF default is 32.
+  void set_alignment(std::uint32_t alignment);
+  std::uint32_t alignment() const { return alignment_; }
+
+  // Adds or replaces a metadata value. `raw` is the encoded value as stored in a file
+  // (type tag followed by payload), e.g. a span described by `KV::raw_offset/raw_size`.
+  void set_raw(const std::string& key, std::string raw);
+  void set_u32(const std::string& key, std::uint32_t v);
+
+  // Appends a tensor entry; returns its index for `write`'s fill callback.
+  std::size_t add_tensor(std::string name, std::vector<std::uint64_t> dims, std::uint32_t ggml_type,
+                         std::uint64_t nbytes);
+
+  // Data-section-relative offset of tensor `i` (final once every tensor has been added).
+  std::uint64_t tensor_offset(std::size_t i) const;
+
+  // Writes the file through a shared mapping: header and table first, then `fill(i, dst)`
+  // for each tensor (concurrently when `pool` is given) with room for its `nbytes`.
+  // Padding is left as file holes. The file appears at `path` only once complete.
+  void write(const std::string& path,
+             const std::function<void(std::size_t, std::uint8_t*)>& fill,
+             ThreadPool* pool = nullptr) const;
+
+ private:
+  struct Tensor {
+    std::string name;
+    std::vector<std::uint64_t> dims;
+    std::uint32_t ggml_type = 0;
+    std::uint64_t nbytes = 0;
+  };
+
+  std::uint32_t alignment_ = 32;
+  std::vector<std::pair<std::string, std::string>> kvs_;  // key, encoded value
+  std::unordered_map<std::string, std::size_t> kv_index_;
+  std::vector<Tensor> tensors_;
+};
+
+}  // namespace cieft::gguf
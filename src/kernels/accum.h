@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace cieft::kernels {
+
+// How reductions (dot products, sums of squares, softmax denominators) accumulate.
+enum class Accum : std::uint8_t {
+  Double,       // one double accumulator: the reference
+  Float,        // kAccumLanes independent float accumulators, so loops vectorize and use FMA
+  Compensated,  // as Float, with a Kahan correction term per lane
+};
+
+inline constexpr std::size_t kAccumLanes = 8;
+
+inline const char* accum_name(Accum a) {
+  switch (a) {
+    case Accum::Double: return "double";
+    case Accum::Float: return "float";
+    case Accum::Compensated: return "compensated";
+  }
+  return "?";
+}
+
+inline std::optional<Accum> parse_accum(std::string_view s) {
+  if (s == "double") return Accum::Double;
+  if (s == "float") return Accum::Float;
+  if (s == "compensated") return Accum::Compensated;
+  return std::nullopt;
+}
+
+namespace detail {
+
+// Lane i of the result sums terms i, i + kAccumLanes, ...; lanes are combined pairwise.
+template <Accum P, typename Term>
+float lane_sum(std::size_t n, Term term) {
+  float sum[kAccumLanes] = {};
+  float comp[kAccumLanes] = {};
+  // The tail goes through the same update, so each lane's correction covers all its terms.
+  auto add = [&](std::size_t l, float t) {
+    if constexpr (P == Accum::Compensated) {
+      const float y = t - comp[l];
+      const float s = sum[l] + y;
+      comp[l] = (s - sum[l]) - y;
+      sum[l] = s;
+    } else {
+      sum[l] += t;
+    }
+  };
+  std::size_t i = 0;
+  for (; i + kAccumLanes <= n; i += kAccumLanes) {
+    for (std::size_t l = 0; l < kAccumLanes; l++) {
+      add(l, term(i + l));
+    }
+  }
+  for (std::size_t l = 0; l < kAccumLanes && i + l < n; l++) {
+    add(l, term(i + l));
+  }
+  if constexpr (P == Accum::Compensated) {
+    for (std::size_t l = 0; l < kAccumLanes; l++) {
+      sum[l] -= comp[l];
+    }
+  }
+  for (std::size_t w = kAccumLanes / 2; w > 0; w /= 2) {
+    for (std::size_t l = 0; l < w; l++) {
+      sum[l] += sum[l + w];
+    }
+  }
+  return sum[0];
+}
+
+}  // namespace detail
+
+// sum(a[i] * b[i]) under policy `P`.
+template <Accum P>
+float dot_acc_f32(const float* a, const float* b, std::size_t n) {
+  if constexpr (P == Accum::Double) {
+    double sum = 0.0;
+    for (std::size_t i = 0; i < n; i++) {
+      sum += static_cast<double>(a[i]) * static_cast<double>(b[i]);
+    }
+    return static_cast<float>(sum);
+  } else {
+    return detail::lane_sum<P>(n, [&](std::size_t i) { return a[i] * b[i]; });
+  }
+}
+
+// sum(x[i]) under policy `P`.
+template <Accum P>
+float sum_acc_f32(const float* x, std::size_t n) {
+  if constexpr (P == Accum::Double) {
+    double sum = 0.0;
+    for (std::size_t i = 0; i < n; i++) {
+      sum += x[i];
+    }
+    return static_cast<float>(sum);
+  } else {
+    return detail::lane_sum<P>(n, [&](std::size_t i) { return x[i]; });
+  }
+}
+
+}  // namespace cieft::kernels
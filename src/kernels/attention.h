@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "accum.h"
+#include "math.h"
+#include "softmax.h"
+
+namespace cieft::kernels {
+
+// Single-query attention against a KV cache laid out [kv_head][max_seq][head_dim].
+struct AttentionArgs {
+  const float* q = nullptr;        // [n_heads * head_dim]
+  const float* k_cache = nullptr;  // kv head 0, position 0
+  const float* v_cache = nullptr;
+  std::size_t kv_head_stride = 0;  // floats between kv heads (max_seq * head_dim)
+  std::uint32_t n_heads = 0;
+  std::uint32_t n_kv_heads = 0;
+  std::uint32_t head_dim = 0;
+  std::uint32_t n_pos = 0;   // positions 0..n_pos-1 are attended
+  float scale = 1.0f;        // applied to every score
+  float* scores = nullptr;   // [group * n_pos]
+  float* out = nullptr;      // [n_heads * head_dim]
+};
+
+using AttentionFn = void (*)(const AttentionArgs& a);
+
+// Query heads sharing a kv head are processed together, so each K/V row is read once per
+// group. `kHeadDim` / `kGroup` fix the trip counts at compile time; 0 reads them from `a`.
+// Every dot product and output sum accumulates in the same order as the generic kernel,
+// so all variants of one accumulation policy `P` give identical results.
+template <std::uint32_t kHeadDim, std::uint32_t kGroup, Accum P = Accum::Double>
+void attention_f32(const AttentionArgs& a) {
+  const std::uint32_t hd = kHeadDim != 0 ? kHeadDim : a.head_dim;
+  const std::uint32_t group = kGroup != 0 ? kGroup : a.n_heads / a.n_kv_heads;
+  const std::size_t n_pos = a.n_pos;
+
+  for (std::uint32_t kv = 0; kv < a.n_kv_heads; kv++) {
+    const float* k_head = a.k_cache + kv * a.kv_head_stride;
+    const float* v_head = a.v_cache + kv * a.kv_head_stride;
+    const float* q_group = a.q + static_cast<std::size_t>(kv) * group * hd;
+    float* out_group = a.out + static_cast<std::size_t>(kv) * group * hd;
+
+    for (std::size_t t = 0; t < n_pos; t++) {
+      const float* kt = k_head + t * hd;
+      for (std::uint32_t g = 0; g < group; g++) {
+        const float* qh = q_group + static_cast<std::size_t>(g) * hd;
+        a.scores[g * n_pos + t] = dot_acc_f32<P>(qh, kt, hd) * a.scale;
+      }
+    }
+    for (std::uint32_t g = 0; g < group; g++) {
+      softmax_inplace_f32<P>(a.scores + g * n_pos, n_pos);
+    }
+
+    set_zero(out_group, static_cast<std::size_t>(group) * hd);
+    for (std::size_t t = 0; t < n_pos; t++) {
+      const float* vt = v_head + t * hd;
+      for (std::uint32_t g = 0; g < group; g++) {
+        const float p = a.scores[g * n_pos + t];
+        float* oh = out_group + static_cast<std::size_t>(g) * hd;
+        for (std::uint32_t i = 0; i < hd; i++) {
+          oh[i] += p * vt[i];
+        }
+      }
+    }
+  }
+}
+
+// Head dims and GQA group sizes with compile-time specializations.
+inline bool specialized_head_dim(std::uint32_t head_dim) { return head_dim == 64 || head_dim == 80 || head_dim == 128; }
+inline bool specialized_group(std::uint32_t group) { return group == 1 || group == 4 || group == 8; }
+
+namespace detail {
+
+template <std::uint32_t kHeadDim, Accum P>
+AttentionFn attention_for_group(std::uint32_t group) {
+  switch (group) {
+    case 1: return attention_f32<kHeadDim, 1, P>;
+    case 4: return attention_f32<kHeadDim, 4, P>;
+    case 8: return attention_f32<kHeadDim, 8, P>;
+    default: return attention_f32<kHeadDim, 0, P>;
+  }
+}
+
+template <Accum P>
+AttentionFn attention_for(std::uint32_t head_dim, std::uint32_t group) {
+  switch (head_dim) {
+    case 64: return attention_for_group<64, P>(group);
+    case 80: return attention_for_group<80, P>(group);
+    case 128: return attention_for_group<128, P>(group);
+    default: return attention_for_group<0, P>(group);
+  }
+}
+
+}  // namespace detail
+
+// Picks the variant specialized for (`head_dim`, `group` = n_heads / n_kv_heads), with
+// runtime trip counts for whichever of the two has no specialization.
+inline AttentionFn select_attention_f32(std::uint32_t head_dim, std::uint32_t group, Accum accum = Accum::Double) {
+  switch (accum) {
+    case Accum::Float: return detail::attention_for<Accum::Float>(head_dim, group);
+    case Accum::Compensated: return detail::attention_for<Accum::Compensated>(head_dim, group);
+    case Accum::Double: break;
+  }
+  return detail::attention_for<Accum::Double>(head_dim, group);
+}
+
+}  // namespace cieft::kernels
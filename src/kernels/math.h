@@ -3,6 +3,8 @@
 #include <cmath>
 #include <cstddef>
 
+#include "accum.h"
+
 namespace cieft::kernels {
 
 inline void add_inplace(float* a, const float* b, std::size_t n) {
@@ -17,12 +19,9 @@ inline void set_zero(float* a, std::size_t n) {
   }
 }
 
-inline float dot_f32(const float* a, const float* b, std::size_t n) {
-  double sum = 0.0;
-  for (std::size_t i = 0; i < n; i++) {
-    sum += static_cast<double>(a[i]) * static_cast<double>(b[i]);
-  }
-  return static_cast<float>(sum);
+template <Accum P = Accum::Double>
+float dot_f32(const float* a, const float* b, std::size_t n) {
+  return dot_acc_f32<P>(a, b, n);
 }
 
 inline float silu(float x) {
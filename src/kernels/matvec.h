@@ -3,6 +3,8 @@
 #include <cstddef>
 #include <cstdint>
 
+#include "accum.h"
+
 namespace cieft::kernels {
 
 // Matrix `W` is stored as [in_dim, out_dim] with contiguous columns (dim0 contiguous),
@@ -22,5 +24,102 @@ inline void matvec_colmajor_f32(const float* W_in_out,
   }
 }
 
-}  // namespace cieft::kernels
+// As `matvec_colmajor_f32`, but accumulates: y[out] += W^T * x[in].
+inline void matvec_colmajor_add_f32(const float* W_in_out,
+                                    std::uint32_t in_dim,
+                                    std::uint32_t out_dim,
+                                    const float* x_in,
+                                    float* y_out) {
+  for (std::uint32_t j = 0; j < out_dim; j++) {
+    const float* col = W_in_out + static_cast<std::size_t>(j) * in_dim;
+    double sum = 0.0;
+    for (std::uint32_t i = 0; i < in_dim; i++) {
+      sum += static_cast<double>(x_in[i]) * static_cast<double>(col[i]);
+    }
+    y_out[j] += static_cast<float>(sum);
+  }
+}
 
+// Processes `kCols` columns per pass over `x`, so each x[i] load feeds several
+// accumulators. Every column still sums in index order, so results match the kernels
+// above exactly. `kAdd` accumulates into `y` instead of overwriting it.
+template <std::uint32_t kCols, bool kAdd>
+void matvec_colmajor_cols_f32(const float* W_in_out,
+                              std::uint32_t in_dim,
+                              std::uint32_t out_dim,
+                              const float* x_in,
+                              float* y_out) {
+  std::uint32_t j = 0;
+  for (; j + kCols <= out_dim; j += kCols) {
+    const float* cols = W_in_out + static_cast<std::size_t>(j) * in_dim;
+    double sum[kCols] = {};
+    for (std::uint32_t i = 0; i < in_dim; i++) {
+      const double xi = x_in[i];
+      for (std::uint32_t c = 0; c < kCols; c++) {
+        sum[c] += xi * static_cast<double>(cols[static_cast<std::size_t>(c) * in_dim + i]);
+      }
+    }
+    for (std::uint32_t c = 0; c < kCols; c++) {
+      if constexpr (kAdd) {
+        y_out[j + c] += static_cast<float>(sum[c]);
+      } else {
+        y_out[j + c] = static_cast<float>(sum[c]);
+      }
+    }
+  }
+  const float* rest = W_in_out + static_cast<std::size_t>(j) * in_dim;
+  if constexpr (kAdd) {
+    matvec_colmajor_add_f32(rest, in_dim, out_dim - j, x_in, y_out + j);
+  } else {
+    matvec_colmajor_f32(rest, in_dim, out_dim - j, x_in, y_out + j);
+  }
+}
+
+// Per-column dot products under accumulation policy `P`; `kAdd` accumulates into `y`. With
+// `Accum::Double` this matches `matvec_colmajor_f32` / `matvec_colmajor_add_f32` exactly.
+template <Accum P, bool kAdd>
+void matvec_colmajor_acc_f32(const float* W_in_out,
+                             std::uint32_t in_dim,
+                             std::uint32_t out_dim,
+                             const float* x_in,
+                             float* y_out) {
+  for (std::uint32_t j = 0; j < out_dim; j++) {
+    const float s = dot_acc_f32<P>(x_in, W_in_out + static_cast<std::size_t>(j) * in_dim, in_dim);
+    if constexpr (kAdd) {
+      y_out[j] += s;
+    } else {
+      y_out[j] = s;
+    }
+  }
+}
+
+using MatVecFn = void (*)(const float* W_in_out, std::uint32_t in_dim, std::uint32_t out_dim, const float* x_in,
+                          float* y_out);
+
+// Interchangeable f32 matvec kernels with double accumulation (same results), as
+// candidates for tuning.
+struct MatVecVariant {
+  const char* name;
+  MatVecFn set;  // y = W^T x
+  MatVecFn add;  // y += W^T x
+};
+
+inline constexpr MatVecVariant kMatVecVariants[] = {
+    {"cols1", matvec_colmajor_f32, matvec_colmajor_add_f32},
+    {"cols4", matvec_colmajor_cols_f32<4, false>, matvec_colmajor_cols_f32<4, true>},
+    {"cols8", matvec_colmajor_cols_f32<8, false>, matvec_colmajor_cols_f32<8, true>},
+};
+
+// Kernel for a non-reference policy; `Accum::Double` returns the default variant.
+inline MatVecFn select_matvec_acc_f32(Accum accum, bool add) {
+  switch (accum) {
+    case Accum::Float:
+      return add ? matvec_colmajor_acc_f32<Accum::Float, true> : matvec_colmajor_acc_f32<Accum::Float, false>;
+    case Accum::Compensated:
+      return add ? matvec_colmajor_acc_f32<Accum::Compensated, true> : matvec_colmajor_acc_f32<Accum::Compensated, false>;
+    case Accum::Double: break;
+  }
+  return add ? kMatVecVariants[0].add : kMatVecVariants[0].set;
+}
+
+}  // namespace cieft::kernels
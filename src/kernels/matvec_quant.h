@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include "../ggml_fp16.h"
+#include "../ggml_quants.h"
+
+namespace cieft::kernels {
+
+namespace detail {
+
+inline double dot_f16_f32(const std::uint16_t* w, const float* x, std::uint32_t n) {
+  double sum = 0.0;
+  for (std::uint32_t i = 0; i < n; i++) {
+    sum += static_cast<double>(ggml::fp16_to_fp32(w[i])) * static_cast<double>(x[i]);
+  }
+  return sum;
+}
+
+inline double dot_q8_0_f32(const ggml::block_q8_0* w, const float* x, std::uint32_t n) {
+  double sum = 0.0;
+  for (std::uint32_t b = 0; b < n / ggml::QK8_0; b++, x += ggml::QK8_0) {
+    double block = 0.0;
+    for (int i = 0; i < ggml::QK8_0; i++) {
+      block += static_cast<double>(w[b].qs[i]) * static_cast<double>(x[i]);
+    }
+    sum += block * static_cast<double>(ggml::fp16_to_fp32(w[b].d));
+  }
+  return sum;
+}
+
+// K-quant blocks are decoded one at a time into a stack buffer, then dotted.
+template <typename Block, void (*kDequant)(const Block*, float*, std::int64_t)>
+double dot_k_f32(const Block* w, const float* x, std::uint32_t n) {
+  float buf[ggml::QK_K];
+  double sum = 0.0;
+  for (std::uint32_t b = 0; b < n / ggml::QK_K; b++, x += ggml::QK_K) {
+    kDequant(w + b, buf, ggml::QK_K);
+    for (int i = 0; i < ggml::QK_K; i++) {
+      sum += static_cast<double>(buf[i]) * static_cast<double>(x[i]);
+    }
+  }
+  return sum;
+}
+
+}  // namespace detail
+
+// As `matvec_colmajor_f32` for a matrix whose columns are stored as ggml rows of
+// `ggml_type` (F16, Q8_0, Q4_K, Q6_K), `col_bytes` apart. Weights are decoded on the fly,
+// so each column is read in its packed size. `kAdd` accumulates into `y`.
+template <bool kAdd>
+void matvec_packed_f32(std::uint32_t ggml_type,
+                       const std::uint8_t* W,
+                       std::size_t col_bytes,
+                       std::uint32_t in_dim,
+                       std::uint32_t out_dim,
+                       const float* x_in,
+                       float* y_out) {
+  for (std::uint32_t j = 0; j < out_dim; j++) {
+    const std::uint8_t* col = W + j * col_bytes;
+    double sum = 0.0;
+    switch (ggml_type) {
+      case 1:
+        sum = detail::dot_f16_f32(reinterpret_cast<const std::uint16_t*>(col), x_in, in_dim);
+        break;
+      case 8:
+        sum = detail::dot_q8_0_f32(reinterpret_cast<const ggml::block_q8_0*>(col), x_in, in_dim);
+        break;
+      case 12:
+        sum = detail::dot_k_f32<ggml::block_q4_K, ggml::dequantize_row_q4_k>(
+            reinterpret_cast<const ggml::block_q4_K*>(col), x_in, in_dim);
+        break;
+      case 14:
+        sum = detail::dot_k_f32<ggml::block_q6_K, ggml::dequantize_row_q6_k>(
+            reinterpret_cast<const ggml::block_q6_K*>(col), x_in, in_dim);
+        break;
+      default:
+        throw std::runtime_error("matvec_packed_f32: unsupported ggml_type " + std::to_string(ggml_type));
+    }
+    if constexpr (kAdd) {
+      y_out[j] += static_cast<float>(sum);
+    } else {
+      y_out[j] = static_cast<float>(sum);
+    }
+  }
+}
+
+}  // namespace cieft::kernels
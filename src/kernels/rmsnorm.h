@@ -3,21 +3,67 @@
 #include <cmath>
 #include <cstddef>
 
+#include "accum.h"
+
 namespace cieft::kernels {
 
-inline void rmsnorm_f32(const float* x, const float* weight, std::size_t n, float eps, float* out) {
-  double sum_sq = 0.0;
-  for (std::size_t i = 0; i < n; i++) {
-    const double v = x[i];
-    sum_sq += v * v;
+template <Accum P = Accum::Double>
+float inv_rms_f32(const float* x, std::size_t n, float eps) {
+  if constexpr (P == Accum::Double) {
+    double sum_sq = 0.0;
+    for (std::size_t i = 0; i < n; i++) {
+      const double v = x[i];
+      sum_sq += v * v;
+    }
+    const double mean_sq = sum_sq / static_cast<double>(n);
+    return 1.0f / std::sqrt(static_cast<float>(mean_sq) + eps);
+  } else {
+    const float mean_sq = dot_acc_f32<P>(x, x, n) / static_cast<float>(n);
+    return 1.0f / std::sqrt(mean_sq + eps);
   }
-  const double mean_sq = sum_sq / static_cast<double>(n);
-  const float inv_rms = 1.0f / std::sqrt(static_cast<float>(mean_sq) + eps);
+}
 
+template <Accum P = Accum::Double>
+void rmsnorm_f32(const float* x, const float* weight, std::size_t n, float eps, float* out) {
+  const float inv_rms = inv_rms_f32<P>(x, n, eps);
   for (std::size_t i = 0; i < n; i++) {
     out[i] = x[i] * inv_rms * weight[i];
   }
 }
 
-}  // namespace cieft::kernels
+// RMSNorm without a gain, for layers whose gain is folded into the following matmuls.
+template <Accum P = Accum::Double>
+void rmsnorm_unit_f32(const float* x, std::size_t n, float eps, float* out) {
+  const float inv_rms = inv_rms_f32<P>(x, n, eps);
+  for (std::size_t i = 0; i < n; i++) {
+    out[i] = x[i] * inv_rms;
+  }
+}
+
+// `weight` is ignored by the unit variants.
+using RmsNormFn = void (*)(const float* x, const float* weight, std::size_t n, float eps, float* out);
+
+namespace detail {
 
+template <Accum P>
+void rmsnorm_unit_adapter(const float* x, const float*, std::size_t n, float eps, float* out) {
+  rmsnorm_unit_f32<P>(x, n, eps, out);
+}
+
+template <Accum P>
+RmsNormFn rmsnorm_for(bool unit) {
+  return unit ? rmsnorm_unit_adapter<P> : rmsnorm_f32<P>;
+}
+
+}  // namespace detail
+
+inline RmsNormFn select_rmsnorm_f32(Accum accum, bool unit) {
+  switch (accum) {
+    case Accum::Float: return detail::rmsnorm_for<Accum::Float>(unit);
+    case Accum::Compensated: return detail::rmsnorm_for<Accum::Compensated>(unit);
+    case Accum::Double: break;
+  }
+  return detail::rmsnorm_for<Accum::Double>(unit);
+}
+
+}  // namespace cieft::kernels
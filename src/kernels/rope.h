@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <stdexcept>
 #include <vector>
@@ -32,6 +33,7 @@ class RoPECache {
 
   std::uint32_t rope_dim() const { return rope_dim_; }
   float theta() const { return theta_; }
+  const float* inv_freq() const { return inv_freq_.data(); }
 
   // Applies RoPE to the first `rope_dim` dims of each head vector.
   void apply_inplace(float* x, std::uint32_t n_heads, std::uint32_t head_dim, std::uint32_t pos) const {
@@ -69,5 +71,52 @@ class RoPECache {
   std::vector<float> inv_freq_;
 };
 
-}  // namespace cieft::kernels
+using RopeFn = void (*)(const RoPECache& rope, float* x, std::uint32_t n_heads, std::uint32_t head_dim,
+                        std::uint32_t pos);
+
+inline void rope_apply_f32(const RoPECache& rope, float* x, std::uint32_t n_heads, std::uint32_t head_dim,
+                           std::uint32_t pos) {
+  rope.apply_inplace(x, n_heads, head_dim, pos);
+}
 
+// RoPE over whole heads (`rope_dim == head_dim == kHeadDim`): the rotation table is built
+// once per call instead of once per head, and the per-head loop has a fixed trip count.
+template <std::uint32_t kHeadDim>
+void rope_apply_full_f32(const RoPECache& rope, float* x, std::uint32_t n_heads, std::uint32_t head_dim,
+                         std::uint32_t pos) {
+  static_assert(kHeadDim % 2 == 0);
+  if (rope.rope_dim() != kHeadDim || head_dim != kHeadDim) {
+    throw std::runtime_error("rope_apply_full_f32: dims do not match the specialization");
+  }
+  float c[kHeadDim / 2];
+  float s[kHeadDim / 2];
+  for (std::uint32_t i = 0; i < kHeadDim / 2; i++) {
+    const float angle = static_cast<float>(pos) * rope.inv_freq()[i];
+    c[i] = std::cos(angle);
+    s[i] = std::sin(angle);
+  }
+  for (std::uint32_t h = 0; h < n_heads; h++) {
+    float* head = x + static_cast<std::size_t>(h) * kHeadDim;
+    for (std::uint32_t i = 0; i < kHeadDim / 2; i++) {
+      const float v0 = head[2 * i];
+      const float v1 = head[2 * i + 1];
+      head[2 * i] = v0 * c[i] - v1 * s[i];
+      head[2 * i + 1] = v0 * s[i] + v1 * c[i];
+    }
+  }
+}
+
+// Full-head specialization for head dims 64/80/128, `rope_apply_f32` otherwise.
+inline RopeFn select_rope_f32(std::uint32_t head_dim, std::uint32_t rope_dim) {
+  if (rope_dim == head_dim) {
+    switch (head_dim) {
+      case 64: return rope_apply_full_f32<64>;
+      case 80: return rope_apply_full_f32<80>;
+      case 128: return rope_apply_full_f32<128>;
+      default: break;
+    }
+  }
+  return rope_apply_f32;
+}
+
+}  // namespace cieft::kernels
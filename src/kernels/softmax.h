@@ -4,9 +4,12 @@
 #include <cstddef>
 #include <limits>
 
+#include "accum.h"
+
 namespace cieft::kernels {
 
-inline void softmax_inplace_f32(float* x, std::size_t n) {
+template <Accum P = Accum::Double>
+void softmax_inplace_f32(float* x, std::size_t n) {
   if (n == 0) {
     return;
   }
@@ -17,18 +20,26 @@ inline void softmax_inplace_f32(float* x, std::size_t n) {
     }
   }
 
-  double sum = 0.0;
-  for (std::size_t i = 0; i < n; i++) {
-    const float e = std::exp(x[i] - max_v);
-    x[i] = e;
-    sum += e;
+  float inv_sum = 0.0f;
+  if constexpr (P == Accum::Double) {
+    double sum = 0.0;
+    for (std::size_t i = 0; i < n; i++) {
+      const float e = std::exp(x[i] - max_v);
+      x[i] = e;
+      sum += e;
+    }
+    inv_sum = sum > 0.0 ? static_cast<float>(1.0 / sum) : 0.0f;
+  } else {
+    for (std::size_t i = 0; i < n; i++) {
+      x[i] = std::exp(x[i] - max_v);
+    }
+    const float sum = sum_acc_f32<P>(x, n);
+    inv_sum = sum > 0.0f ? 1.0f / sum : 0.0f;
   }
 
-  const float inv_sum = sum > 0.0 ? static_cast<float>(1.0 / sum) : 0.0f;
   for (std::size_t i = 0; i < n; i++) {
     x[i] *= inv_sum;
   }
 }
 
 }  // namespace cieft::kernels
-
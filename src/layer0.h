@@ -1,18 +1,26 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
-#include <vector>
 
+#include "context_arena.h"
 #include "gguf_loader.h"
 #include "kernels/rope.h"
+#include "layer_plan.h"
 #include "weights.h"
 
 namespace cieft {
 
+// Per-layer K/V cache over memory owned elsewhere (a context arena).
 class KVCacheLayer {
  public:
   KVCacheLayer() = default;
-  KVCacheLayer(std::uint32_t n_kv_heads, std::uint32_t max_seq, std::uint32_t head_dim);
+  KVCacheLayer(std::uint32_t n_kv_heads, std::uint32_t max_seq, std::uint32_t head_dim, float* k, float* v);
+
+  // Floats needed for each of the K and V arrays.
+  static std::size_t floats(std::uint32_t n_kv_heads, std::uint32_t max_seq, std::uint32_t head_dim) {
+    return static_cast<std::size_t>(n_kv_heads) * max_seq * head_dim;
+  }
 
   std::uint32_t n_kv_heads() const { return n_kv_heads_; }
   std::uint32_t max_seq() const { return max_seq_; }
@@ -29,31 +37,48 @@ class KVCacheLayer {
   std::uint32_t n_kv_heads_ = 0;
   std::uint32_t max_seq_ = 0;
   std::uint32_t head_dim_ = 0;
-  std::vector<float> k_;
-  std::vector<float> v_;
+  float* k_ = nullptr;
+  float* v_ = nullptr;
 };
 
 class Layer0Context {
  public:
-  explicit Layer0Context(const ModelConfig& cfg);
+  // Owns one arena holding its scratch and KV cache.
+  explicit Layer0Context(const ModelConfig& cfg, const ContextOptions& opts = {});
+
+  // Carves the KV cache (and, unless `shared` is given, the plan scratch) from `arena`,
+  // which must outlive the context. `shared` lends its scratch instead; scratch is only
+  // live during `step`, so contexts that never step concurrently can share it.
+  Layer0Context(const ModelConfig& cfg, ContextArena& arena, const Layer0Context* shared = nullptr);
 
-  // Updates K/V cache at `pos` and runs one layer forward in-place on `x` (length d_model).
+  // Bytes a context carves from an arena, with or without its own scratch.
+  static std::size_t arena_bytes(const ModelConfig& cfg, bool with_scratch = true);
+
+  // Updates K/V cache at `pos` and runs one layer forward in-place on `x` (length d_model),
+  // through the plan matching `layer.folded`.
   void step(const LayerWeights& layer, std::uint32_t pos, float* x_d_model);
 
+  // Runs one phase of `step`, splitting its work across `pool` instead of the configured
+  // one. The three phases must run in order before the scratch is used for anything else.
+  void step(LayerPhase phase, const LayerWeights& layer, std::uint32_t pos, float* x_d_model, ThreadPool* pool);
+
+  const LayerPlan& plan(bool folded) const { return folded ? folded_plan_ : plan_; }
+
+  // Recompiles both plans with `opts` (its `folded` is ignored) and runs their
+  // multi-threaded matmuls on `pool`. Scratch layout does not change.
+  void configure(const PlanOptions& opts, ThreadPool* pool);
+
  private:
+  void init(const ModelConfig& cfg);
+
   ModelConfig cfg_;
   kernels::RoPECache rope_;
   KVCacheLayer cache_;
-
-  std::vector<float> x_norm_;
-  std::vector<float> q_;
-  std::vector<float> k_;
-  std::vector<float> v_;
-  std::vector<float> attn_out_;
-  std::vector<float> tmp_d_model_;
-  std::vector<float> gate_;
-  std::vector<float> up_;
-  std::vector<float> attn_probs_;
+  LayerPlan plan_;
+  LayerPlan folded_plan_;
+  float* scratch_ = nullptr;
+  ThreadPool* pool_ = nullptr;
+  ContextArena own_arena_;
 };
 
 }  // namespace cieft
@@ -26,7 +26,9 @@ int main(int argc, char** argv) {
   try {
     if (argc < 2) {
       std::cerr << "usage: " << (argc > 0 ? argv[0] : "layer0_step")
-                << " <model.gguf> --token <id> [--pos 0]\n";
+                << " <model.gguf> --token <id> [--pos 0] [--threads N]\n"
+                << "  mmap: [--mmap-populate] [--madvise normal|seq|random|willneed] [--hugepage] [--mlock]\n"
+                << "        [--mlock-tensor <substring>]...\n";
       return 2;
     }
 
@@ -34,6 +36,9 @@ int main(int argc, char** argv) {
     std::uint32_t token = 0;
     bool have_token = false;
     std::uint32_t pos = 0;
+    cieft::LoadOptions load_opts;
+    cieft::MapOptions map_opts;
+    std::vector<std::string> mlock_tensors;
 
     for (int i = 2; i < argc; i++) {
       const std::string_view a = argv[i];
@@ -44,6 +49,23 @@ int main(int argc, char** argv) {
       } else if (a == "--pos") {
         if (i + 1 >= argc) throw std::runtime_error("--pos requires an argument");
         pos = static_cast<std::uint32_t>(std::stoul(argv[++i]));
+      } else if (a == "--threads") {
+        if (i + 1 >= argc) throw std::runtime_error("--threads requires an argument");
+        load_opts.n_threads = static_cast<std::uint32_t>(std::stoul(argv[++i]));
+      } else if (a == "--mmap-populate") {
+        map_opts.populate = true;
+      } else if (a == "--madvise") {
+        if (i + 1 >= argc) throw std::runtime_error("--madvise requires an argument");
+        const auto advice = cieft::parse_map_advice(argv[++i]);
+        if (!advice) throw std::runtime_error("unknown --madvise value: " + std::string(argv[i]));
+        map_opts.advice = *advice;
+      } else if (a == "--hugepage") {
+        map_opts.hugepage = true;
+      } else if (a == "--mlock") {
+        map_opts.lock = true;
+      } else if (a == "--mlock-tensor") {
+        if (i + 1 >= argc) throw std::runtime_error("--mlock-tensor requires an argument");
+        mlock_tensors.emplace_back(argv[++i]);
       } else {
         throw std::runtime_error("unknown arg: " + std::string(a));
       }
@@ -56,8 +78,16 @@ int main(int argc, char** argv) {
       throw std::runtime_error("this prototype currently supports only --pos 0 (single-token step)");
     }
 
-    const cieft::GGUFLoader loader(path);
-    auto weights = cieft::load_weights(loader, {0}, /*load_lm_head=*/false);
+    const cieft::GGUFLoader loader(path, map_opts);
+    for (const auto name : loader.tensor_names()) {
+      for (const auto& pat : mlock_tensors) {
+        if (name.find(pat) != std::string_view::npos) {
+          loader.lock(loader.get_tensor(name));
+          break;
+        }
+      }
+    }
+    auto weights = cieft::load_weights(loader, {0}, /*load_lm_head=*/false, load_opts);
 
     if (token >= weights.cfg.vocab_size) {
       throw std::runtime_error("token id out of range for vocab");
@@ -0,0 +1,397 @@
+#include "layer_plan.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "kernels/math.h"
+#include "kernels/matvec.h"
+#include "layer0.h"
+#include "thread_pool.h"
+#include "tuning.h"
+
+namespace cieft {
+
+namespace {
+
+// Indices into `layer_tensors()` / `kLayerTensorSuffixes`.
+enum LayerTensor : int {
+  kAttnNorm = 0,
+  kAttnQ,
+  kAttnK,
+  kAttnV,
+  kAttnOutput,
+  kFfnNorm,
+  kFfnGate,
+  kFfnUp,
+  kFfnDown,
+};
+
+// Buffer offsets are kept on 64-byte boundaries.
+constexpr std::size_t kAlignFloats = 16;
+
+std::size_t align_floats(std::size_t n) { return (n + kAlignFloats - 1) / kAlignFloats * kAlignFloats; }
+
+const char* op_name(OpKind k) {
+  switch (k) {
+    case OpKind::RmsNorm: return "rmsnorm";
+    case OpKind::RmsNormUnit: return "rmsnorm_unit";
+    case OpKind::MatVec: return "matvec";
+    case OpKind::MatVecAdd: return "matvec_add";
+    case OpKind::Add: return "add";
+    case OpKind::Rope: return "rope";
+    case OpKind::KvWrite: return "kv_write";
+    case OpKind::Attention: return "attention";
+    case OpKind::SwiGLU: return "swiglu";
+  }
+  return "?";
+}
+
+}  // namespace
+
+int LayerPlan::add_buffer(std::string name, std::size_t floats) {
+  PlanBuffer b;
+  b.name = std::move(name);
+  b.floats = floats;
+  b.first = ops_.size();
+  b.last = ops_.size();
+  buffers_.push_back(std::move(b));
+  return static_cast<int>(buffers_.size() - 1);
+}
+
+void LayerPlan::add_op(const PlanOp& op) {
+  const std::size_t i = ops_.size();
+  for (const int id : {op.in, op.in2, op.out, op.tmp}) {
+    if (id >= 0) {
+      auto& b = buffers_[static_cast<std::size_t>(id)];
+      b.first = std::min(b.first, i);
+      b.last = std::max(b.last, i);
+    }
+  }
+  ops_.push_back(op);
+}
+
+LayerPlan LayerPlan::compile(const ModelConfig& cfg, const PlanOptions& opts) {
+  if (cfg.d_model == 0 || cfg.n_heads == 0 || cfg.head_dim == 0 || cfg.n_kv_heads == 0 || cfg.kv_dim == 0 ||
+      cfg.ffn_hidden_dim == 0) {
+    throw std::runtime_error("LayerPlan: invalid model config");
+  }
+  LayerPlan p;
+  p.cfg_ = cfg;
+  const std::uint32_t d = cfg.d_model;
+  const std::uint32_t kv = cfg.kv_dim;
+  const std::uint32_t ffn = cfg.ffn_hidden_dim;
+  const std::uint32_t max_seq = cfg.context_length != 0 ? cfg.context_length : 2048;
+  constexpr int R = PlanOp::kResidual;
+
+  auto norm = [&](int gain, int out) {
+    PlanOp op;
+    op.kind = opts.folded ? OpKind::RmsNormUnit : OpKind::RmsNorm;
+    op.rmsnorm = kernels::select_rmsnorm_f32(opts.accum, opts.folded);
+    if (opts.accum != kernels::Accum::Double) {
+      op.kernel = std::string("accum=") + kernels::accum_name(opts.accum);
+    }
+    op.in = R;
+    op.out = out;
+    op.weight = gain;
+    p.add_op(op);
+  };
+  // Default kernels, split across the whole pool, unless the tuning profile has a measured
+  // choice for this shape. The variants all accumulate in double; other policies have one
+  // kernel and only take the tuned thread count.
+  auto select_matvec = [&](PlanOp& op, bool add) {
+    const auto choice = opts.tuning != nullptr ? opts.tuning->find(op.rows, op.cols) : std::nullopt;
+    const auto& variant = kernels::kMatVecVariants[choice ? choice->variant : 0];
+    op.matvec = add ? variant.add : variant.set;
+    op.threads = choice ? choice->threads : kPoolThreads;
+    if (opts.tuning != nullptr) {
+      op.packed_threads = opts.tuning->packed_threads(op.rows, op.cols);
+    }
+    if (opts.accum != kernels::Accum::Double) {
+      op.matvec = kernels::select_matvec_acc_f32(opts.accum, add);
+      op.kernel = std::string("matvec_") + kernels::accum_name(opts.accum) + (add ? "_add" : "") +
+                  (choice ? " x" + std::to_string(op.threads) : "");
+    } else if (choice) {
+      op.kernel = std::string("matvec_") + variant.name + (add ? "_add" : "") + " x" + std::to_string(op.threads);
+    } else {
+      op.kernel = add ? "matvec_colmajor_add_f32" : "matvec_colmajor_f32";
+    }
+  };
+  auto matvec = [&](int weight, int in, int out, std::uint32_t in_dim, std::uint32_t out_dim) {
+    PlanOp op;
+    op.kind = OpKind::MatVec;
+    op.in = in;
+    op.out = out;
+    op.weight = weight;
+    op.rows = in_dim;
+    op.cols = out_dim;
+    select_matvec(op, false);
+    p.add_op(op);
+  };
+  // out-projection back into the residual stream
+  auto project_add = [&](int weight, int in, std::uint32_t in_dim, const char* tmp_name) {
+    if (opts.fuse_residual) {
+      PlanOp op;
+      op.kind = OpKind::MatVecAdd;
+      op.in = in;
+      op.out = R;
+      op.weight = weight;
+      op.rows = in_dim;
+      op.cols = d;
+      select_matvec(op, true);
+      p.add_op(op);
+      return;
+    }
+    const int tmp = p.add_buffer(tmp_name, d);
+    matvec(weight, in, tmp, in_dim, d);
+    PlanOp add;
+    add.kind = OpKind::Add;
+    add.in = tmp;
+    add.out = R;
+    p.add_op(add);
+  };
+
+  // ---- Attention ----
+  const int xn = p.add_buffer("attn_in", d);
+  norm(kAttnNorm, xn);
+  const int q = p.add_buffer("q", d);
+  const int k = p.add_buffer("k", kv);
+  const int v = p.add_buffer("v", kv);
+  matvec(kAttnQ, xn, q, d, d);
+  matvec(kAttnK, xn, k, d, kv);
+  matvec(kAttnV, xn, v, d, kv);
+
+  // Fixed-width kernels for common head_dim / GQA group / full-head RoPE, generic otherwise.
+  const std::uint32_t group = cfg.n_heads / cfg.n_kv_heads;
+  const std::uint32_t rope_dim = cfg.rope_dim != 0 ? cfg.rope_dim : cfg.head_dim;
+  const bool fixed_hd = kernels::specialized_head_dim(cfg.head_dim);
+  const bool fixed_group = kernels::specialized_group(group);
+  const std::string hd_label = fixed_hd ? std::to_string(cfg.head_dim) : "*";
+
+  p.attention_begin_ = p.ops_.size();
+  PlanOp rope;
+  rope.kind = OpKind::Rope;
+  rope.rope = kernels::select_rope_f32(cfg.head_dim, rope_dim);
+  rope.kernel = rope.rope == kernels::rope_apply_f32 ? "rope_apply_f32" : "rope_apply_full_f32<" + hd_label + ">";
+  rope.out = q;
+  rope.rows = cfg.n_heads;
+  p.add_op(rope);
+  rope.out = k;
+  rope.rows = cfg.n_kv_heads;
+  p.add_op(rope);
+
+  PlanOp kv_write;
+  kv_write.kind = OpKind::KvWrite;
+  kv_write.in = k;
+  kv_write.in2 = v;
+  p.add_op(kv_write);
+
+  PlanOp attn;
+  attn.kind = OpKind::Attention;
+  attn.in = q;
+  attn.out = p.add_buffer("attn_out", d);
+  attn.tmp = p.add_buffer("scores", static_cast<std::size_t>(cfg.n_heads) * max_seq);
+  attn.threads = cfg.n_kv_heads;
+  attn.scale = opts.folded ? 1.0f : 1.0f / std::sqrt(static_cast<float>(cfg.head_dim));
+  attn.attention = kernels::select_attention_f32(cfg.head_dim, group, opts.accum);
+  attn.kernel = "attention_f32<" + hd_label + "," + (fixed_group ? std::to_string(group) : "*") +
+                (opts.accum != kernels::Accum::Double ? std::string(",") + kernels::accum_name(opts.accum) : "") + ">";
+  p.add_op(attn);
+  p.output_begin_ = p.ops_.size();
+  project_add(kAttnOutput, attn.out, d, "attn_proj");
+
+  // ---- FFN ----
+  const int xn2 = p.add_buffer("ffn_in", d);
+  norm(kFfnNorm, xn2);
+  const int gate = p.add_buffer("gate", ffn);
+  const int up = p.add_buffer("up", ffn);
+  matvec(kFfnGate, xn2, gate, d, ffn);
+  matvec(kFfnUp, xn2, up, d, ffn);
+
+  PlanOp act;
+  act.kind = OpKind::SwiGLU;
+  act.in = gate;
+  act.in2 = up;
+  act.out = gate;
+  p.add_op(act);
+  project_add(kFfnDown, gate, ffn, "ffn_proj");
+
+  p.assign_offsets();
+  return p;
+}
+
+// Greedy interval packing: largest buffers first, each at the lowest offset that does not
+// collide with an already placed buffer whose live range overlaps.
+void LayerPlan::assign_offsets() {
+  std::vector<std::size_t> order(buffers_.size());
+  for (std::size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&](std::size_t a, std::size_t b) { return buffers_[a].floats > buffers_[b].floats; });
+
+  std::vector<std::size_t> placed;
+  scratch_floats_ = 0;
+  for (const std::size_t i : order) {
+    PlanBuffer& b = buffers_[i];
+    const std::size_t size = align_floats(b.floats);
+
+    std::vector<std::pair<std::size_t, std::size_t>> busy;  // [begin, end) of live neighbours
+    for (const std::size_t j : placed) {
+      const PlanBuffer& o = buffers_[j];
+      if (o.first <= b.last && b.first <= o.last) {
+        busy.emplace_back(o.offset, o.offset + align_floats(o.floats));
+      }
+    }
+    std::sort(busy.begin(), busy.end());
+    std::size_t off = 0;
+    for (const auto& [begin, end] : busy) {
+      if (off + size <= begin) {
+        break;
+      }
+      off = std::max(off, end);
+    }
+    b.offset = off;
+    scratch_floats_ = std::max(scratch_floats_, off + size);
+    placed.push_back(i);
+  }
+}
+
+std::size_t LayerPlan::unshared_floats() const {
+  std::size_t n = 0;
+  for (const auto& b : buffers_) {
+    n += align_floats(b.floats);
+  }
+  return n;
+}
+
+void LayerPlan::run(const LayerWeights& layer, KVCacheLayer& cache, const kernels::RoPECache& rope,
+                    std::uint32_t pos, float* x_d_model, float* scratch, ThreadPool* pool) const {
+  run_ops(0, ops_.size(), layer, cache, rope, pos, x_d_model, scratch, pool);
+}
+
+void LayerPlan::run(LayerPhase phase, const LayerWeights& layer, KVCacheLayer& cache, const kernels::RoPECache& rope,
+                    std::uint32_t pos, float* x_d_model, float* scratch, ThreadPool* pool) const {
+  switch (phase) {
+    case LayerPhase::QKV:
+      run_ops(0, attention_begin_, layer, cache, rope, pos, x_d_model, scratch, pool);
+      break;
+    case LayerPhase::Attention:
+      run_ops(attention_begin_, output_begin_, layer, cache, rope, pos, x_d_model, scratch, pool);
+      break;
+    case LayerPhase::Output:
+      run_ops(output_begin_, ops_.size(), layer, cache, rope, pos, x_d_model, scratch, pool);
+      break;
+  }
+}
+
+void LayerPlan::run_ops(std::size_t begin, std::size_t end, const LayerWeights& layer, KVCacheLayer& cache,
+                        const kernels::RoPECache& rope, std::uint32_t pos, float* x_d_model, float* scratch,
+                        ThreadPool* pool) const {
+  if (pos >= cache.max_seq()) {
+    throw std::runtime_error("LayerPlan::run pos out of range");
+  }
+  const auto weights = layer_tensors(layer);
+  auto buf = [&](int id) { return id == PlanOp::kResidual ? x_d_model : scratch + buffers_[static_cast<std::size_t>(id)].offset; };
+  const std::size_t d_model = cfg_.d_model;
+  const std::uint32_t head_dim = cfg_.head_dim;
+
+  for (std::size_t i = begin; i < end; i++) {
+    const PlanOp& op = ops_[i];
+    switch (op.kind) {
+      case OpKind::RmsNorm:
+        op.rmsnorm(buf(op.in), weights[op.weight]->data(), d_model, cfg_.rms_epsilon, buf(op.out));
+        break;
+      case OpKind::RmsNormUnit:
+        op.rmsnorm(buf(op.in), nullptr, d_model, cfg_.rms_epsilon, buf(op.out));
+        break;
+      case OpKind::MatVec:
+      case OpKind::MatVecAdd:
+        matvec_tensor(*weights[op.weight], op.matvec, op.kind == OpKind::MatVecAdd,
+                      tensor_threads(*weights[op.weight], op.threads, op.packed_threads), pool, buf(op.in),
+                      buf(op.out));
+        break;
+      case OpKind::Add:
+        kernels::add_inplace(buf(op.out), buf(op.in), d_model);
+        break;
+      case OpKind::Rope:
+        op.rope(rope, buf(op.out), op.rows, head_dim, pos);
+        break;
+      case OpKind::KvWrite:
+        cache.write(pos, buf(op.in), buf(op.in2));
+        break;
+      case OpKind::Attention: {
+        kernels::AttentionArgs a;
+        a.q = buf(op.in);
+        a.k_cache = cache.k_ptr(0, 0);
+        a.v_cache = cache.v_ptr(0, 0);
+        a.kv_head_stride = static_cast<std::size_t>(cache.max_seq()) * head_dim;
+        a.n_heads = cfg_.n_heads;
+        a.n_kv_heads = cfg_.n_kv_heads;
+        a.head_dim = head_dim;
+        a.n_pos = pos + 1;
+        a.scale = op.scale;
+        a.scores = buf(op.tmp);
+        a.out = buf(op.out);
+        if (pool == nullptr || pool->size() == 1 || op.threads <= 1) {
+          op.attention(a);
+          break;
+        }
+        // One task per kv head and its GQA group, each with its own rows of `scores`.
+        const std::uint32_t group = cfg_.n_heads / cfg_.n_kv_heads;
+        const std::size_t group_floats = static_cast<std::size_t>(group) * head_dim;
+        pool->parallel_for(op.threads, [&](std::size_t kv) {
+          kernels::AttentionArgs h = a;
+          h.q = a.q + kv * group_floats;
+          h.k_cache = a.k_cache + kv * a.kv_head_stride;
+          h.v_cache = a.v_cache + kv * a.kv_head_stride;
+          h.n_heads = group;
+          h.n_kv_heads = 1;
+          h.scores = a.scores + kv * group * static_cast<std::size_t>(a.n_pos);
+          h.out = a.out + kv * group_floats;
+          op.attention(h);
+        });
+        break;
+      }
+      case OpKind::SwiGLU: {
+        const float* g = buf(op.in);
+        const float* u = buf(op.in2);
+        float* o = buf(op.out);
+        for (std::uint32_t i = 0; i < cfg_.ffn_hidden_dim; i++) {
+          o[i] = kernels::silu(g[i]) * u[i];
+        }
+        break;
+      }
+    }
+  }
+}
+
+std::string LayerPlan::describe() const {
+  std::ostringstream oss;
+  auto name = [&](int id) -> std::string {
+    if (id == PlanOp::kResidual) return "x";
+    return id >= 0 ? buffers_[static_cast<std::size_t>(id)].name : "-";
+  };
+  for (std::size_t i = 0; i < ops_.size(); i++) {
+    const PlanOp& op = ops_[i];
+    oss << i << ": " << op_name(op.kind) << " " << name(op.out) << " <- " << name(op.in);
+    if (op.in2 >= 0) oss << ", " << name(op.in2);
+    if (op.weight >= 0) oss << " [" << kLayerTensorSuffixes[static_cast<std::size_t>(op.weight)] << "]";
+    if (!op.kernel.empty()) oss << " " << op.kernel;
+    oss << "\n";
+  }
+  for (const auto& b : buffers_) {
+    oss << "  " << b.name << ": " << b.floats << " floats @" << b.offset << ", live " << b.first << ".." << b.last
+        << "\n";
+  }
+  oss << "scratch: " << scratch_floats_ << " floats (" << unshared_floats() << " unshared)\n";
+  return oss.str();
+}
+
+}  // namespace cieft
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gguf_loader.h"
+#include "kernels/accum.h"
+#include "kernels/attention.h"
+#include "kernels/matvec.h"
+#include "kernels/rmsnorm.h"
+#include "kernels/rope.h"
+#include "tuning.h"
+#include "weights.h"
+
+namespace cieft {
+
+class KVCacheLayer;
+class ThreadPool;
+
+using kernels::MatVecFn;
+
+enum class OpKind {
+  RmsNorm,      // out = rmsnorm(in) * gain
+  RmsNormUnit,  // out = rmsnorm(in); the gain was folded into the weights
+  MatVec,       // out = W^T in
+  MatVecAdd,    // out += W^T in: the residual add fused into the matmul
+  Add,          // out += in
+  Rope,         // rotate `out` in place (`rows` heads)
+  KvWrite,      // cache[pos] = (in, in2)
+  Attention,    // out = softmax(q . K * scale) V over cache[0..pos]; `tmp` holds a score
+                // row per query head, so kv heads can run as separate tasks
+  SwiGLU,       // out = silu(in) * in2
+};
+
+// Consecutive parts of a layer's op list. Attention reads the KV cache (bandwidth bound on
+// cached positions); the other two are the layer's matmuls (bandwidth bound on weights).
+// Running them separately lets one sequence's attention overlap another's matmuls.
+enum class LayerPhase {
+  QKV,        // attention norm and the q/k/v projections
+  Attention,  // RoPE, KV-cache write and attention; reads and writes no residual
+  Output,     // attention output projection and the FFN
+};
+
+// One step of a compiled layer. Operands are buffer ids: `kResidual` is the layer's
+// in/out vector, other non-negative ids index `LayerPlan::buffers()`.
+struct PlanOp {
+  static constexpr int kNone = -1;
+  static constexpr int kResidual = -2;
+
+  OpKind kind = OpKind::Add;
+  int in = kNone;
+  int in2 = kNone;
+  int out = kNone;
+  int tmp = kNone;
+  int weight = kNone;      // index into `layer_tensors()` for norms and matmuls
+  std::uint32_t rows = 0;  // matmul in_dim, or head count for Rope
+  std::uint32_t cols = 0;  // matmul out_dim
+  float scale = 1.0f;      // Attention score scale
+  // MatVec(Add) threads (`kPoolThreads`: all), or Attention kv-head tasks, on the pool given to `run`
+  std::uint32_t threads = 1;
+  PackedThreads packed_threads;  // MatVec(Add) threads when the weight is packed, per ggml type
+
+  // Kernel chosen at compile time for norms, MatVec(Add), Rope and Attention, and its label.
+  kernels::RmsNormFn rmsnorm = nullptr;
+  MatVecFn matvec = nullptr;
+  kernels::RopeFn rope = nullptr;
+  kernels::AttentionFn attention = nullptr;
+  std::string kernel;
+};
+
+// An intermediate. `first`/`last` are the op indices that define and last read it; buffers
+// whose ranges do not overlap may share scratch.
+struct PlanBuffer {
+  std::string name;
+  std::size_t floats = 0;
+  std::size_t offset = 0;  // in floats, into the scratch passed to `run`
+  std::size_t first = 0;
+  std::size_t last = 0;
+};
+
+struct PlanOptions {
+  bool folded = false;        // layers went through `fold_layer_weights`
+  bool fuse_residual = true;  // accumulate attn_output/ffn_down straight into the residual
+  const TuningProfile* tuning = nullptr;  // per-shape matvec variant and thread count
+  kernels::Accum accum = kernels::Accum::Double;  // reduction precision of every kernel
+};
+
+// Compiled op list for one transformer layer. Fusion choices, kernel selection and
+// scratch placement happen once in `compile`; `run` only dispatches.
+class LayerPlan {
+ public:
+  LayerPlan() = default;
+
+  static LayerPlan compile(const ModelConfig& cfg, const PlanOptions& opts = {});
+
+  const std::vector<PlanOp>& ops() const { return ops_; }
+  const std::vector<PlanBuffer>& buffers() const { return buffers_; }
+
+  // Floats of scratch `run` needs, with intermediates sharing memory by liveness.
+  std::size_t scratch_floats() const { return scratch_floats_; }
+  // What the same intermediates would take with one buffer each.
+  std::size_t unshared_floats() const;
+
+  // Matmuls tuned for more than one thread split their columns across `pool`; without a
+  // pool everything runs on the caller.
+  void run(const LayerWeights& layer, KVCacheLayer& cache, const kernels::RoPECache& rope, std::uint32_t pos,
+           float* x_d_model, float* scratch, ThreadPool* pool = nullptr) const;
+
+  // Runs only the ops of `phase`. Running QKV, Attention and Output in that order, with
+  // the same scratch, is `run`; scratch must stay untouched between a sequence's phases.
+  void run(LayerPhase phase, const LayerWeights& layer, KVCacheLayer& cache, const kernels::RoPECache& rope,
+           std::uint32_t pos, float* x_d_model, float* scratch, ThreadPool* pool = nullptr) const;
+
+  // One line per op and per buffer, for debugging.
+  std::string describe() const;
+
+ private:
+  int add_buffer(std::string name, std::size_t floats);
+  void add_op(const PlanOp& op);
+  void assign_offsets();
+  void run_ops(std::size_t begin, std::size_t end, const LayerWeights& layer, KVCacheLayer& cache,
+               const kernels::RoPECache& rope, std::uint32_t pos, float* x_d_model, float* scratch,
+               ThreadPool* pool) const;
+
+  ModelConfig cfg_;
+  std::vector<PlanOp> ops_;
+  std::vector<PlanBuffer> buffers_;
+  std::size_t scratch_floats_ = 0;
+  std::size_t attention_begin_ = 0;  // first op of LayerPhase::Attention
+  std::size_t output_begin_ = 0;     // first op of LayerPhase::Output
+};
+
+}  // namespace cieft
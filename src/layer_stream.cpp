@@ -0,0 +1,224 @@
+#include "layer_stream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "reader.h"
+
+namespace cieft {
+
+namespace {
+
+double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+void pread_all(int fd, std::uint8_t* dst, std::size_t n, std::uint64_t offset, const std::string& path) {
+  while (n > 0) {
+    const ssize_t r = ::pread(fd, dst, n, static_cast<off_t>(offset));
+    if (r < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error("pread failed: " + path + ": " + std::strerror(errno));
+    }
+    if (r == 0) {
+      throw std::runtime_error("pread past EOF: " + path);
+    }
+    dst += r;
+    n -= static_cast<std::size_t>(r);
+    offset += static_cast<std::uint64_t>(r);
+  }
+}
+
+}  // namespace
+
+LayerStreamer::LayerStreamer(const GGUFLoader& loader,
+                             const ModelConfig& cfg,
+                             const std::vector<std::uint32_t>& layers,
+                             const StreamOptions& opts)
+    : loader_(loader), cfg_(cfg), opts_(opts), layer_ids_(layers) {
+  if (layer_ids_.empty()) {
+    throw std::runtime_error("LayerStreamer: no layers");
+  }
+  if (opts_.resident_layers < 2 && layer_ids_.size() > 1) {
+    throw std::runtime_error("LayerStreamer: resident_layers must be >= 2");
+  }
+
+  std::size_t staging_bytes = 0;
+  ranges_.resize(layer_ids_.size());
+  for (std::size_t p = 0; p < layer_ids_.size(); p++) {
+    if (layer_ids_[p] >= cfg.n_layers) {
+      throw std::runtime_error("layer index out of range");
+    }
+    check_layer_shapes(loader_, cfg, layer_ids_[p]);
+
+    std::size_t off = 0;
+    for (const auto suffix : kLayerTensorSuffixes) {
+      TensorRange r;
+      r.view = loader_.get_tensor(layer_tensor_name(layer_ids_[p], suffix));
+      r.staging_off = off;
+      off = align_up(off + static_cast<std::size_t>(r.view.nbytes), 64);
+      ranges_[p].push_back(r);
+    }
+    staging_bytes = std::max(staging_bytes, off);
+  }
+  staging_ = AlignedBuffer::allocate(staging_bytes, 4096);
+
+  // All layers share a shape, so any layer's dims size every slot.
+  const std::size_t n_slots = std::min<std::size_t>(opts_.resident_layers, layer_ids_.size());
+  slots_.reserve(n_slots);
+  for (std::size_t s = 0; s < n_slots; s++) {
+    slots_.push_back(allocate_layer_f32(loader_, layer_ids_[s], opts_.alignment));
+  }
+
+  if (opts_.dequant_threads > 1) {
+    pool_ = std::make_unique<ThreadPool>(opts_.dequant_threads);
+  }
+
+  for (std::size_t s = 0; s < loader_.shard_count(); s++) {
+    const std::string& path = loader_.mapped_file(s).path();
+    fds_.push_back(::open(path.c_str(), O_RDONLY));
+    if (fds_.back() < 0) {
+      fds_.pop_back();
+      for (const int fd : fds_) {
+        ::close(fd);
+      }
+      throw std::runtime_error("open failed: " + path);
+    }
+  }
+
+  worker_ = std::thread([this] { loader_loop(); });
+}
+
+LayerStreamer::~LayerStreamer() {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+  for (const int fd : fds_) {
+    ::close(fd);
+  }
+}
+
+const LayerWeights& LayerStreamer::acquire(std::size_t i) {
+  std::unique_lock<std::mutex> lk(mu_);
+  const std::uint64_t seq = acquired_;
+  if (i != seq % layer_ids_.size()) {
+    throw std::runtime_error("LayerStreamer::acquire: layers must be acquired in execution order");
+  }
+
+  // With every layer resident, each position is loaded exactly once.
+  const std::uint64_t need = all_resident() ? seq % layer_ids_.size() : seq;
+  const auto t0 = std::chrono::steady_clock::now();
+  cv_.wait(lk, [&] { return error_ || loaded_ > need; });
+  stats_.stall_s += seconds_since(t0);
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+
+  acquired_ += 1;
+  return slots_[slot_of(seq)];
+}
+
+void LayerStreamer::release(std::size_t i) {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (released_ >= acquired_ || i != released_ % layer_ids_.size()) {
+      throw std::runtime_error("LayerStreamer::release: out of order");
+    }
+    released_ += 1;
+  }
+  cv_.notify_all();
+}
+
+StreamStats LayerStreamer::stats() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return stats_;
+}
+
+void LayerStreamer::loader_loop() {
+  const std::size_t n = layer_ids_.size();
+  for (std::uint64_t seq = 0;; seq++) {
+    if (all_resident() && seq >= n) {
+      return;
+    }
+    {
+      std::unique_lock<std::mutex> lk(mu_);
+      cv_.wait(lk, [&] { return stop_ || seq < released_ + slots_.size(); });
+      if (stop_) {
+        return;
+      }
+    }
+
+    try {
+      load_into(static_cast<std::size_t>(seq % n), slots_[slot_of(seq)]);
+    } catch (...) {
+      std::lock_guard<std::mutex> lk(mu_);
+      error_ = std::current_exception();
+      cv_.notify_all();
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      loaded_ = seq + 1;
+    }
+    cv_.notify_all();
+  }
+}
+
+void LayerStreamer::load_into(std::size_t pos, LayerWeights& dst) {
+  auto* staging = static_cast<std::uint8_t*>(staging_.data());
+  const auto t_read = std::chrono::steady_clock::now();
+  std::uint64_t bytes = 0;
+  for (const auto& r : ranges_[pos]) {
+    pread_all(fds_[r.view.shard], staging + r.staging_off, static_cast<std::size_t>(r.view.nbytes), r.view.file_offset,
+              loader_.mapped_file(r.view.shard).path());
+    bytes += r.view.nbytes;
+  }
+#ifdef POSIX_FADV_DONTNEED
+  if (opts_.drop_page_cache) {
+    for (const auto& r : ranges_[pos]) {
+      ::posix_fadvise(fds_[r.view.shard], static_cast<off_t>(r.view.file_offset), static_cast<off_t>(r.view.nbytes),
+                      POSIX_FADV_DONTNEED);
+    }
+  }
+#endif
+  const double read_s = seconds_since(t_read);
+
+  const auto t_deq = std::chrono::steady_clock::now();
+  const auto tensors = layer_tensors(dst);
+  for (std::size_t k = 0; k < ranges_[pos].size(); k++) {
+    TensorView v = ranges_[pos][k].view;
+    v.data = staging + ranges_[pos][k].staging_off;
+    dequantize_tensor(v, *tensors[k], pool_.get());
+  }
+  dst.index = layer_ids_[pos];
+  dst.folded = false;  // slots are reused; the tensors were just overwritten
+  if (opts_.fold_weights) {
+    fold_layer_weights(dst, cfg_, pool_.get());
+  }
+  const double dequant_s = seconds_since(t_deq);
+
+  std::lock_guard<std::mutex> lk(mu_);
+  stats_.layers_loaded += 1;
+  stats_.bytes_read += bytes;
+  stats_.read_s += read_s;
+  stats_.dequant_s += dequant_s;
+}
+
+}  // namespace cieft
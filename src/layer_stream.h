@@ -0,0 +1,91 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "aligned_alloc.h"
+#include "forward.h"
+#include "gguf_loader.h"
+#include "thread_pool.h"
+#include "weights.h"
+
+namespace cieft {
+
+struct StreamOptions {
+  std::uint32_t resident_layers = 2;  // slots; >= 2 so one can load while another computes
+  std::uint32_t dequant_threads = 1;  // pool used by the loader thread
+  bool drop_page_cache = true;        // posix_fadvise(DONTNEED) after each read
+  std::size_t alignment = 64;
+  bool fold_weights = false;  // `fold_layer_weights` each layer after dequantizing it
+};
+
+// Cumulative counters; diff two snapshots for per-token numbers.
+struct StreamStats {
+  std::uint64_t layers_loaded = 0;
+  std::uint64_t bytes_read = 0;
+  double read_s = 0.0;     // time inside pread
+  double dequant_s = 0.0;  // time dequantizing into slots
+  double stall_s = 0.0;    // time `acquire` waited for a layer
+};
+
+// Out-of-core layer source for models larger than RAM. Only `resident_layers` layers are
+// materialized at once; a loader thread `pread`s the next layers' tensors into an aligned
+// staging buffer and dequantizes them into free slots while earlier layers compute.
+// Layers must be acquired/released in cyclic execution order (0..n-1, 0..n-1, ...).
+class LayerStreamer final : public LayerSource {
+ public:
+  LayerStreamer(const GGUFLoader& loader,
+                const ModelConfig& cfg,
+                const std::vector<std::uint32_t>& layers,
+                const StreamOptions& opts = {});
+  ~LayerStreamer() override;
+
+  LayerStreamer(const LayerStreamer&) = delete;
+  LayerStreamer& operator=(const LayerStreamer&) = delete;
+
+  std::size_t size() const override { return layer_ids_.size(); }
+  const LayerWeights& acquire(std::size_t i) override;
+  void release(std::size_t i) override;
+
+  std::uint32_t slots() const { return static_cast<std::uint32_t>(slots_.size()); }
+  StreamStats stats() const;
+
+ private:
+  struct TensorRange {
+    TensorView view;           // dims/type from the file; `data` is rebased into staging
+    std::size_t staging_off = 0;
+  };
+
+  void loader_loop();
+  void load_into(std::size_t pos, LayerWeights& dst);
+  bool all_resident() const { return slots_.size() >= layer_ids_.size(); }
+  std::size_t slot_of(std::uint64_t seq) const { return static_cast<std::size_t>(seq % slots_.size()); }
+
+  const GGUFLoader& loader_;
+  ModelConfig cfg_;
+  StreamOptions opts_;
+  std::vector<std::uint32_t> layer_ids_;
+  std::vector<std::vector<TensorRange>> ranges_;  // per position
+  std::vector<LayerWeights> slots_;
+  AlignedBuffer staging_;
+  std::vector<int> fds_;  // per shard
+  std::unique_ptr<ThreadPool> pool_;
+
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  std::uint64_t loaded_ = 0;    // sequence numbers [0, loaded_) are ready
+  std::uint64_t acquired_ = 0;  // next sequence number `acquire` expects
+  std::uint64_t released_ = 0;  // sequence numbers [0, released_) may be overwritten
+  bool stop_ = false;
+  std::exception_ptr error_;
+  StreamStats stats_;
+  std::thread worker_;
+};
+
+}  // namespace cieft
@@ -0,0 +1,102 @@
+#include "lazy_layers.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace cieft {
+
+LazyLayers::LazyLayers(const GGUFLoader& loader,
+                       const ModelConfig& cfg,
+                       const std::vector<std::uint32_t>& layers,
+                       const LazyOptions& opts)
+    : loader_(loader),
+      cfg_(cfg),
+      opts_(opts),
+      layer_ids_(layers),
+      bytes_(layers.size(), 0),
+      resident_(layers.size()),
+      pins_(layers.size(), 0),
+      lru_pos_(layers.size(), lru_.end()) {
+  for (std::size_t p = 0; p < layer_ids_.size(); p++) {
+    if (layer_ids_[p] >= cfg.n_layers) {
+      throw std::runtime_error("layer index out of range");
+    }
+    check_layer_shapes(loader_, cfg, layer_ids_[p]);
+    for (const auto suffix : kLayerTensorSuffixes) {
+      const auto t = loader_.get_tensor(layer_tensor_name(layer_ids_[p], suffix));
+      std::uint64_t numel = 1;
+      for (const auto d : t.dims) {
+        numel *= d;
+      }
+      bytes_[p] += static_cast<std::size_t>(numel * sizeof(float));
+    }
+  }
+  if (opts_.dequant_threads > 1) {
+    pool_ = std::make_unique<ThreadPool>(opts_.dequant_threads);
+  }
+}
+
+const LayerWeights& LazyLayers::acquire(std::size_t i) {
+  if (i >= layer_ids_.size()) {
+    throw std::runtime_error("LazyLayers::acquire: layer position out of range");
+  }
+
+  if (resident_[i]) {
+    stats_.hits += 1;
+    lru_.splice(lru_.begin(), lru_, lru_pos_[i]);
+  } else {
+    stats_.misses += 1;
+    evict_for(bytes_[i]);
+
+    const auto t0 = std::chrono::steady_clock::now();
+    auto lw = std::make_unique<LayerWeights>(allocate_layer_f32(loader_, layer_ids_[i], opts_.alignment));
+    const auto dst = layer_tensors(*lw);
+    for (std::size_t k = 0; k < kLayerTensorSuffixes.size(); k++) {
+      dequantize_tensor(loader_.get_tensor(layer_tensor_name(layer_ids_[i], kLayerTensorSuffixes[k])), *dst[k],
+                        pool_.get());
+    }
+    if (opts_.fold_weights) {
+      fold_layer_weights(*lw, cfg_, pool_.get());
+    }
+    stats_.dequant_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    resident_[i] = std::move(lw);
+    lru_.push_front(i);
+    lru_pos_[i] = lru_.begin();
+    stats_.resident_bytes += bytes_[i];
+    stats_.peak_bytes = std::max(stats_.peak_bytes, stats_.resident_bytes);
+  }
+
+  pins_[i] += 1;
+  return *resident_[i];
+}
+
+void LazyLayers::release(std::size_t i) {
+  if (i >= layer_ids_.size() || pins_[i] == 0) {
+    throw std::runtime_error("LazyLayers::release: layer not acquired");
+  }
+  pins_[i] -= 1;
+}
+
+void LazyLayers::evict_for(std::size_t incoming_bytes) {
+  if (opts_.budget_bytes == 0) {
+    return;
+  }
+  // Walk from the cold end; pinned layers are skipped, not evicted.
+  auto it = lru_.end();
+  while (it != lru_.begin() && stats_.resident_bytes + incoming_bytes > opts_.budget_bytes) {
+    --it;
+    const std::size_t p = *it;
+    if (pins_[p] != 0) {
+      continue;
+    }
+    it = lru_.erase(it);
+    lru_pos_[p] = lru_.end();
+    resident_[p].reset();
+    stats_.resident_bytes -= bytes_[p];
+    stats_.evictions += 1;
+  }
+}
+
+}  // namespace cieft
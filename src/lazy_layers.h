@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "forward.h"
+#include "gguf_loader.h"
+#include "thread_pool.h"
+#include "weights.h"
+
+namespace cieft {
+
+struct LazyOptions {
+  std::size_t budget_bytes = 0;       // float32 bytes kept materialized; 0 = unlimited
+  std::uint32_t dequant_threads = 1;  // pool used to materialize a layer
+  std::size_t alignment = 64;
+  bool fold_weights = false;  // `fold_layer_weights` each layer after dequantizing it
+};
+
+// Cumulative counters.
+struct LazyStats {
+  std::uint64_t hits = 0;       // acquire found the layer materialized
+  std::uint64_t misses = 0;     // acquire had to dequantize it
+  std::uint64_t evictions = 0;  // layers dropped back to their mmap form
+  std::size_t resident_bytes = 0;
+  std::size_t peak_bytes = 0;
+  double dequant_s = 0.0;
+};
+
+// Layer source that keeps every layer in its compact (quantized, mmap-backed) form and
+// dequantizes one on first use. Materialized layers form an LRU; when adding one would
+// exceed `budget_bytes`, least recently used layers that are not currently acquired are
+// freed again. A layer larger than the whole budget is still materialized on its own.
+// Not thread-safe: acquire/release from the thread running the forward pass.
+class LazyLayers final : public LayerSource {
+ public:
+  LazyLayers(const GGUFLoader& loader,
+             const ModelConfig& cfg,
+             const std::vector<std::uint32_t>& layers,
+             const LazyOptions& opts = {});
+
+  LazyLayers(const LazyLayers&) = delete;
+  LazyLayers& operator=(const LazyLayers&) = delete;
+
+  std::size_t size() const override { return layer_ids_.size(); }
+  const LayerWeights& acquire(std::size_t i) override;
+  void release(std::size_t i) override;
+
+  std::size_t layer_bytes(std::size_t i) const { return bytes_.at(i); }
+  const LazyStats& stats() const { return stats_; }
+
+ private:
+  void evict_for(std::size_t incoming_bytes);
+
+  const GGUFLoader& loader_;
+  ModelConfig cfg_;
+  LazyOptions opts_;
+  std::vector<std::uint32_t> layer_ids_;
+  std::vector<std::size_t> bytes_;  // float32 bytes per position once materialized
+  std::vector<std::unique_ptr<LayerWeights>> resident_;
+  std::vector<std::uint32_t> pins_;
+  std::list<std::size_t> lru_;  // front = most recently used
+  std::vector<std::list<std::size_t>::iterator> lru_pos_;
+  std::unique_ptr<ThreadPool> pool_;
+  LazyStats stats_;
+};
+
+}  // namespace cieft
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <cerrno>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <utility>
 
 #include <fcntl.h>
@@ -13,9 +17,35 @@
 
 namespace cieft {
 
+enum class MapAdvice {
+  Normal,
+  Sequential,
+  Random,
+  WillNeed,
+  DontNeed,
+};
+
+inline std::optional<MapAdvice> parse_map_advice(std::string_view s) {
+  if (s == "normal") return MapAdvice::Normal;
+  if (s == "seq" || s == "sequential") return MapAdvice::Sequential;
+  if (s == "random") return MapAdvice::Random;
+  if (s == "willneed") return MapAdvice::WillNeed;
+  if (s == "dontneed") return MapAdvice::DontNeed;
+  return std::nullopt;
+}
+
+// Mapping policy. Linux-only knobs (MAP_POPULATE, MADV_HUGEPAGE) degrade to the closest
+// portable behaviour elsewhere: populate becomes MADV_WILLNEED, hugepage is ignored.
+struct MapOptions {
+  bool populate = false;                 // prefault the whole file at mmap time
+  MapAdvice advice = MapAdvice::Normal;  // applied to the whole mapping
+  bool hugepage = false;                 // MADV_HUGEPAGE (needs THP for page-cache files)
+  bool lock = false;                     // mlock the whole mapping
+};
+
 class MappedFile {
  public:
-  explicit MappedFile(const std::string& path) : path_(path) {
+  explicit MappedFile(const std::string& path, const MapOptions& opts = {}) : path_(path) {
     fd_ = ::open(path.c_str(), O_RDONLY);
     if (fd_ < 0) {
       throw std::runtime_error("open failed: " + path);
@@ -37,7 +67,13 @@ class MappedFile {
       throw std::runtime_error("empty file: " + path);
     }
 
-    void* mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (opts.populate) {
+      flags |= MAP_POPULATE;
+    }
+#endif
+    void* mapped = ::mmap(nullptr, size_, PROT_READ, flags, fd_, 0);
     if (mapped == MAP_FAILED) {
       ::close(fd_);
       throw std::runtime_error("mmap failed: " + path);
@@ -48,6 +84,21 @@ class MappedFile {
     // mapping is established; fd no longer needed
     ::close(fd_);
     fd_ = -1;
+
+#ifndef MAP_POPULATE
+    if (opts.populate) {
+      advise(0, size_, MapAdvice::WillNeed);
+    }
+#endif
+    if (opts.advice != MapAdvice::Normal) {
+      advise(0, size_, opts.advice);
+    }
+    if (opts.hugepage) {
+      advise_hugepage(0, size_);
+    }
+    if (opts.lock) {
+      lock(0, size_);
+    }
   }
 
   ~MappedFile() {
@@ -90,7 +141,72 @@ class MappedFile {
   std::size_t size() const { return size_; }
   const std::string& path() const { return path_; }
 
+  // Range hints; `offset`/`len` need not be page aligned. Hints are best effort: returns
+  // false if the kernel rejected the advice.
+  bool advise(std::size_t offset, std::size_t len, MapAdvice advice) const {
+    int a = MADV_NORMAL;
+    switch (advice) {
+      case MapAdvice::Normal:
+        a = MADV_NORMAL;
+        break;
+      case MapAdvice::Sequential:
+        a = MADV_SEQUENTIAL;
+        break;
+      case MapAdvice::Random:
+        a = MADV_RANDOM;
+        break;
+      case MapAdvice::WillNeed:
+        a = MADV_WILLNEED;
+        break;
+      case MapAdvice::DontNeed:
+        a = MADV_DONTNEED;
+        break;
+    }
+    const auto [p, n] = page_range(offset, len);
+    return n == 0 || ::madvise(p, n, a) == 0;
+  }
+
+  bool advise_hugepage(std::size_t offset, std::size_t len) const {
+#ifdef MADV_HUGEPAGE
+    const auto [p, n] = page_range(offset, len);
+    return n == 0 || ::madvise(p, n, MADV_HUGEPAGE) == 0;
+#else
+    (void)offset;
+    (void)len;
+    return false;
+#endif
+  }
+
+  // Pins a range in RAM. Throws if the kernel refuses (typically RLIMIT_MEMLOCK).
+  void lock(std::size_t offset, std::size_t len) const {
+    const auto [p, n] = page_range(offset, len);
+    if (n != 0 && ::mlock(p, n) != 0) {
+      throw std::runtime_error("mlock failed: " + path_ + ": " + std::strerror(errno));
+    }
+  }
+
+  void unlock(std::size_t offset, std::size_t len) const {
+    const auto [p, n] = page_range(offset, len);
+    if (n != 0) {
+      ::munlock(p, n);
+    }
+  }
+
  private:
+  // Expands [offset, offset+len) to whole pages, clamped to the mapping.
+  std::pair<void*, std::size_t> page_range(std::size_t offset, std::size_t len) const {
+    if (offset >= size_ || len == 0) {
+      return {nullptr, 0};
+    }
+    if (len > size_ - offset) {
+      len = size_ - offset;
+    }
+    const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    const std::size_t begin = offset / page * page;
+    const std::size_t end = offset + len;
+    return {const_cast<std::uint8_t*>(data_) + begin, end - begin};
+  }
+
   std::string path_;
   int fd_ = -1;
   const std::uint8_t* data_ = nullptr;
@@ -0,0 +1,165 @@
+#include "numa.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "thread_pool.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#define CIEFT_HAVE_NUMA 1
+#endif
+
+namespace cieft {
+
+namespace {
+
+#ifdef CIEFT_HAVE_NUMA
+constexpr int kMpolPreferred = 1;         // MPOL_PREFERRED
+constexpr unsigned kMpolMfMove = 1u << 1;  // MPOL_MF_MOVE
+#endif
+
+// Parses a sysfs cpulist such as "0-3,8-11".
+std::vector<int> parse_cpulist(const std::string& s) {
+  std::vector<int> cpus;
+  std::stringstream ss(s);
+  std::string part;
+  while (std::getline(ss, part, ',')) {
+    if (part.empty() || part == "\n") {
+      continue;
+    }
+    const std::size_t dash = part.find('-');
+    const int lo = std::stoi(part.substr(0, dash));
+    const int hi = dash == std::string::npos ? lo : std::stoi(part.substr(dash + 1));
+    for (int c = lo; c <= hi; c++) {
+      cpus.push_back(c);
+    }
+  }
+  return cpus;
+}
+
+std::string read_line(const std::string& path) {
+  std::ifstream in(path);
+  std::string line;
+  std::getline(in, line);
+  return line;
+}
+
+}  // namespace
+
+NumaTopology NumaTopology::detect() {
+  NumaTopology t;
+#ifdef CIEFT_HAVE_NUMA
+  // Memory-less nodes cannot hold weights; their CPUs are left out.
+  const std::string nodes = read_line("/sys/devices/system/node/has_memory");
+  for (const int node : parse_cpulist(nodes)) {
+    auto cpus = parse_cpulist(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+    if (!cpus.empty()) {
+      t.node_cpus.push_back(std::move(cpus));
+      t.node_ids.push_back(node);
+    }
+  }
+#endif
+  if (t.node_cpus.empty()) {
+    std::vector<int> all(std::max(1u, std::thread::hardware_concurrency()));
+    for (std::size_t i = 0; i < all.size(); i++) {
+      all[i] = static_cast<int>(i);
+    }
+    t.node_cpus.push_back(std::move(all));
+    t.node_ids = {0};
+  }
+  return t;
+}
+
+std::string NumaTopology::describe() const {
+  std::ostringstream oss;
+  oss << nodes() << " node" << (nodes() == 1 ? "" : "s") << ":";
+  for (std::size_t n = 0; n < node_cpus.size(); n++) {
+    oss << " node" << node_ids[n] << "=" << node_cpus[n].size() << "cpu";
+  }
+  return oss.str();
+}
+
+bool numa_bind(void* addr, std::size_t bytes, int node_id) {
+#ifdef CIEFT_HAVE_NUMA
+  const auto page = static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+  const auto begin = (reinterpret_cast<std::uintptr_t>(addr) + page - 1) / page * page;
+  const auto end = (reinterpret_cast<std::uintptr_t>(addr) + bytes) / page * page;
+  if (end <= begin) {
+    return true;  // nothing whole to bind
+  }
+  constexpr std::size_t kMaskBits = 1024;
+  if (node_id < 0 || static_cast<std::size_t>(node_id) >= kMaskBits) {
+    return false;
+  }
+  const auto node = static_cast<std::size_t>(node_id);
+  unsigned long mask[kMaskBits / (8 * sizeof(unsigned long))] = {};
+  mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+  return ::syscall(SYS_mbind, begin, end - begin, kMpolPreferred, mask, kMaskBits + 1, kMpolMfMove) == 0;
+#else
+  (void)addr;
+  (void)bytes;
+  (void)node_id;
+  return false;
+#endif
+}
+
+std::uint32_t numa_place_columns(void* data, std::size_t col_bytes, std::uint64_t n_cols,
+                                 const std::vector<int>& node_ids) {
+  const auto nodes = static_cast<std::uint32_t>(node_ids.size());
+  std::uint32_t refused = 0;
+  for (std::uint32_t node = 0; node < nodes; node++) {
+    const auto [c0, c1] = numa_column_range(n_cols, nodes, node);
+    if (c1 > c0 &&
+        !numa_bind(static_cast<std::uint8_t*>(data) + c0 * col_bytes, (c1 - c0) * col_bytes, node_ids[node])) {
+      refused++;
+    }
+  }
+  return refused;
+}
+
+bool pin_current_thread(const std::vector<int>& cpus) {
+#ifdef CIEFT_HAVE_NUMA
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const int c : cpus) {
+    if (c >= 0 && c < CPU_SETSIZE) {
+      CPU_SET(c, &set);
+    }
+  }
+  return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+
+std::uint32_t assign_pool_to_nodes(ThreadPool& pool, const NumaTopology& topo, std::uint32_t nodes) {
+  nodes = std::clamp(nodes, 1u, pool.size());
+  std::vector<std::uint32_t> thread_node(pool.size());
+  for (std::uint32_t t = 0; t < pool.size(); t++) {
+    thread_node[t] = static_cast<std::uint32_t>(static_cast<std::uint64_t>(t) * nodes / pool.size());
+  }
+  pool.set_thread_nodes(thread_node);
+  if (nodes != topo.nodes() || nodes == 1) {
+    return 0;
+  }
+  std::atomic<std::uint32_t> pinned{0};
+  pool.for_each_thread([&](std::uint32_t t) {
+    if (t != 0 && pin_current_thread(topo.node_cpus[thread_node[t]])) {
+      pinned.fetch_add(1);
+    }
+  });
+  return pinned.load();
+}
+
+}  // namespace cieft
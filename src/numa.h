@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cieft {
+
+class ThreadPool;
+
+// CPUs of each NUMA node with memory, from /sys/devices/system/node (Linux). Elsewhere,
+// or when sysfs is unavailable, a single node holding every CPU. Nodes are indexed
+// densely (the index splits columns and threads); `node_ids` holds the kernel's id of
+// each, which is what memory policies take and may have gaps ("0,2").
+struct NumaTopology {
+  std::vector<std::vector<int>> node_cpus;
+  std::vector<int> node_ids;
+
+  static NumaTopology detect();
+
+  std::uint32_t nodes() const { return static_cast<std::uint32_t>(node_cpus.size()); }
+  std::string describe() const;
+};
+
+// Columns [first, second) of an `n_cols`-column matrix that live on `node` of `nodes`.
+// The loader places them there and NUMA-aware matmuls compute them there.
+inline std::pair<std::uint64_t, std::uint64_t> numa_column_range(std::uint64_t n_cols, std::uint32_t nodes,
+                                                                 std::uint32_t node) {
+  return {n_cols * node / nodes, n_cols * (node + 1) / nodes};
+}
+
+// Asks the kernel to back the pages of `[addr, addr + bytes)` from kernel node id
+// `node_id` (mbind with MPOL_PREFERRED, moving pages already present). Only whole pages
+// inside the range are bound. Returns false where unsupported or refused; placement is a
+// hint either way.
+bool numa_bind(void* addr, std::size_t bytes, int node_id);
+
+// Binds range n of a column-major matrix (`n_cols` columns of `col_bytes`, split over
+// `node_ids.size()` nodes by `numa_column_range`) to kernel node `node_ids[n]`. Returns the
+// number of ranges the kernel refused.
+std::uint32_t numa_place_columns(void* data, std::size_t col_bytes, std::uint64_t n_cols,
+                                 const std::vector<int>& node_ids);
+
+// Pins the calling thread to `cpus`. Returns false where unsupported (macOS) or refused.
+bool pin_current_thread(const std::vector<int>& cpus);
+
+// Splits `pool`'s threads into `nodes` contiguous groups (thread 0, the caller, goes to
+// node 0), records the split in the pool and, if `topo` has that many nodes, pins every
+// worker to its node's CPUs. The caller is left unpinned: threads it starts later (loader
+// pools, prefetchers, streamers) inherit its affinity and must keep every CPU. `nodes`
+// above the real node count still partitions work, which is how the column split can be
+// exercised on one socket. Returns the number of threads successfully pinned.
+std::uint32_t assign_pool_to_nodes(ThreadPool& pool, const NumaTopology& topo, std::uint32_t nodes);
+
+}  // namespace cieft
@@ -0,0 +1,276 @@
+#include "pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "cli_util.h"
+#include "numa.h"
+
+namespace cieft {
+
+namespace {
+
+double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+}  // namespace
+
+PipelineDecoder::PipelineDecoder(const Weights& w, const ModelConfig& cfg, std::uint32_t n_seqs,
+                                 const PipelineOptions& opts)
+    : w_(w), cfg_(cfg), opts_(opts), n_seqs_(n_seqs) {
+  const auto n_layers = static_cast<std::uint32_t>(w.layers.size());
+  if (n_layers == 0 || !w.global.output || !w.global.output_norm) {
+    throw std::runtime_error("PipelineDecoder: needs every layer and the LM head");
+  }
+  if (opts.stages == 0 || opts.stages > n_layers) {
+    throw std::runtime_error("PipelineDecoder: stages must be 1.." + std::to_string(n_layers));
+  }
+  if (n_seqs == 0 || opts.micro_batch == 0) {
+    throw std::runtime_error("PipelineDecoder: n_seqs and micro_batch must be non-zero");
+  }
+
+  for (std::uint32_t s = 0; s < opts.stages; s++) {
+    auto st = std::make_unique<Stage>();
+    st->index = s;
+    st->first_layer = n_layers * s / opts.stages;
+    st->n_layers = n_layers * (s + 1) / opts.stages - st->first_layer;
+    stages_.push_back(std::move(st));
+  }
+  tokens_.resize(n_seqs);
+  pos_.resize(n_seqs);
+  prompt_len_.resize(n_seqs);
+  total_len_.resize(n_seqs);
+  x_.assign(n_seqs, std::vector<float>(cfg.d_model));
+
+  // Stages set themselves up on their own threads, so contexts are first touched where
+  // they will run.
+  for (auto& st : stages_) {
+    st->thread = std::thread([this, s = st.get()] { stage_loop(*s); });
+  }
+  std::unique_lock<std::mutex> lk(mu_);
+  cv_.wait(lk, [this] { return ready_stages_ == stages_.size() || error_; });
+  if (error_) {
+    const std::exception_ptr e = error_;
+    lk.unlock();
+    stop_stages();
+    std::rethrow_exception(e);
+  }
+}
+
+PipelineDecoder::~PipelineDecoder() { stop_stages(); }
+
+void PipelineDecoder::stop_stages() {
+  stop_.store(true);
+  for (auto& st : stages_) {
+    {
+      std::lock_guard<std::mutex> lk(st->mu);
+    }
+    st->cv.notify_all();
+  }
+  for (auto& st : stages_) {
+    if (st->thread.joinable()) {
+      st->thread.join();
+    }
+  }
+}
+
+void PipelineDecoder::setup_stage(Stage& st) {
+  if (opts_.pin_numa) {
+    const NumaTopology topo = NumaTopology::detect();
+    const auto& cpus = topo.node_cpus[static_cast<std::uint64_t>(st.index) * topo.nodes() / stages_.size()];
+    pin_current_thread(cpus);
+    if (opts_.stage_threads > 1) {
+      st.pool = std::make_unique<ThreadPool>(opts_.stage_threads);
+      st.pool->for_each_thread([&](std::uint32_t) { pin_current_thread(cpus); });
+    }
+  } else if (opts_.stage_threads > 1) {
+    st.pool = std::make_unique<ThreadPool>(opts_.stage_threads);
+  }
+  for (std::uint32_t b = 0; b < n_seqs_; b++) {
+    st.ctx.push_back(std::make_unique<ForwardContext>(cfg_, st.n_layers));
+    st.ctx.back()->configure(opts_.plan, st.pool.get());
+  }
+  if (st.index + 1 == stages_.size()) {
+    st.logits.resize(cfg_.vocab_size);
+  }
+}
+
+void PipelineDecoder::stage_loop(Stage& st) {
+  try {
+    setup_stage(st);
+  } catch (...) {
+    fail(std::current_exception());
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    ready_stages_ += 1;
+  }
+  cv_.notify_all();
+
+  for (;;) {
+    std::uint32_t mb = 0;
+    {
+      const auto t_wait = std::chrono::steady_clock::now();
+      std::unique_lock<std::mutex> lk(st.mu);
+      st.cv.wait(lk, [&] { return stop_.load() || !st.queue.empty(); });
+      if (stop_.load()) {
+        return;
+      }
+      mb = st.queue.front();
+      st.queue.pop_front();
+      st.stats.wait_s += seconds_since(t_wait);
+    }
+    try {
+      const auto t0 = std::chrono::steady_clock::now();
+      process(st, mb);
+      st.stats.busy_s += seconds_since(t0);
+      st.stats.micro_batches += 1;
+      if (st.index + 1 < stages_.size()) {
+        push(*stages_[st.index + 1], mb);
+      } else {
+        retire_or_loop(mb);
+      }
+    } catch (...) {
+      fail(std::current_exception());
+      return;
+    }
+  }
+}
+
+void PipelineDecoder::process(Stage& st, std::uint32_t mb) {
+  const std::vector<std::uint32_t>& seqs = micro_batches_[mb];
+  if (st.index == 0) {
+    for (const std::uint32_t b : seqs) {
+      gather_column(w_.global.token_embd, tokens_[b][pos_[b]], x_[b].data());
+    }
+  }
+  // Layer-major: each layer's weights serve every sequence of the micro-batch in turn.
+  for (std::uint32_t i = 0; i < st.n_layers; i++) {
+    const LayerWeights& layer = w_.layers[st.first_layer + i];
+    for (const std::uint32_t b : seqs) {
+      st.ctx[b]->step_layer(i, layer, pos_[b], x_[b].data());
+    }
+  }
+  if (st.index + 1 < stages_.size()) {
+    return;
+  }
+  for (const std::uint32_t b : seqs) {
+    const std::uint32_t next = pos_[b] + 1;
+    if (next >= prompt_len_[b] && next < total_len_[b]) {
+      st.ctx[b]->logits(w_, x_[b].data(), st.logits.data());
+      tokens_[b].push_back(argmax(st.logits));
+    }
+    pos_[b] = next;
+  }
+}
+
+void PipelineDecoder::push(Stage& st, std::uint32_t mb) {
+  {
+    std::lock_guard<std::mutex> lk(st.mu);
+    st.queue.push_back(mb);
+  }
+  st.cv.notify_one();
+}
+
+// Drops finished sequences from the micro-batch; sends it round again unless none is left.
+void PipelineDecoder::retire_or_loop(std::uint32_t mb) {
+  auto& seqs = micro_batches_[mb];
+  seqs.erase(std::remove_if(seqs.begin(), seqs.end(), [&](std::uint32_t b) { return pos_[b] >= total_len_[b]; }),
+             seqs.end());
+  if (!seqs.empty()) {
+    push(*stages_.front(), mb);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    retired_ += 1;
+  }
+  cv_.notify_all();
+}
+
+void PipelineDecoder::fail(std::exception_ptr e) {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!error_) {
+      error_ = e;
+    }
+  }
+  cv_.notify_all();
+}
+
+std::vector<std::vector<std::uint32_t>> PipelineDecoder::run(const std::vector<std::vector<std::uint32_t>>& prompts,
+                                                             std::uint32_t generate, PipelineStats* stats) {
+  if (prompts.empty() || prompts.size() > n_seqs_) {
+    throw std::runtime_error("PipelineDecoder::run: 1.." + std::to_string(n_seqs_) + " sequences");
+  }
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+  const std::uint32_t max_seq = cfg_.context_length != 0 ? cfg_.context_length : 2048;
+  std::uint64_t positions = 0;
+  for (std::size_t b = 0; b < prompts.size(); b++) {
+    if (prompts[b].empty() || prompts[b].size() + generate > max_seq) {
+      throw std::runtime_error("PipelineDecoder::run: empty prompt or sequence longer than context_length");
+    }
+    for (const auto t : prompts[b]) {
+      if (t >= cfg_.vocab_size) {
+        throw std::runtime_error("PipelineDecoder::run: token id out of range for vocab");
+      }
+    }
+    tokens_[b] = prompts[b];
+    pos_[b] = 0;
+    prompt_len_[b] = static_cast<std::uint32_t>(prompts[b].size());
+    total_len_[b] = prompt_len_[b] + generate;
+    positions += total_len_[b];
+  }
+  micro_batches_.clear();
+  for (std::uint32_t b = 0; b < prompts.size(); b += opts_.micro_batch) {
+    std::vector<std::uint32_t> seqs;
+    for (std::uint32_t k = b; k < std::min<std::size_t>(prompts.size(), b + opts_.micro_batch); k++) {
+      seqs.push_back(k);
+    }
+    micro_batches_.push_back(std::move(seqs));
+  }
+  for (auto& st : stages_) {
+    st->stats = PipelineStageStats{};
+  }
+
+  const auto t0 = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    retired_ = 0;
+  }
+  for (std::uint32_t mb = 0; mb < micro_batches_.size(); mb++) {
+    push(*stages_.front(), mb);
+  }
+  {
+    std::unique_lock<std::mutex> lk(mu_);
+    cv_.wait(lk, [&] { return retired_ == micro_batches_.size() || error_; });
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+  if (stats != nullptr) {
+    stats->elapsed_s = seconds_since(t0);
+    stats->tokens = positions;
+    stats->stages.clear();
+    for (const auto& st : stages_) {
+      PipelineStageStats s = st->stats;
+      s.first_layer = st->first_layer;
+      s.n_layers = st->n_layers;
+      stats->stages.push_back(s);
+    }
+  }
+  return std::vector<std::vector<std::uint32_t>>(tokens_.begin(), tokens_.begin() + prompts.size());
+}
+
+}  // namespace cieft
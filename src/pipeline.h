@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "forward.h"
+#include "layer_plan.h"
+#include "thread_pool.h"
+#include "weights.h"
+
+namespace cieft {
+
+struct PipelineOptions {
+  std::uint32_t stages = 2;       // contiguous layer groups, one thread each
+  std::uint32_t micro_batch = 1;  // sequences that travel through the stages together
+
+  // Threads per stage: above 1, each stage gets its own `ThreadPool` (the stage thread
+  // plus workers) for its matmuls and attention.
+  std::uint32_t stage_threads = 1;
+
+  // Pin stage s (and its pool) to NUMA node s * nodes / stages, so a stage's weights stay
+  // in that node's caches.
+  bool pin_numa = false;
+
+  PlanOptions plan;  // kernels; `plan.tuning` must outlive the pipeline
+};
+
+// Per-stage counters of one `PipelineDecoder::run`.
+struct PipelineStageStats {
+  std::uint32_t first_layer = 0;
+  std::uint32_t n_layers = 0;
+  std::uint64_t micro_batches = 0;  // trips through this stage
+  double busy_s = 0.0;              // running layers (and, on the last stage, the LM head)
+  double wait_s = 0.0;              // blocked on an empty input queue
+};
+
+struct PipelineStats {
+  std::vector<PipelineStageStats> stages;
+  std::uint64_t tokens = 0;  // sequence positions decoded
+  double elapsed_s = 0.0;
+};
+
+// Pipeline-parallel batched decoding. The model's layers are split into `stages`
+// contiguous groups; each group runs on its own thread and holds, per sequence, a
+// `ForwardContext` with KV caches for its layers only. Sequences are grouped into
+// micro-batches that flow stage to stage through queues; within a stage a micro-batch is
+// processed layer by layer, so each layer's weights are read once for all its sequences
+// while they are hot in that stage's cores' caches. The last stage applies the LM head,
+// picks each sequence's next token (the next prompt token, or greedy argmax once the
+// prompt is consumed) and sends the micro-batch straight back to the first stage, so with
+// at least `stages` micro-batches in flight every stage stays busy.
+class PipelineDecoder {
+ public:
+  // `w` must hold every layer and the LM head and outlive the decoder. `n_seqs` is the
+  // most sequences one `run` may decode.
+  PipelineDecoder(const Weights& w, const ModelConfig& cfg, std::uint32_t n_seqs, const PipelineOptions& opts);
+  ~PipelineDecoder();
+
+  PipelineDecoder(const PipelineDecoder&) = delete;
+  PipelineDecoder& operator=(const PipelineDecoder&) = delete;
+
+  std::uint32_t stages() const { return static_cast<std::uint32_t>(stages_.size()); }
+
+  // Decodes each prompt, then `generate` greedy tokens after it, all sequences starting
+  // from position 0. Returns every sequence's tokens (prompt followed by generated).
+  std::vector<std::vector<std::uint32_t>> run(const std::vector<std::vector<std::uint32_t>>& prompts,
+                                              std::uint32_t generate, PipelineStats* stats = nullptr);
+
+ private:
+  struct Stage {
+    std::uint32_t index = 0;
+    std::uint32_t first_layer = 0;
+    std::uint32_t n_layers = 0;
+    std::vector<std::unique_ptr<ForwardContext>> ctx;  // per sequence
+    std::unique_ptr<ThreadPool> pool;
+    std::vector<float> logits;  // last stage only
+
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<std::uint32_t> queue;  // micro-batch ids waiting for this stage
+    PipelineStageStats stats;
+    std::thread thread;
+  };
+
+  void stage_loop(Stage& st);
+  void setup_stage(Stage& st);
+  void process(Stage& st, std::uint32_t mb);
+  void push(Stage& st, std::uint32_t mb);
+  void retire_or_loop(std::uint32_t mb);
+  void fail(std::exception_ptr e);
+  void stop_stages();
+
+  const Weights& w_;
+  ModelConfig cfg_;
+  PipelineOptions opts_;
+  std::uint32_t n_seqs_ = 0;
+  std::vector<std::unique_ptr<Stage>> stages_;
+
+  // State of the current `run`. A sequence's entries are only touched by the stage that
+  // holds its micro-batch; the queues hand them over.
+  std::vector<std::vector<std::uint32_t>> tokens_;  // per sequence
+  std::vector<std::uint32_t> pos_;                  // next position to decode
+  std::vector<std::uint32_t> prompt_len_;
+  std::vector<std::uint32_t> total_len_;
+  std::vector<std::vector<float>> x_;               // residual stream per sequence
+  std::vector<std::vector<std::uint32_t>> micro_batches_;  // live sequences of each
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::uint32_t ready_stages_ = 0;
+  std::uint32_t retired_ = 0;
+  std::atomic<bool> stop_{false};
+  std::exception_ptr error_;
+};
+
+}  // namespace cieft
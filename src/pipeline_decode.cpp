@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cli_util.h"
+#include "forward.h"
+#include "gguf_loader.h"
+#include "pipeline.h"
+#include "weights.h"
+
+int main(int argc, char** argv) {
+  try {
+    if (argc < 2) {
+      std::cerr << "usage: " << (argc > 0 ? argv[0] : "pipeline_decode")
+                << " <model.gguf> --prompts <id,id,...;id,...> [--batch B] [--generate N] [--stages S]\n"
+                << "       [--micro-batch M] [--stage-threads T] [--numa] [--threads N] [--max-seq N] [--compare]\n";
+      return 2;
+    }
+
+    const std::string path = argv[1];
+    std::vector<std::vector<std::uint32_t>> prompts;
+    std::uint32_t batch = 0;  // 0 = one sequence per prompt
+    std::uint32_t generate = 0;
+    std::uint32_t max_seq = 0;
+    bool compare = false;
+    cieft::PipelineOptions opts;
+    cieft::LoadOptions load_opts;
+
+    for (int i = 2; i < argc; i++) {
+      const std::string_view a = argv[i];
+      auto next = [&]() -> std::string {
+        if (i + 1 >= argc) throw std::runtime_error(std::string(a) + " requires an argument");
+        return argv[++i];
+      };
+      if (a == "--prompts") {
+        prompts = cieft::parse_prompts(next());
+      } else if (a == "--batch") {
+        batch = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--generate") {
+        generate = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--stages") {
+        opts.stages = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--micro-batch") {
+        opts.micro_batch = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--stage-threads") {
+        opts.stage_threads = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--numa") {
+        opts.pin_numa = true;
+      } else if (a == "--threads") {
+        load_opts.n_threads = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--max-seq") {
+        max_seq = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--compare") {
+        compare = true;
+      } else {
+        throw std::runtime_error("unknown arg: " + std::string(a));
+      }
+    }
+    if (prompts.empty()) {
+      throw std::runtime_error("missing --prompts");
+    }
+    // --batch repeats the prompts cyclically.
+    if (batch != 0) {
+      const std::size_t n = prompts.size();
+      prompts.resize(batch);
+      for (std::size_t b = n; b < batch; b++) {
+        prompts[b] = prompts[b % n];
+      }
+    }
+
+    const cieft::GGUFLoader loader(path);
+    std::vector<std::uint32_t> layer_ids(loader.config().n_layers);
+    std::iota(layer_ids.begin(), layer_ids.end(), 0u);
+    const cieft::Weights w = cieft::load_weights(loader, layer_ids, true, load_opts);
+    cieft::ModelConfig cfg = w.cfg;
+    if (max_seq != 0) {
+      cfg.context_length = max_seq;
+    }
+
+    cieft::PipelineDecoder pipe(w, cfg, static_cast<std::uint32_t>(prompts.size()), opts);
+    cieft::PipelineStats st;
+    const auto out = pipe.run(prompts, generate, &st);
+    std::cout << "pipeline: " << pipe.stages() << " stages, " << prompts.size() << " sequences, micro-batch "
+              << opts.micro_batch << ", " << st.tokens << " positions in " << std::fixed << std::setprecision(3)
+              << st.elapsed_s << "s, " << std::setprecision(1) << static_cast<double>(st.tokens) / st.elapsed_s
+              << " tok/s\n";
+    for (std::size_t s = 0; s < st.stages.size(); s++) {
+      const auto& ss = st.stages[s];
+      std::cout << "  stage " << s << ": layers " << ss.first_layer << ".." << ss.first_layer + ss.n_layers - 1
+                << ", " << ss.micro_batches << " micro-batches, busy " << std::setprecision(3) << ss.busy_s * 1000.0
+                << " ms, waiting " << ss.wait_s * 1000.0 << " ms (" << std::setprecision(0)
+                << (st.elapsed_s > 0.0 ? 100.0 * ss.busy_s / st.elapsed_s : 0.0) << "% busy)\n";
+    }
+    for (std::size_t b = 0; b < out.size(); b++) {
+      std::cout << "seq " << b << ": " << cieft::join(out[b]) << "\n";
+    }
+
+    if (compare) {
+      const auto t0 = std::chrono::steady_clock::now();
+      const auto ref = cieft::reference_decode(w, cfg, prompts, generate);
+      std::size_t match = 0;
+      for (std::size_t b = 0; b < prompts.size(); b++) {
+        match += ref[b] == out[b] ? 1 : 0;
+      }
+      const double ref_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      std::cout << "single context: " << std::setprecision(3) << ref_s << "s, " << std::setprecision(1)
+                << static_cast<double>(st.tokens) / ref_s << " tok/s; speedup " << std::setprecision(2)
+                << ref_s / st.elapsed_s << "x; sequences matching: " << match << "/" << prompts.size() << "\n";
+    }
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
+}
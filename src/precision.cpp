@@ -0,0 +1,130 @@
+#include "precision.h"
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "gguf.h"
+#include "ggml_quants.h"
+#include "weights.h"
+
+namespace cieft {
+
+std::optional<RuntimeType> parse_runtime_type(std::string_view s) {
+  if (s == "f32") return RuntimeType::F32;
+  if (s == "f16") return RuntimeType::F16;
+  if (s == "q8_0") return RuntimeType::Q8_0;
+  if (s == "keep") return RuntimeType::Keep;
+  return std::nullopt;
+}
+
+const char* runtime_type_name(RuntimeType t) {
+  switch (t) {
+    case RuntimeType::F32: return "f32";
+    case RuntimeType::F16: return "f16";
+    case RuntimeType::Q8_0: return "q8_0";
+    case RuntimeType::Keep: return "keep";
+  }
+  return "?";
+}
+
+std::uint32_t runtime_ggml_type(RuntimeType t, std::uint32_t src_type, std::uint64_t row_len) {
+  switch (t) {
+    case RuntimeType::F32: return 0;
+    case RuntimeType::F16: return 1;
+    case RuntimeType::Q8_0: return row_len % ggml::QK8_0 == 0 ? 8 : 1;
+    case RuntimeType::Keep: return src_type;
+  }
+  return 0;
+}
+
+RuntimeType PrecisionPolicy::type_for(std::string_view name) const {
+  for (const auto& r : rules) {
+    if (name.find(r.pattern) != std::string_view::npos) {
+      return r.type;
+    }
+  }
+  return RuntimeType::F32;
+}
+
+void PrecisionPolicy::add(std::string_view spec) {
+  const std::size_t eq = spec.rfind('=');
+  if (eq == std::string_view::npos || eq == 0) {
+    throw std::runtime_error("precision rule expects <substr>=<type>, got " + std::string(spec));
+  }
+  const auto t = parse_runtime_type(spec.substr(eq + 1));
+  if (!t) {
+    throw std::runtime_error("unknown runtime type in precision rule: " + std::string(spec) +
+                             " (expected f32, f16, q8_0 or keep)");
+  }
+  rules.push_back(Rule{std::string(spec.substr(0, eq)), *t});
+}
+
+void PrecisionPolicy::add_file(const std::string& path) {
+  std::ifstream in(path);
+  if (!in) {
+    throw std::runtime_error("cannot open precision policy: " + path);
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    line = line.substr(0, line.find('#'));
+    const std::size_t b = line.find_first_not_of(" \t\r");
+    if (b == std::string::npos) {
+      continue;
+    }
+    const std::size_t e = line.find_last_not_of(" \t\r");
+    add(std::string_view(line).substr(b, e - b + 1));
+  }
+}
+
+WeightFootprint weight_footprint(const Weights& w) {
+  WeightFootprint f;
+  auto add = [&](const TensorF32& t, bool whole) {
+    const auto traits = gguf::ggml_type_traits(t.ggml_type);
+    auto& e = f.by_type[traits ? traits->name : "?"];
+    const std::uint64_t bytes = t.dims.empty() ? 0 : t.row_bytes() * (t.numel / t.dims[0]);
+    const std::uint64_t per_token = whole ? bytes : t.row_bytes();
+    e.tensors += 1;
+    e.resident_bytes += bytes;
+    e.bytes_per_token += per_token;
+    f.resident_bytes += bytes;
+    f.bytes_per_token += per_token;
+  };
+  add(w.global.token_embd, false);
+  for (const auto& lw : w.layers) {
+    for (const TensorF32* t : layer_tensors(lw)) {
+      add(*t, true);
+    }
+  }
+  if (w.global.output_norm) {
+    add(*w.global.output_norm, true);
+  }
+  if (w.global.output) {
+    add(*w.global.output, true);
+  }
+  return f;
+}
+
+std::string format_weight_footprint(const WeightFootprint& f, double tokens_per_s) {
+  constexpr double kMiB = 1024.0 * 1024.0;
+  char buf[256];
+  std::string out;
+  std::snprintf(buf, sizeof(buf), "weights: %.1f MiB resident, %.1f MiB read per token", f.resident_bytes / kMiB,
+                f.bytes_per_token / kMiB);
+  out += buf;
+  if (tokens_per_s > 0.0) {
+    std::snprintf(buf, sizeof(buf), " (%.1f GiB/s at %.1f tok/s)", f.bytes_per_token * tokens_per_s / (kMiB * 1024.0),
+                  tokens_per_s);
+    out += buf;
+  }
+  out += "\n";
+  for (const auto& [type, e] : f.by_type) {
+    std::snprintf(buf, sizeof(buf), "  %-5s %4llu tensors %10.1f MiB resident %10.1f MiB/token\n", type.c_str(),
+                  static_cast<unsigned long long>(e.tensors), e.resident_bytes / kMiB, e.bytes_per_token / kMiB);
+    out += buf;
+  }
+  return out;
+}
+
+}  // namespace cieft
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cieft {
+
+struct Weights;
+
+// What a weight matrix is held as after loading.
+enum class RuntimeType : std::uint8_t {
+  F32,   // dequantized to float32 (the default)
+  F16,   // dequantized, stored as float16
+  Q8_0,  // dequantized and requantized to Q8_0 (F16 if rows are not a multiple of 32)
+  Keep,  // the file's own encoding, copied as is
+};
+
+std::optional<RuntimeType> parse_runtime_type(std::string_view s);
+const char* runtime_type_name(RuntimeType t);
+
+// ggml type a tensor stored in the file as `src_type` with `row_len` elements per row is
+// held as under `t`; 0 means float32.
+std::uint32_t runtime_ggml_type(RuntimeType t, std::uint32_t src_type, std::uint64_t row_len);
+
+// Maps tensor names to runtime representations: the first rule whose pattern is a
+// substring of the name wins, unmatched tensors are F32. Only 2-D tensors are affected;
+// norms always stay float32.
+struct PrecisionPolicy {
+  struct Rule {
+    std::string pattern;
+    RuntimeType type = RuntimeType::F32;
+  };
+  std::vector<Rule> rules;
+
+  bool empty() const { return rules.empty(); }
+  RuntimeType type_for(std::string_view name) const;
+
+  // Appends a `<substr>=<type>` rule.
+  void add(std::string_view spec);
+  // Appends one rule per line of `path`; blank lines and `#` comments are skipped.
+  void add_file(const std::string& path);
+};
+
+// Memory held by loaded weights and bytes a decode step reads from them, per stored type.
+struct WeightFootprint {
+  struct Entry {
+    std::uint64_t tensors = 0;
+    std::uint64_t resident_bytes = 0;
+    std::uint64_t bytes_per_token = 0;
+  };
+  std::map<std::string, Entry> by_type;  // "F32", "Q8_0", ...
+  std::uint64_t resident_bytes = 0;
+  // Every layer and LM-head tensor is read once per token; of the embedding, one column.
+  std::uint64_t bytes_per_token = 0;
+};
+
+WeightFootprint weight_footprint(const Weights& w);
+
+// Multi-line summary; `tokens_per_s` > 0 adds the weight bandwidth that rate implies.
+std::string format_weight_footprint(const WeightFootprint& f, double tokens_per_s = 0.0);
+
+}  // namespace cieft
@@ -0,0 +1,143 @@
+#include "prefetch.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+#include "weights.h"
+
+namespace cieft {
+
+std::optional<PrefetchMode> parse_prefetch_mode(std::string_view s) {
+  if (s == "madvise") return PrefetchMode::Madvise;
+  if (s == "touch") return PrefetchMode::Touch;
+  return std::nullopt;
+}
+
+LayerPrefetcher::LayerPrefetcher(const GGUFLoader& loader,
+                                 const std::vector<std::uint32_t>& layers,
+                                 std::uint32_t depth,
+                                 PrefetchMode mode)
+    : loader_(loader), depth_(depth), mode_(mode) {
+  ranges_.resize(layers.size());
+  bytes_.assign(layers.size(), 0);
+  for (std::size_t p = 0; p < layers.size(); p++) {
+    for (const auto suffix : kLayerTensorSuffixes) {
+      const auto t = loader_.get_tensor(layer_tensor_name(layers[p], suffix));
+      ranges_[p].push_back(Range{.shard = t.shard,
+                                 .offset = static_cast<std::size_t>(t.file_offset),
+                                 .len = static_cast<std::size_t>(t.nbytes)});
+      bytes_[p] += t.nbytes;
+    }
+  }
+
+  // Never look further ahead than one full pass over the layers.
+  depth_ = std::min<std::uint32_t>(depth_, static_cast<std::uint32_t>(layers.size() > 0 ? layers.size() - 1 : 0));
+
+  if (mode_ == PrefetchMode::Touch && depth_ > 0) {
+    worker_ = std::thread([this] { touch_loop(); });
+  }
+}
+
+LayerPrefetcher::~LayerPrefetcher() {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+void LayerPrefetcher::on_layer_begin(std::size_t pos) {
+  const std::size_t n = ranges_.size();
+  if (depth_ == 0 || n == 0) {
+    return;
+  }
+  pos %= n;
+
+  // Sliding window: when execution advanced by one layer only the new tail is missing.
+  const bool advanced_by_one = last_requested_ != static_cast<std::size_t>(-1) && pos == (last_requested_ + 1) % n;
+  last_requested_ = pos;
+  if (advanced_by_one) {
+    request(pos + depth_);
+    return;
+  }
+  for (std::uint32_t k = 1; k <= depth_; k++) {
+    request(pos + k);
+  }
+}
+
+void LayerPrefetcher::request(std::size_t pos) {
+  if (ranges_.empty()) {
+    return;
+  }
+  pos %= ranges_.size();
+
+  if (mode_ == PrefetchMode::Madvise) {
+    for (const auto& r : ranges_[pos]) {
+      loader_.mapped_file(r.shard).advise(r.offset, r.len, MapAdvice::WillNeed);
+    }
+    std::lock_guard<std::mutex> lk(mu_);
+    stats_.requests += 1;
+    stats_.bytes += bytes_[pos];
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (std::find(queue_.begin(), queue_.end(), pos) != queue_.end()) {
+      return;
+    }
+    queue_.push_back(pos);
+    stats_.requests += 1;
+    stats_.bytes += bytes_[pos];
+  }
+  cv_.notify_one();
+}
+
+PrefetchStats LayerPrefetcher::stats() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return stats_;
+}
+
+void LayerPrefetcher::touch_loop() {
+  for (;;) {
+    std::size_t pos = 0;
+    {
+      std::unique_lock<std::mutex> lk(mu_);
+      cv_.wait(lk, [this] { return stop_ || !queue_.empty(); });
+      if (stop_) {
+        return;
+      }
+      pos = queue_.front();
+      queue_.pop_front();
+    }
+    touch(ranges_[pos]);
+  }
+}
+
+void LayerPrefetcher::touch(const std::vector<Range>& ranges) {
+  const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  std::uint64_t pages = 0;
+  std::uint8_t sink = 0;
+  for (const auto& r : ranges) {
+    const std::uint8_t* base = loader_.mapped_file(r.shard).data();
+    for (std::size_t o = r.offset / page * page; o < r.offset + r.len; o += page) {
+      sink ^= *static_cast<const volatile std::uint8_t*>(base + o);
+      pages += 1;
+    }
+  }
+  (void)sink;
+
+  std::lock_guard<std::mutex> lk(mu_);
+  stats_.pages_touched += pages;
+}
+
+}  // namespace cieft
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "gguf_loader.h"
+
+namespace cieft {
+
+enum class PrefetchMode {
+  Madvise,  // MADV_WILLNEED: kernel readahead, returns immediately
+  Touch,    // helper thread reads one byte per page (works where WILLNEED is a no-op)
+};
+
+std::optional<PrefetchMode> parse_prefetch_mode(std::string_view s);
+
+struct PrefetchStats {
+  std::uint64_t requests = 0;    // layers requested
+  std::uint64_t bytes = 0;       // tensor bytes covered by those requests
+  std::uint64_t pages_touched = 0;
+};
+
+// Issues readahead for the tensor byte ranges of upcoming layers while the current one
+// computes. Layers are addressed by their position in `layers` (the execution order).
+class LayerPrefetcher {
+ public:
+  LayerPrefetcher(const GGUFLoader& loader,
+                  const std::vector<std::uint32_t>& layers,
+                  std::uint32_t depth,
+                  PrefetchMode mode = PrefetchMode::Madvise);
+  ~LayerPrefetcher();
+
+  LayerPrefetcher(const LayerPrefetcher&) = delete;
+  LayerPrefetcher& operator=(const LayerPrefetcher&) = delete;
+
+  std::uint32_t depth() const { return depth_; }
+
+  // Call when execution reaches position `pos`; requests pos+1 .. pos+depth, wrapping
+  // around to the first layers (the next token starts there).
+  void on_layer_begin(std::size_t pos);
+
+  // Requests one position now (e.g. to warm the first layers before the first token).
+  void request(std::size_t pos);
+
+  PrefetchStats stats() const;
+
+ private:
+  struct Range {
+    std::uint32_t shard = 0;
+    std::size_t offset = 0;  // within the shard's file
+    std::size_t len = 0;
+  };
+
+  void touch_loop();
+  void touch(const std::vector<Range>& ranges);
+
+  const GGUFLoader& loader_;
+  std::uint32_t depth_ = 0;
+  PrefetchMode mode_ = PrefetchMode::Madvise;
+  std::vector<std::vector<Range>> ranges_;  // per position
+  std::vector<std::uint64_t> bytes_;        // per position
+  std::size_t last_requested_ = static_cast<std::size_t>(-1);
+
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<std::size_t> queue_;
+  bool stop_ = false;
+  PrefetchStats stats_;
+  std::thread worker_;
+};
+
+}  // namespace cieft
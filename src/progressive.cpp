@@ -0,0 +1,116 @@
+#include "progressive.h"
+
+#include <chrono>
+#include <stdexcept>
+
+namespace cieft {
+
+namespace {
+
+double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+}  // namespace
+
+ProgressiveWeights::ProgressiveWeights(const GGUFLoader& loader,
+                                       const std::vector<std::uint32_t>& layers,
+                                       bool load_lm_head,
+                                       const LoadOptions& opts)
+    : n_layers_(layers.size()), start_(std::chrono::steady_clock::now()), layer_ready_(layers.size(), 0) {
+  LoadOptions o = opts;
+  o.on_ready = [this, user = opts.on_ready](LoadStage stage, std::size_t layer_pos) {
+    on_ready(stage, layer_pos);
+    if (user) {
+      user(stage, layer_pos);
+    }
+  };
+
+  worker_ = std::thread([this, &loader, layers, load_lm_head, o] {
+    try {
+      load_weights_into(w_, loader, layers, load_lm_head, o);
+      std::lock_guard<std::mutex> lk(mu_);
+      all_ready_ = true;
+      stats_.all_s = seconds_since(start_);
+    } catch (...) {
+      std::lock_guard<std::mutex> lk(mu_);
+      error_ = std::current_exception();
+    }
+    cv_.notify_all();
+  });
+}
+
+ProgressiveWeights::~ProgressiveWeights() {
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+void ProgressiveWeights::on_ready(LoadStage stage, std::size_t layer_pos) {
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    const double t = seconds_since(start_);
+    switch (stage) {
+      case LoadStage::Embedding:
+        embedding_ready_ = true;
+        stats_.embedding_s = t;
+        break;
+      case LoadStage::Layer:
+        layer_ready_.at(layer_pos) = 1;
+        if (layer_pos == 0) {
+          stats_.first_layer_s = t;
+        }
+        break;
+      case LoadStage::LmHead:
+        break;  // covered by all_ready_
+    }
+  }
+  cv_.notify_all();
+}
+
+void ProgressiveWeights::wait_for(const bool& flag) {
+  std::unique_lock<std::mutex> lk(mu_);
+  if (!flag && !error_) {
+    const auto t0 = std::chrono::steady_clock::now();
+    cv_.wait(lk, [&] { return flag || error_; });
+    stats_.stall_s += seconds_since(t0);
+  }
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+}
+
+const LayerWeights& ProgressiveWeights::acquire(std::size_t i) {
+  if (i >= n_layers_) {
+    throw std::runtime_error("ProgressiveWeights::acquire: layer position out of range");
+  }
+  {
+    std::unique_lock<std::mutex> lk(mu_);
+    if (layer_ready_[i] == 0 && !error_) {
+      const auto t0 = std::chrono::steady_clock::now();
+      cv_.wait(lk, [&] { return layer_ready_[i] != 0 || error_; });
+      stats_.stall_s += seconds_since(t0);
+    }
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+  return w_.layers[i];
+}
+
+const Weights& ProgressiveWeights::wait_embedding() {
+  wait_for(embedding_ready_);
+  return w_;
+}
+
+const Weights& ProgressiveWeights::wait_all() {
+  wait_for(all_ready_);
+  return w_;
+}
+
+ProgressiveStats ProgressiveWeights::stats() const {
+  std::lock_guard<std::mutex> lk(mu_);
+  return stats_;
+}
+
+}  // namespace cieft
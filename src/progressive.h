@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "forward.h"
+#include "gguf_loader.h"
+#include "weights.h"
+
+namespace cieft {
+
+// Cumulative timings, in seconds since the load started.
+struct ProgressiveStats {
+  double embedding_s = 0.0;    // token embedding usable
+  double first_layer_s = 0.0;  // layer position 0 usable
+  double all_s = 0.0;          // every tensor loaded (0 while still loading)
+  double stall_s = 0.0;        // time callers spent waiting on a not-yet-ready part
+};
+
+// Progressive startup: runs `load_weights` on a background thread and hands out each layer
+// as soon as it is filled, so the first token can start through layer 0 while later layers
+// are still being dequantized. `acquire(i)` blocks until layer `i` is ready.
+class ProgressiveWeights final : public LayerSource {
+ public:
+  ProgressiveWeights(const GGUFLoader& loader,
+                     const std::vector<std::uint32_t>& layers,
+                     bool load_lm_head,
+                     const LoadOptions& opts = {});
+  ~ProgressiveWeights() override;
+
+  ProgressiveWeights(const ProgressiveWeights&) = delete;
+  ProgressiveWeights& operator=(const ProgressiveWeights&) = delete;
+
+  std::size_t size() const override { return n_layers_; }
+  const LayerWeights& acquire(std::size_t i) override;
+
+  // Block until `cfg` and `global.token_embd` (resp. everything, LM head included) are
+  // usable. Rethrow a load error.
+  const Weights& wait_embedding();
+  const Weights& wait_all();
+
+  ProgressiveStats stats() const;
+
+ private:
+  void on_ready(LoadStage stage, std::size_t layer_pos);
+  void wait_for(const bool& flag);
+
+  std::size_t n_layers_ = 0;
+  Weights w_;
+  std::chrono::steady_clock::time_point start_;
+
+  mutable std::mutex mu_;
+  std::condition_variable cv_;
+  bool embedding_ready_ = false;
+  std::vector<char> layer_ready_;
+  bool all_ready_ = false;
+  std::exception_ptr error_;
+  ProgressiveStats stats_;
+  std::thread worker_;
+};
+
+}  // namespace cieft
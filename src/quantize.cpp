@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "ggml_fp16.h"
+#include "ggml_quants.h"
+#include "gguf.h"
+#include "gguf_loader.h"
+#include "gguf_writer.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include "weights.h"
+
+namespace {
+
+constexpr std::uint32_t kF32 = 0;
+constexpr std::uint32_t kF16 = 1;
+constexpr std::uint32_t kQ8_0 = 8;
+constexpr std::uint32_t kQ4_K = 12;
+constexpr std::uint32_t kQ6_K = 14;
+
+std::uint32_t parse_type(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  if (s == "f32") return kF32;
+  if (s == "f16") return kF16;
+  if (s == "q8_0") return kQ8_0;
+  if (s == "q4_k") return kQ4_K;
+  if (s == "q6_k") return kQ6_K;
+  throw std::runtime_error("unknown type: " + s + " (expected f32, f16, q8_0, q4_k or q6_k)");
+}
+
+// llama.cpp's `general.file_type` for a model that is mostly `ggml_type`.
+std::uint32_t file_type_for(std::uint32_t ggml_type) {
+  switch (ggml_type) {
+    case kF16: return 1;    // MOSTLY_F16
+    case kQ8_0: return 7;   // MOSTLY_Q8_0
+    case kQ4_K: return 14;  // MOSTLY_Q4_K_S
+    case kQ6_K: return 18;  // MOSTLY_Q6_K
+    default: return 0;      // ALL_F32
+  }
+}
+
+std::uint32_t parse_alignment(const std::string& s) {
+  if (s == "4k" || s == "4K") return 4096;
+  if (s == "2m" || s == "2M") return 2 * 1024 * 1024;
+  return static_cast<std::uint32_t>(std::stoul(s));
+}
+
+// First matching `--override <substr>=<type>` wins.
+struct Override {
+  std::string pattern;
+  std::uint32_t type = 0;
+};
+
+struct Plan {
+  cieft::TensorView src;
+  std::uint32_t type = 0;
+  std::uint64_t row_len = 0;
+  std::uint64_t n_rows = 0;
+  std::uint64_t row_bytes = 0;  // output bytes per row
+};
+
+// Encodes `n_rows` rows of `x` (row-major, `row_len` wide) as `type` into `dst`.
+void quantize_rows(std::uint32_t type, const float* x, std::uint64_t n_rows, std::uint64_t row_len, std::uint8_t* dst) {
+  const std::uint64_t n = n_rows * row_len;
+  switch (type) {
+    case kF32:
+      std::memcpy(dst, x, static_cast<std::size_t>(n * sizeof(float)));
+      return;
+    case kF16: {
+      auto* h = reinterpret_cast<std::uint16_t*>(dst);
+      for (std::uint64_t i = 0; i < n; i++) {
+        h[i] = cieft::ggml::fp32_to_fp16(x[i]);
+      }
+      return;
+    }
+    case kQ8_0:
+      cieft::ggml::quantize_row_q8_0(x, reinterpret_cast<cieft::ggml::block_q8_0*>(dst), static_cast<std::int64_t>(n));
+      return;
+    case kQ4_K:
+      cieft::ggml::quantize_row_q4_k(x, reinterpret_cast<cieft::ggml::block_q4_K*>(dst), static_cast<std::int64_t>(n));
+      return;
+    case kQ6_K:
+      cieft::ggml::quantize_row_q6_k(x, reinterpret_cast<cieft::ggml::block_q6_K*>(dst), static_cast<std::int64_t>(n));
+      return;
+  }
+}
+
+// Target float elements per task: bounds per-thread scratch and balances across threads.
+constexpr std::uint64_t kChunkElements = 1 << 20;
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  try {
+    if (argc < 3) {
+      std::cerr << "usage: " << (argc > 0 ? argv[0] : "quantize")
+                << " <in.gguf> <out.gguf> [--type q4_k|q6_k|q8_0|f16|f32] [--override <substr>=<type>]...\n"
+                   "                [--align 4k|2m|N] [--threads N] [--verbose]\n";
+      return 2;
+    }
+
+    const std::string in_path = argv[1];
+    const std::string out_path = argv[2];
+    std::uint32_t default_type = kQ4_K;
+    std::vector<Override> overrides;
+    std::uint32_t alignment = 0;
+    std::uint32_t n_threads = 0;
+    bool verbose = false;
+
+    for (int i = 3; i < argc; i++) {
+      const std::string_view a = argv[i];
+      auto next = [&]() -> std::string {
+        if (i + 1 >= argc) throw std::runtime_error(std::string(a) + " requires an argument");
+        return argv[++i];
+      };
+      if (a == "--type") {
+        default_type = parse_type(next());
+      } else if (a == "--override") {
+        const std::string v = next();
+        const std::size_t eq = v.rfind('=');
+        if (eq == std::string::npos || eq == 0) {
+          throw std::runtime_error("--override expects <substr>=<type>, got " + v);
+        }
+        overrides.push_back(Override{v.substr(0, eq), parse_type(v.substr(eq + 1))});
+      } else if (a == "--align") {
+        alignment = parse_alignment(next());
+      } else if (a == "--threads") {
+        n_threads = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--verbose") {
+        verbose = true;
+      } else {
+        throw std::runtime_error("unknown arg: " + std::string(a));
+      }
+    }
+
+    const auto t0 = std::chrono::steady_clock::now();
+    const cieft::GGUFLoader loader(in_path);
+    const auto& meta = loader.file();
+
+    // Metadata is copied verbatim, minus split bookkeeping: the output is always one file.
+    cieft::gguf::Writer w;
+    const auto& mf0 = loader.mapped_file();
+    for (const auto& kv : meta.metadata) {
+      if (kv.key.rfind("split.", 0) == 0) {
+        continue;
+      }
+      w.set_raw(kv.key, std::string(reinterpret_cast<const char*>(mf0.data() + kv.raw_offset), kv.raw_size));
+    }
+    if (alignment != 0) {
+      w.set_alignment(alignment);
+    } else if (auto it = meta.kv_index_by_key.find("general.alignment"); it != meta.kv_index_by_key.end()) {
+      if (const auto* a = std::get_if<std::uint32_t>(&meta.metadata[it->second].value.payload)) {
+        w.set_alignment(*a);
+      }
+    }
+    w.set_u32("general.quantization_version", 2);
+    w.set_u32("general.file_type", file_type_for(default_type));
+
+    // Matrices get the default type; vectors (norms) stay as they are. Rows that do not
+    // divide into the target's blocks fall back to F16.
+    std::vector<Plan> plans;
+    std::uint64_t in_bytes = 0;
+    std::uint64_t out_bytes = 0;
+    std::map<std::string, std::pair<std::size_t, std::uint64_t>> by_type;  // count, bytes
+    for (const auto name : loader.tensor_names()) {
+      Plan p;
+      p.src = loader.get_tensor(name);
+      if (!cieft::gguf::ggml_type_traits(p.src.ggml_type) || p.src.dims.empty()) {
+        throw std::runtime_error("unsupported tensor " + std::string(name));
+      }
+      p.type = p.src.dims.size() >= 2 ? default_type : p.src.ggml_type;
+      for (const auto& o : overrides) {
+        if (name.find(o.pattern) != std::string_view::npos) {
+          p.type = o.type;
+          break;
+        }
+      }
+      p.row_len = p.src.dims[0];
+      p.n_rows = 1;
+      for (std::size_t d = 1; d < p.src.dims.size(); d++) {
+        p.n_rows *= p.src.dims[d];
+      }
+      auto traits = *cieft::gguf::ggml_type_traits(p.type);
+      if (p.row_len % traits.block_size != 0) {
+        p.type = kF16;
+        traits = *cieft::gguf::ggml_type_traits(p.type);
+      }
+      p.row_bytes = p.row_len / traits.block_size * traits.type_size;
+      const std::uint64_t nbytes = p.row_bytes * p.n_rows;
+      w.add_tensor(std::string(name), p.src.dims, p.type, nbytes);
+
+      in_bytes += p.src.nbytes;
+      out_bytes += nbytes;
+      auto& [count, bytes] = by_type[traits.name];
+      count += 1;
+      bytes += nbytes;
+      if (verbose) {
+        std::cout << "  " << name << ": " << cieft::gguf::ggml_type_traits(p.src.ggml_type)->name << " -> "
+                  << traits.name << "\n";
+      }
+      plans.push_back(std::move(p));
+    }
+
+    // Tensors are filled one after another, each split into row chunks across the pool,
+    // so a single huge matrix (embedding, LM head) still uses every thread.
+    cieft::ThreadPool pool(n_threads);
+    w.write(out_path, [&](std::size_t k, std::uint8_t* dst) {
+      const Plan& p = plans[k];
+      if (p.type == p.src.ggml_type) {
+        std::memcpy(dst, p.src.data, static_cast<std::size_t>(p.row_bytes * p.n_rows));
+        return;
+      }
+      const std::uint64_t rows_per_chunk = std::max<std::uint64_t>(1, kChunkElements / p.row_len);
+      const std::uint64_t n_chunks = (p.n_rows + rows_per_chunk - 1) / rows_per_chunk;
+      pool.parallel_for(static_cast<std::size_t>(n_chunks), [&](std::size_t c) {
+        thread_local std::vector<float> scratch;
+        const std::uint64_t r0 = c * rows_per_chunk;
+        const std::uint64_t r1 = std::min(p.n_rows, r0 + rows_per_chunk);
+        scratch.resize(static_cast<std::size_t>((r1 - r0) * p.row_len));
+        cieft::dequantize_elements(p.src, r0 * p.row_len, r1 * p.row_len, scratch.data());
+        quantize_rows(p.type, scratch.data(), r1 - r0, p.row_len, dst + r0 * p.row_bytes);
+      });
+    });
+
+    // Re-read what we wrote so a bad file never goes unnoticed.
+    const cieft::MappedFile out(out_path);
+    const auto check = cieft::gguf::parse(out.data(), out.size());
+    if (check.tensors.size() != plans.size()) {
+      throw std::runtime_error("quantize: tensor count mismatch in output");
+    }
+
+    constexpr double kMiB = 1024.0 * 1024.0;
+    const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "quantize: " << plans.size() << " tensors, " << std::fixed << std::setprecision(1)
+              << static_cast<double>(in_bytes) / kMiB << " MiB -> " << static_cast<double>(out_bytes) / kMiB
+              << " MiB data, " << std::setprecision(2) << s << "s, " << pool.size() << " threads\n";
+    for (const auto& [type, cb] : by_type) {
+      std::cout << "  " << type << ": " << cb.first << " tensors, " << std::setprecision(1)
+                << static_cast<double>(cb.second) / kMiB << " MiB\n";
+    }
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
+}
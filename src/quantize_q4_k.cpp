@@ -0,0 +1,167 @@
+#include "ggml_quants.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+#include "ggml_fp16.h"
+
+namespace cieft::ggml {
+
+namespace {
+
+inline int nearest_int(float v) { return static_cast<int>(std::lrintf(v)); }
+
+inline void get_scale_min_k4(int j, const std::uint8_t* q, std::uint8_t* d, std::uint8_t* m) {
+  if (j < 4) {
+    *d = q[j] & 63;
+    *m = q[j + 4] & 63;
+  } else {
+    *d = (q[j + 4] & 0xF) | ((q[j - 4] >> 6) << 4);
+    *m = (q[j + 4] >> 4) | ((q[j - 0] >> 6) << 4);
+  }
+}
+
+// Weighted least-squares fit of x ~ scale * L + min with L in [0, nmax], searching
+// `nstep` candidate inverse scales around the min/max one.
+float make_qkx2_quants(int n, int nmax, const float* x, const float* weights, std::uint8_t* L, float* the_min,
+                       std::uint8_t* Laux, float rmin, float rdelta, int nstep) {
+  float min = x[0];
+  float max = x[0];
+  float sum_w = weights[0];
+  float sum_x = sum_w * x[0];
+  for (int i = 1; i < n; ++i) {
+    min = std::min(min, x[i]);
+    max = std::max(max, x[i]);
+    sum_w += weights[i];
+    sum_x += weights[i] * x[i];
+  }
+  min = std::min(min, 0.0f);
+  if (max == min) {
+    std::fill(L, L + n, 0);
+    *the_min = -min;
+    return 0.0f;
+  }
+
+  float iscale = nmax / (max - min);
+  float scale = 1 / iscale;
+  float best_err = 0;
+  for (int i = 0; i < n; ++i) {
+    L[i] = static_cast<std::uint8_t>(std::clamp(nearest_int(iscale * (x[i] - min)), 0, nmax));
+    const float diff = scale * L[i] + min - x[i];
+    best_err += weights[i] * diff * diff;
+  }
+
+  for (int is = 0; is <= nstep; ++is) {
+    iscale = (rmin + rdelta * is + nmax) / (max - min);
+    float sum_l = 0;
+    float sum_l2 = 0;
+    float sum_xl = 0;
+    for (int i = 0; i < n; ++i) {
+      const int l = std::clamp(nearest_int(iscale * (x[i] - min)), 0, nmax);
+      Laux[i] = static_cast<std::uint8_t>(l);
+      const float w = weights[i];
+      sum_l += w * l;
+      sum_l2 += w * l * l;
+      sum_xl += w * l * x[i];
+    }
+    const float D = sum_w * sum_l2 - sum_l * sum_l;
+    if (D > 0) {
+      float this_scale = (sum_w * sum_xl - sum_x * sum_l) / D;
+      float this_min = (sum_l2 * sum_x - sum_l * sum_xl) / D;
+      if (this_min > 0) {
+        this_min = 0;
+        this_scale = sum_xl / sum_l2;
+      }
+      float err = 0;
+      for (int i = 0; i < n; ++i) {
+        const float diff = this_scale * Laux[i] + this_min - x[i];
+        err += weights[i] * diff * diff;
+      }
+      if (err < best_err) {
+        std::copy(Laux, Laux + n, L);
+        best_err = err;
+        scale = this_scale;
+        min = this_min;
+      }
+    }
+  }
+  *the_min = -min;
+  return scale;
+}
+
+}  // namespace
+
+void quantize_row_q4_k(const float* x, block_q4_K* y, std::int64_t k) {
+  assert(k % QK_K == 0);
+  const std::int64_t nb = k / QK_K;
+
+  std::uint8_t L[QK_K];
+  std::uint8_t Laux[32];
+  float weights[32];
+  float mins[QK_K / 32];
+  float scales[QK_K / 32];
+
+  for (std::int64_t i = 0; i < nb; i++) {
+    float max_scale = 0;
+    float max_min = 0;
+    for (int j = 0; j < QK_K / 32; ++j) {
+      float sum_x2 = 0;
+      for (int l = 0; l < 32; ++l) {
+        sum_x2 += x[32 * j + l] * x[32 * j + l];
+      }
+      const float av_x = std::sqrt(sum_x2 / 32);
+      for (int l = 0; l < 32; ++l) {
+        weights[l] = av_x + std::fabs(x[32 * j + l]);
+      }
+      scales[j] = make_qkx2_quants(32, 15, x + 32 * j, weights, L + 32 * j, &mins[j], Laux, -1.0f, 0.1f, 20);
+      max_scale = std::max(max_scale, scales[j]);
+      max_min = std::max(max_min, mins[j]);
+    }
+
+    // 6-bit sub-block scales and mins, packed as `get_scale_min_k4` expects.
+    const float inv_scale = max_scale > 0 ? 63.0f / max_scale : 0.0f;
+    const float inv_min = max_min > 0 ? 63.0f / max_min : 0.0f;
+    for (int j = 0; j < QK_K / 32; ++j) {
+      const auto ls = static_cast<std::uint8_t>(std::min(63, nearest_int(inv_scale * scales[j])));
+      const auto lm = static_cast<std::uint8_t>(std::min(63, nearest_int(inv_min * mins[j])));
+      if (j < 4) {
+        y[i].scales[j] = ls;
+        y[i].scales[j + 4] = lm;
+      } else {
+        y[i].scales[j + 4] = (ls & 0xF) | ((lm & 0xF) << 4);
+        y[i].scales[j - 4] |= ((ls >> 4) << 6);
+        y[i].scales[j - 0] |= ((lm >> 4) << 6);
+      }
+    }
+    y[i].d = fp32_to_fp16(max_scale / 63.0f);
+    y[i].dmin = fp32_to_fp16(max_min / 63.0f);
+
+    // Requantize against the rounded scales.
+    std::uint8_t sc = 0;
+    std::uint8_t m = 0;
+    for (int j = 0; j < QK_K / 32; ++j) {
+      get_scale_min_k4(j, y[i].scales, &sc, &m);
+      const float d = fp16_to_fp32(y[i].d) * sc;
+      if (d == 0.0f) {
+        continue;
+      }
+      const float dm = fp16_to_fp32(y[i].dmin) * m;
+      for (int ii = 0; ii < 32; ++ii) {
+        L[32 * j + ii] = static_cast<std::uint8_t>(std::clamp(nearest_int((x[32 * j + ii] + dm) / d), 0, 15));
+      }
+    }
+
+    std::uint8_t* q = y[i].qs;
+    for (int j = 0; j < QK_K; j += 64) {
+      for (int l = 0; l < 32; ++l) {
+        q[l] = static_cast<std::uint8_t>(L[j + l] | (L[j + l + 32] << 4));
+      }
+      q += 32;
+    }
+    x += QK_K;
+  }
+}
+
+}  // namespace cieft::ggml
@@ -0,0 +1,136 @@
+#include "ggml_quants.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "ggml_fp16.h"
+
+namespace cieft::ggml {
+
+namespace {
+
+constexpr float kGroupMaxEps = 1e-15f;
+
+inline int nearest_int(float v) { return static_cast<int>(std::lrintf(v)); }
+
+// Symmetric fit of x ~ scale * (L - nmax) with L in [0, 2*nmax), weighted by x^2, trying
+// inverse scales around -nmax/max.
+float make_qx_quants(int n, int nmax, const float* x, std::int8_t* L) {
+  float max = 0;
+  float amax = 0;
+  for (int i = 0; i < n; ++i) {
+    const float ax = std::fabs(x[i]);
+    if (ax > amax) {
+      amax = ax;
+      max = x[i];
+    }
+  }
+  if (amax < kGroupMaxEps) {
+    std::fill(L, L + n, 0);
+    return 0.0f;
+  }
+
+  auto fit = [&](float iscale, float* sumlx, float* suml2) {
+    *sumlx = 0;
+    *suml2 = 0;
+    for (int i = 0; i < n; ++i) {
+      const int l = std::clamp(nearest_int(iscale * x[i]), -nmax, nmax - 1);
+      const float w = x[i] * x[i];
+      *sumlx += w * x[i] * l;
+      *suml2 += w * l * l;
+    }
+  };
+  auto assign = [&](float iscale) {
+    for (int i = 0; i < n; ++i) {
+      L[i] = static_cast<std::int8_t>(nmax + std::clamp(nearest_int(iscale * x[i]), -nmax, nmax - 1));
+    }
+  };
+
+  float iscale = -nmax / max;
+  float sumlx = 0;
+  float suml2 = 0;
+  fit(iscale, &sumlx, &suml2);
+  assign(iscale);
+  float scale = suml2 != 0 ? sumlx / suml2 : 0.0f;
+  float best = scale * sumlx;
+  for (int is = -9; is <= 9; ++is) {
+    if (is == 0) {
+      continue;
+    }
+    iscale = -(nmax + 0.1f * is) / max;
+    fit(iscale, &sumlx, &suml2);
+    if (suml2 > 0 && sumlx * sumlx > best * suml2) {
+      assign(iscale);
+      scale = sumlx / suml2;
+      best = scale * sumlx;
+    }
+  }
+  return scale;
+}
+
+}  // namespace
+
+void quantize_row_q6_k(const float* x, block_q6_K* y, std::int64_t k) {
+  assert(k % QK_K == 0);
+  const std::int64_t nb = k / QK_K;
+
+  std::int8_t L[QK_K];
+  float scales[QK_K / 16];
+
+  for (std::int64_t i = 0; i < nb; i++) {
+    float max_scale = 0;
+    float max_abs_scale = 0;
+    for (int ib = 0; ib < QK_K / 16; ++ib) {
+      scales[ib] = make_qx_quants(16, 32, x + 16 * ib, L + 16 * ib);
+      if (std::fabs(scales[ib]) > max_abs_scale) {
+        max_abs_scale = std::fabs(scales[ib]);
+        max_scale = scales[ib];
+      }
+    }
+    if (max_abs_scale < kGroupMaxEps) {
+      std::memset(&y[i], 0, sizeof(block_q6_K));
+      x += QK_K;
+      continue;
+    }
+
+    const float iscale = -128.0f / max_scale;
+    y[i].d = fp32_to_fp16(1 / iscale);
+    for (int ib = 0; ib < QK_K / 16; ++ib) {
+      y[i].scales[ib] = static_cast<std::int8_t>(std::min(127, nearest_int(iscale * scales[ib])));
+    }
+
+    // Requantize against the rounded scales.
+    for (int j = 0; j < QK_K / 16; ++j) {
+      const float d = fp16_to_fp32(y[i].d) * y[i].scales[j];
+      if (d == 0.0f) {
+        continue;
+      }
+      for (int ii = 0; ii < 16; ++ii) {
+        L[16 * j + ii] = static_cast<std::int8_t>(std::clamp(nearest_int(x[16 * j + ii] / d), -32, 31) + 32);
+      }
+    }
+
+    std::uint8_t* ql = y[i].ql;
+    std::uint8_t* qh = y[i].qh;
+    for (int j = 0; j < QK_K; j += 128) {
+      for (int l = 0; l < 32; ++l) {
+        const std::uint8_t q1 = L[j + l + 0] & 0xF;
+        const std::uint8_t q2 = L[j + l + 32] & 0xF;
+        const std::uint8_t q3 = L[j + l + 64] & 0xF;
+        const std::uint8_t q4 = L[j + l + 96] & 0xF;
+        ql[l + 0] = static_cast<std::uint8_t>(q1 | (q3 << 4));
+        ql[l + 32] = static_cast<std::uint8_t>(q2 | (q4 << 4));
+        qh[l] = static_cast<std::uint8_t>((L[j + l] >> 4) | ((L[j + l + 32] >> 4) << 2) | ((L[j + l + 64] >> 4) << 4) |
+                                          ((L[j + l + 96] >> 4) << 6));
+      }
+      ql += 64;
+      qh += 32;
+    }
+    x += QK_K;
+  }
+}
+
+}  // namespace cieft::ggml
@@ -0,0 +1,31 @@
+#include "ggml_quants.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+#include "ggml_fp16.h"
+
+namespace cieft::ggml {
+
+void quantize_row_q8_0(const float* x, block_q8_0* y, std::int64_t k) {
+  assert(k % QK8_0 == 0);
+  const std::int64_t nb = k / QK8_0;
+
+  for (std::int64_t i = 0; i < nb; i++) {
+    float amax = 0.0f;
+    for (int j = 0; j < QK8_0; j++) {
+      amax = std::fmax(amax, std::fabs(x[j]));
+    }
+
+    const float d = amax / 127.0f;
+    const float id = d != 0.0f ? 1.0f / d : 0.0f;
+    y[i].d = fp32_to_fp16(d);
+    for (int j = 0; j < QK8_0; ++j) {
+      y[i].qs[j] = static_cast<std::int8_t>(std::round(x[j] * id));
+    }
+    x += QK8_0;
+  }
+}
+
+}  // namespace cieft::ggml
@@ -3,12 +3,24 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <limits>
 #include <stdexcept>
 #include <string>
 #include <type_traits>
 
 namespace cieft {
 
+// a * b, throwing instead of wrapping; for sizes computed from untrusted headers.
+inline std::uint64_t checked_mul_u64(std::uint64_t a, std::uint64_t b) {
+  if (a == 0 || b == 0) {
+    return 0;
+  }
+  if (a > std::numeric_limits<std::uint64_t>::max() / b) {
+    throw std::runtime_error("u64 overflow");
+  }
+  return a * b;
+}
+
 class Reader {
  public:
   Reader(const std::uint8_t* data, std::size_t size) : data_(data), size_(size) {}
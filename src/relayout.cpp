@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "gguf.h"
+#include "gguf_writer.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include "weights.h"
+
+namespace {
+
+// Sort key placing tensors in the order the forward pass reads them: embedding, each
+// block's tensors in `kLayerTensorSuffixes` order, final norm + LM head, then anything
+// else in original file order.
+struct OrderKey {
+  int group = 0;  // 0 embedding, 1 blocks, 2 head, 3 other
+  std::uint64_t layer = 0;
+  std::size_t rank = 0;
+
+  bool operator<(const OrderKey& o) const {
+    return std::tie(group, layer, rank) < std::tie(o.group, o.layer, o.rank);
+  }
+};
+
+OrderKey order_key(std::string_view name, std::uint64_t file_offset) {
+  if (name == "token_embd.weight") return {0, 0, 0};
+  if (name == "output_norm.weight") return {2, 0, 0};
+  if (name == "output.weight") return {2, 0, 1};
+
+  constexpr std::string_view kBlk = "blk.";
+  if (name.substr(0, kBlk.size()) == kBlk) {
+    const std::size_t dot = name.find('.', kBlk.size());
+    const std::string_view num = name.substr(kBlk.size(), dot - kBlk.size());
+    if (dot != std::string_view::npos && !num.empty() &&
+        std::all_of(num.begin(), num.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+      const std::uint64_t layer = std::stoull(std::string(num));
+      const std::string_view suffix = name.substr(dot + 1);
+      const auto it = std::find(cieft::kLayerTensorSuffixes.begin(), cieft::kLayerTensorSuffixes.end(), suffix);
+      // Unknown per-block tensors (biases, ...) go after the known ones of their block.
+      const std::size_t rank = static_cast<std::size_t>(it - cieft::kLayerTensorSuffixes.begin());
+      return {1, layer, it != cieft::kLayerTensorSuffixes.end() ? rank : rank + file_offset};
+    }
+  }
+  return {3, 0, static_cast<std::size_t>(file_offset)};
+}
+
+std::uint32_t parse_alignment(const std::string& s) {
+  if (s == "4k" || s == "4K") return 4096;
+  if (s == "2m" || s == "2M") return 2 * 1024 * 1024;
+  return static_cast<std::uint32_t>(std::stoul(s));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  try {
+    if (argc < 3) {
+      std::cerr << "usage: " << (argc > 0 ? argv[0] : "relayout")
+                << " <in.gguf> <out.gguf> [--align 4k|2m|N] [--keep-order] [--threads N]\n";
+      return 2;
+    }
+
+    const std::string in_path = argv[1];
+    const std::string out_path = argv[2];
+    std::uint32_t alignment = 4096;
+    bool keep_order = false;
+    std::uint32_t n_threads = 0;
+
+    for (int i = 3; i < argc; i++) {
+      const std::string_view a = argv[i];
+      auto next = [&]() -> std::string {
+        if (i + 1 >= argc) throw std::runtime_error(std::string(a) + " requires an argument");
+        return argv[++i];
+      };
+      if (a == "--align") {
+        alignment = parse_alignment(next());
+      } else if (a == "--keep-order") {
+        keep_order = true;
+      } else if (a == "--threads") {
+        n_threads = static_cast<std::uint32_t>(std::stoul(next()));
+      } else {
+        throw std::runtime_error("unknown arg: " + std::string(a));
+      }
+    }
+
+    const auto t0 = std::chrono::steady_clock::now();
+    const cieft::MappedFile in(in_path);
+    const auto gguf = cieft::gguf::parse(in.data(), in.size());
+
+    cieft::gguf::Writer w;
+    for (const auto& kv : gguf.metadata) {
+      w.set_raw(kv.key, std::string(reinterpret_cast<const char*>(in.data() + kv.raw_offset), kv.raw_size));
+    }
+    w.set_alignment(alignment);
+
+    std::vector<std::size_t> order(gguf.tensors.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (!keep_order) {
+      std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        return order_key(gguf.tensors[a].name, gguf.tensors[a].offset) <
+               order_key(gguf.tensors[b].name, gguf.tensors[b].offset);
+      });
+    }
+
+    std::vector<const std::uint8_t*> src(order.size());
+    std::uint64_t data_bytes = 0;
+    for (std::size_t k = 0; k < order.size(); k++) {
+      const auto& ti = gguf.tensors[order[k]];
+      const auto nbytes = cieft::gguf::tensor_nbytes(ti);
+      if (!nbytes) {
+        throw std::runtime_error("unsupported tensor type for " + ti.name);
+      }
+      src[k] = in.data() + gguf.data_section_offset + ti.offset;
+      w.add_tensor(ti.name, ti.dims, ti.ggml_type, *nbytes);
+      data_bytes += *nbytes;
+    }
+
+    cieft::ThreadPool pool(n_threads);
+    w.write(
+        out_path,
+        [&](std::size_t k, std::uint8_t* dst) {
+          const auto& ti = gguf.tensors[order[k]];
+          std::memcpy(dst, src[k], static_cast<std::size_t>(*cieft::gguf::tensor_nbytes(ti)));
+        },
+        &pool);
+
+    // Re-read what we wrote so a bad file never goes unnoticed.
+    const cieft::MappedFile out(out_path);
+    const auto check = cieft::gguf::parse(out.data(), out.size());
+    if (check.tensors.size() != gguf.tensors.size()) {
+      throw std::runtime_error("relayout: tensor count mismatch in output");
+    }
+
+    constexpr double kMiB = 1024.0 * 1024.0;
+    const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "relayout: " << gguf.tensors.size() << " tensors, " << std::fixed << std::setprecision(1)
+              << static_cast<double>(data_bytes) / kMiB << " MiB data, alignment " << alignment << ", "
+              << (keep_order ? "original" : "execution") << " order\n"
+              << "  " << static_cast<double>(in.size()) / kMiB << " MiB -> " << static_cast<double>(out.size()) / kMiB
+              << " MiB (data at " << check.data_section_offset << "), " << std::setprecision(2) << s << "s, "
+              << pool.size() << " threads\n";
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
+}
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <iomanip>
@@ -7,7 +9,9 @@
 #include <string_view>
 #include <vector>
 
+#include "fault_view.h"
 #include "gguf_loader.h"
+#include "weight_cache.h"
 #include "weights.h"
 
 namespace {
@@ -47,13 +51,14 @@ Stats sample_stats(const float* data, std::uint64_t n, std::uint64_t max_samples
   return s;
 }
 
-void print_tensor_stats(std::string_view name, const cieft::TensorF32& t) {
-  const auto st = sample_stats(t.data(), t.numel);
+void print_tensor_stats(std::string_view name, const std::vector<std::uint64_t>& dims, const float* data,
+                        std::uint64_t numel, std::uint64_t max_samples = 1'000'000) {
+  const auto st = sample_stats(data, numel, max_samples);
   std::cout << name << " dims=";
   std::cout << "[";
-  for (std::size_t i = 0; i < t.dims.size(); i++) {
+  for (std::size_t i = 0; i < dims.size(); i++) {
     if (i) std::cout << ", ";
-    std::cout << t.dims[i];
+    std::cout << dims[i];
   }
   std::cout << "]";
   std::cout << " samples=" << st.samples;
@@ -64,19 +69,33 @@ void print_tensor_stats(std::string_view name, const cieft::TensorF32& t) {
   std::cout << "\n";
 }
 
+void print_tensor_stats(std::string_view name, const cieft::TensorF32& t) {
+  print_tensor_stats(name, t.dims, t.data(), t.numel);
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
   try {
     if (argc < 2) {
       std::cerr << "usage: " << (argc > 0 ? argv[0] : "smoke_load")
-                << " <model.gguf> [--layer N] [--lm-head]\n";
+                << " <model.gguf> [--layer N] [--lm-head] [--threads N] [--progress] [--bulk-io] [--io-threads N]\n"
+                << "  [--arena none|thp|hugetlb] [--cache-dir DIR] [--fault-view <substring>]... [--fault-budget-mib N]\n"
+                << "  mmap: [--mmap-populate] [--madvise normal|seq|random|willneed] [--hugepage] [--mlock]\n"
+                << "        [--mlock-tensor <substring>]...\n";
       return 2;
     }
 
     std::string path;
     std::uint32_t layer = 0;
     bool lm_head = false;
+    bool show_progress = false;
+    std::string cache_dir;
+    cieft::LoadOptions load_opts;
+    cieft::MapOptions map_opts;
+    std::vector<std::string> mlock_tensors;
+    std::vector<std::string> fault_tensors;
+    cieft::FaultViewOptions fault_opts;
 
     path = argv[1];
     for (int i = 2; i < argc; i++) {
@@ -88,12 +107,76 @@ int main(int argc, char** argv) {
           throw std::runtime_error("--layer requires an argument");
         }
         layer = static_cast<std::uint32_t>(std::stoul(argv[++i]));
+      } else if (a == "--threads") {
+        if (i + 1 >= argc) {
+          throw std::runtime_error("--threads requires an argument");
+        }
+        load_opts.n_threads = static_cast<std::uint32_t>(std::stoul(argv[++i]));
+      } else if (a == "--progress") {
+        show_progress = true;
+      } else if (a == "--cache-dir") {
+        if (i + 1 >= argc) {
+          throw std::runtime_error("--cache-dir requires an argument");
+        }
+        cache_dir = argv[++i];
+      } else if (a == "--arena") {
+        if (i + 1 >= argc) {
+          throw std::runtime_error("--arena requires an argument");
+        }
+        const auto arena = cieft::parse_weight_arena(argv[++i]);
+        if (!arena) throw std::runtime_error("unknown --arena value: " + std::string(argv[i]));
+        load_opts.arena = *arena;
+      } else if (a == "--bulk-io") {
+        load_opts.bulk_io = true;
+      } else if (a == "--io-threads") {
+        if (i + 1 >= argc) {
+          throw std::runtime_error("--io-threads requires an argument");
+        }
+        load_opts.bulk.io_threads = static_cast<std::uint32_t>(std::stoul(argv[++i]));
+      } else if (a == "--fault-view") {
+        if (i + 1 >= argc) {
+          throw std::runtime_error("--fault-view requires an argument");
+        }
+        fault_tensors.emplace_back(argv[++i]);
+      } else if (a == "--fault-budget-mib") {
+        if (i + 1 >= argc) {
+          throw std::runtime_error("--fault-budget-mib requires an argument");
+        }
+        fault_opts.max_resident_bytes = static_cast<std::size_t>(std::stoull(argv[++i])) * 1024 * 1024;
+      } else if (a == "--mmap-populate") {
+        map_opts.populate = true;
+      } else if (a == "--madvise") {
+        if (i + 1 >= argc) {
+          throw std::runtime_error("--madvise requires an argument");
+        }
+        const auto advice = cieft::parse_map_advice(argv[++i]);
+        if (!advice) {
+          throw std::runtime_error("unknown --madvise value: " + std::string(argv[i]));
+        }
+        map_opts.advice = *advice;
+      } else if (a == "--hugepage") {
+        map_opts.hugepage = true;
+      } else if (a == "--mlock") {
+        map_opts.lock = true;
+      } else if (a == "--mlock-tensor") {
+        if (i + 1 >= argc) {
+          throw std::runtime_error("--mlock-tensor requires an argument");
+        }
+        mlock_tensors.emplace_back(argv[++i]);
       } else {
         throw std::runtime_error("unknown arg: " + std::string(a));
       }
     }
 
-    const cieft::GGUFLoader loader(path);
+    const cieft::GGUFLoader loader(path, map_opts);
+    for (const auto name : loader.tensor_names()) {
+      for (const auto& pat : mlock_tensors) {
+        if (name.find(pat) != std::string_view::npos) {
+          loader.lock(loader.get_tensor(name));
+          break;
+        }
+      }
+    }
     const auto cfg = loader.config();
 
     std::cout << "config: n_layers=" << cfg.n_layers << " d_model=" << cfg.d_model << " n_heads=" << cfg.n_heads
@@ -101,7 +184,23 @@ int main(int argc, char** argv) {
               << " ffn_hidden_dim=" << cfg.ffn_hidden_dim << " vocab=" << cfg.vocab_size << " rope_dim=" << cfg.rope_dim
               << " rope_theta=" << cfg.rope_theta << " rms_epsilon=" << cfg.rms_epsilon << "\n";
 
-    auto weights = cieft::load_weights(loader, {layer}, lm_head);
+    cieft::LoadProgress final_progress;
+    load_opts.progress = [&](const cieft::LoadProgress& p) {
+      final_progress = p;
+      if (show_progress) {
+        std::cerr << cieft::format_load_progress(p) << "\n";
+      }
+    };
+    const auto t_load = std::chrono::steady_clock::now();
+    bool cache_hit = false;
+    auto weights = cache_dir.empty() ? cieft::load_weights(loader, {layer}, lm_head, load_opts)
+                                     : cieft::load_weights_cached(loader, {layer}, lm_head, load_opts, cache_dir, &cache_hit);
+    if (cache_hit) {
+      std::cout << "load: weight cache hit, "
+                << std::chrono::duration<double>(std::chrono::steady_clock::now() - t_load).count() << "s\n";
+    } else {
+      std::cout << cieft::format_load_progress(final_progress) << "\n";
+    }
 
     print_tensor_stats("token_embd.weight", weights.global.token_embd);
 
@@ -130,6 +229,23 @@ int main(int argc, char** argv) {
     std::cout << "gather_column(token_embd.weight, token_id=1): min=" << emb_stats.min << " max=" << emb_stats.max
               << " nan=" << emb_stats.nans << " inf=" << emb_stats.infs << "\n";
 
+    // Float32 views of arbitrary tensors that only dequantize the pages the sampling reads.
+    for (const auto name : loader.tensor_names()) {
+      const bool match = std::any_of(fault_tensors.begin(), fault_tensors.end(),
+                                     [&](const std::string& pat) { return name.find(pat) != std::string_view::npos; });
+      if (!match) {
+        continue;
+      }
+      const cieft::FaultingTensorView view(loader.get_tensor(name), fault_opts);
+      print_tensor_stats("fault:" + std::string(name), view.dims(), view.data(), view.numel(), 4096);
+      const auto fst = view.stats();
+      constexpr double kMiB = 1024.0 * 1024.0;
+      std::cout << "  " << (view.on_demand() ? "userfaultfd" : "eager") << " faults=" << fst.faults
+                << " evictions=" << fst.evictions << " resident_MiB=" << std::setprecision(3)
+                << static_cast<double>(fst.peak_resident_bytes) / kMiB << " of "
+                << static_cast<double>(view.numel() * sizeof(float)) / kMiB << " dequant_s=" << fst.dequant_s << "\n";
+    }
+
     return 0;
   } catch (const std::exception& e) {
     std::cerr << "error: " << e.what() << "\n";
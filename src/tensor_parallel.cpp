@@ -0,0 +1,474 @@
+#include "tensor_parallel.h"
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+#include "kernels/attention.h"
+#include "kernels/math.h"
+#include "kernels/matvec.h"
+#include "kernels/rmsnorm.h"
+#include "kernels/rope.h"
+#include "layer0.h"
+#include "numa.h"
+
+namespace cieft {
+
+namespace {
+
+constexpr std::uint32_t kMaxRanks = 64;
+
+struct alignas(64) Counter {
+  std::atomic<std::uint64_t> value{0};
+};
+
+// [first, second) of `n` items owned by `rank` of `ranks`.
+std::pair<std::uint32_t, std::uint32_t> share(std::uint32_t n, std::uint32_t ranks, std::uint32_t rank) {
+  return {static_cast<std::uint32_t>(static_cast<std::uint64_t>(n) * rank / ranks),
+          static_cast<std::uint32_t>(static_cast<std::uint64_t>(n) * (rank + 1) / ranks)};
+}
+
+const float* float_data(const TensorF32& t, const char* what) {
+  if (t.packed()) {
+    throw std::runtime_error(std::string("tensor parallel needs float32 weights: ") + what + " is packed");
+  }
+  return t.data();
+}
+
+// Columns [c0, c1) of a column-major [in, out] matrix: one contiguous block.
+std::vector<float> slice_cols(const TensorF32& W, std::uint32_t c0, std::uint32_t c1, const char* what) {
+  const std::size_t in = W.dims.at(0);
+  const float* src = float_data(W, what);
+  return std::vector<float>(src + c0 * in, src + c1 * in);
+}
+
+// Rows [r0, r1) of every column, packed as a [r1 - r0, out] matrix.
+std::vector<float> slice_rows(const TensorF32& W, std::uint32_t r0, std::uint32_t r1, const char* what) {
+  const std::size_t in = W.dims.at(0);
+  const std::size_t out = W.numel / in;
+  const std::size_t rows = r1 - r0;
+  const float* src = float_data(W, what);
+  std::vector<float> dst(rows * out);
+  for (std::size_t c = 0; c < out; c++) {
+    std::memcpy(dst.data() + c * rows, src + c * in + r0, rows * sizeof(float));
+  }
+  return dst;
+}
+
+std::vector<float> copy_vector(const TensorF32& t, const char* what) {
+  const float* src = float_data(t, what);
+  return std::vector<float>(src, src + t.numel);
+}
+
+}  // namespace
+
+// Header of the shared mapping; per-rank partial sums (double-buffered) and the gathered
+// logits follow it.
+struct TensorParallel::Shared {
+  Counter arrived[kMaxRanks];  // collectives each rank has completed its writes for
+  Counter command;             // commands rank 0 has published
+  std::atomic<std::uint32_t> failed{0};
+
+  // The current command, written by rank 0 before `command` is bumped.
+  std::uint32_t token = 0;
+  std::uint32_t pos = 0;
+  std::uint32_t want_logits = 0;
+  std::uint32_t stop = 0;
+
+  std::uint32_t ranks = 0;
+  std::uint32_t d_model = 0;
+
+  // Rank 0's pid and its workers' (index = rank), written as it forks them. A worker
+  // killed by a signal never sets `failed`, so rank 0 also watches the pids.
+  pid_t owner = 0;
+  pid_t worker_pid[kMaxRanks] = {};
+
+  static std::size_t header_bytes() { return (sizeof(Shared) + 63) / 64 * 64; }
+  static std::size_t bytes(std::uint32_t ranks, std::uint32_t d_model, std::uint32_t vocab) {
+    return header_bytes() + (2 * static_cast<std::size_t>(ranks) * d_model + vocab) * sizeof(float);
+  }
+
+  float* partial(std::uint64_t collective, std::uint32_t rank) {
+    float* base = reinterpret_cast<float*>(reinterpret_cast<std::uint8_t*>(this) + header_bytes());
+    return base + ((collective & 1) * ranks + rank) * static_cast<std::size_t>(d_model);
+  }
+  float* logits() { return partial(0, 0) + 2 * static_cast<std::size_t>(ranks) * d_model; }
+
+  // Spins until `done()`, backing off to yields and then short sleeps. Throws once any
+  // rank has failed, so nobody waits forever on a dead peer. Workers die with rank 0
+  // (PR_SET_PDEATHSIG); rank 0 checks on its workers whenever it sleeps.
+  template <typename Done>
+  void wait(const Done& done) {
+    for (std::uint64_t spins = 0; !done(); spins++) {
+      if (failed.load(std::memory_order_relaxed) != 0) {
+        throw std::runtime_error("tensor parallel: a rank failed");
+      }
+      if (spins > (1u << 16)) {
+        if (::getpid() == owner) {
+          check_workers();
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+      } else if (spins > 256) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  // Throws (and marks the run failed) if a worker has exited. WNOWAIT leaves it to be
+  // reaped by `stop_workers`.
+  void check_workers() {
+    for (std::uint32_t r = 1; r < ranks; r++) {
+      siginfo_t info{};
+      if (worker_pid[r] <= 0 ||
+          ::waitid(P_PID, static_cast<id_t>(worker_pid[r]), &info, WEXITED | WNOHANG | WNOWAIT) != 0 ||
+          info.si_pid == 0) {
+        continue;
+      }
+      failed.store(1);
+      const bool signaled = info.si_code == CLD_KILLED || info.si_code == CLD_DUMPED;
+      throw std::runtime_error("tensor parallel: rank " + std::to_string(r) + " " +
+                               (signaled ? "killed by signal " : "exited with status ") +
+                               std::to_string(info.si_status));
+    }
+  }
+};
+
+// One rank's slices, KV cache and activations.
+struct TensorParallel::Rank {
+  struct Layer {
+    std::vector<float> attn_norm, ffn_norm;
+    std::vector<float> q, k, v;  // [d, rank's q / kv dims]
+    std::vector<float> o;        // [rank's q dims, d]
+    std::vector<float> gate, up; // [d, rank's ffn units]
+    std::vector<float> down;     // [rank's ffn units, d]
+    std::vector<float> k_cache, v_cache;
+    KVCacheLayer cache;
+    float scale = 1.0f;
+  };
+
+  Rank(Weights& w, const ModelConfig& model_cfg, Shared* shared_region, std::uint32_t r) : shared(shared_region) {
+    cfg = model_cfg;
+    rank = r;
+    ranks = shared->ranks;
+    const std::uint32_t hd = cfg.head_dim;
+    const std::uint32_t group = cfg.n_heads / cfg.n_kv_heads;
+    const auto [kv0, kv1] = share(cfg.n_kv_heads, ranks, rank);
+    kv_heads = kv1 - kv0;
+    q_heads = kv_heads * group;
+    const std::uint32_t q0 = kv0 * group * hd;
+    const std::uint32_t q1 = kv1 * group * hd;
+    std::tie(ffn0, ffn1) = share(cfg.ffn_hidden_dim, ranks, rank);
+    std::tie(vocab0, vocab1) = share(cfg.vocab_size, ranks, rank);
+    const std::uint32_t max_seq = cfg.context_length != 0 ? cfg.context_length : 2048;
+
+    layers.resize(w.layers.size());
+    for (std::size_t i = 0; i < w.layers.size(); i++) {
+      LayerWeights& src = w.layers[i];
+      Layer& l = layers[i];
+      l.attn_norm = copy_vector(src.attn_norm, "attn_norm");
+      l.ffn_norm = copy_vector(src.ffn_norm, "ffn_norm");
+      l.q = slice_cols(src.attn_q, q0, q1, "attn_q");
+      l.k = slice_cols(src.attn_k, kv0 * hd, kv1 * hd, "attn_k");
+      l.v = slice_cols(src.attn_v, kv0 * hd, kv1 * hd, "attn_v");
+      l.o = slice_rows(src.attn_output, q0, q1, "attn_output");
+      l.gate = slice_cols(src.ffn_gate, ffn0, ffn1, "ffn_gate");
+      l.up = slice_cols(src.ffn_up, ffn0, ffn1, "ffn_up");
+      l.down = slice_rows(src.ffn_down, ffn0, ffn1, "ffn_down");
+      l.k_cache.resize(KVCacheLayer::floats(kv_heads, max_seq, hd));
+      l.v_cache.resize(l.k_cache.size());
+      l.cache = KVCacheLayer(kv_heads, max_seq, hd, l.k_cache.data(), l.v_cache.data());
+      l.scale = src.folded ? 1.0f : 1.0f / std::sqrt(static_cast<float>(hd));
+      src = LayerWeights{};  // the full matrices are no longer needed by this rank
+    }
+    output_norm = copy_vector(*w.global.output_norm, "output_norm");
+    lm_head = slice_cols(*w.global.output, vocab0, vocab1, "output");
+    w.global.output.reset();
+    embd = &w.global.token_embd;
+
+    const std::uint32_t rope_dim = cfg.rope_dim != 0 ? cfg.rope_dim : hd;
+    rope.reset(rope_dim, cfg.rope_theta != 0.0f ? cfg.rope_theta : 10000.0f);
+    rope_fn = kernels::select_rope_f32(hd, rope_dim);
+    attention = kernels::select_attention_f32(hd, group);
+
+    x.resize(cfg.d_model);
+    xn.resize(cfg.d_model);
+    q.resize(static_cast<std::size_t>(q_heads) * hd);
+    k.resize(static_cast<std::size_t>(kv_heads) * hd);
+    v.resize(k.size());
+    attn.resize(q.size());
+    scores.resize(static_cast<std::size_t>(q_heads) * max_seq);
+    gate.resize(ffn1 - ffn0);
+    up.resize(gate.size());
+  }
+
+  std::size_t slice_bytes() const {
+    std::size_t n = lm_head.size();
+    for (const Layer& l : layers) {
+      n += l.q.size() + l.k.size() + l.v.size() + l.o.size() + l.gate.size() + l.up.size() + l.down.size();
+    }
+    return n * sizeof(float);
+  }
+
+  // Marks this rank's writes for the next collective visible and waits for every rank's.
+  std::uint64_t barrier() {
+    const std::uint64_t c = collectives++;
+    shared->arrived[rank].value.store(c + 1, std::memory_order_release);
+    shared->wait([&] {
+      for (std::uint32_t r = 0; r < ranks; r++) {
+        if (shared->arrived[r].value.load(std::memory_order_acquire) <= c) {
+          return false;
+        }
+      }
+      return true;
+    });
+    return c;
+  }
+
+  // y += sum over ranks of W_rows^T in, where this rank holds `rows` input rows of W. The
+  // partial goes straight into this rank's shared slot; every rank then adds the slots in
+  // rank order, so all copies of `y` stay bit-identical. Slots alternate between two
+  // buffers: a rank can only reuse one after everyone has passed the following barrier,
+  // i.e. finished reading it.
+  void all_reduce_add(const std::vector<float>& W_rows, std::uint32_t rows, const float* in, float* y) {
+    const std::uint32_t d = cfg.d_model;
+    kernels::kMatVecVariants[0].set(W_rows.data(), rows, d, in, shared->partial(collectives, rank));
+    const std::uint64_t c = barrier();
+    for (std::uint32_t i = 0; i < d; i++) {
+      double sum = 0.0;
+      for (std::uint32_t r = 0; r < ranks; r++) {
+        sum += static_cast<double>(shared->partial(c, r)[i]);
+      }
+      y[i] += static_cast<float>(sum);
+    }
+  }
+
+  void run(std::uint32_t token, std::uint32_t pos, bool want_logits) {
+    const std::uint32_t d = cfg.d_model;
+    const std::uint32_t hd = cfg.head_dim;
+    const float eps = cfg.rms_epsilon;
+    const auto matvec = kernels::kMatVecVariants[0].set;
+    gather_column(*embd, token, x.data());
+
+    for (Layer& l : layers) {
+      kernels::rmsnorm_f32(x.data(), l.attn_norm.data(), d, eps, xn.data());
+      matvec(l.q.data(), d, static_cast<std::uint32_t>(q.size()), xn.data(), q.data());
+      matvec(l.k.data(), d, static_cast<std::uint32_t>(k.size()), xn.data(), k.data());
+      matvec(l.v.data(), d, static_cast<std::uint32_t>(v.size()), xn.data(), v.data());
+      rope_fn(rope, q.data(), q_heads, hd, pos);
+      rope_fn(rope, k.data(), kv_heads, hd, pos);
+      l.cache.write(pos, k.data(), v.data());
+
+      kernels::AttentionArgs a;
+      a.q = q.data();
+      a.k_cache = l.cache.k_ptr(0, 0);
+      a.v_cache = l.cache.v_ptr(0, 0);
+      a.kv_head_stride = static_cast<std::size_t>(l.cache.max_seq()) * hd;
+      a.n_heads = q_heads;
+      a.n_kv_heads = kv_heads;
+      a.head_dim = hd;
+      a.n_pos = pos + 1;
+      a.scale = l.scale;
+      a.scores = scores.data();
+      a.out = attn.data();
+      attention(a);
+      all_reduce_add(l.o, static_cast<std::uint32_t>(attn.size()), attn.data(), x.data());
+
+      kernels::rmsnorm_f32(x.data(), l.ffn_norm.data(), d, eps, xn.data());
+      matvec(l.gate.data(), d, static_cast<std::uint32_t>(gate.size()), xn.data(), gate.data());
+      matvec(l.up.data(), d, static_cast<std::uint32_t>(up.size()), xn.data(), up.data());
+      for (std::size_t i = 0; i < gate.size(); i++) {
+        gate[i] = kernels::silu(gate[i]) * up[i];
+      }
+      all_reduce_add(l.down, static_cast<std::uint32_t>(gate.size()), gate.data(), x.data());
+    }
+
+    if (want_logits) {
+      // All-gather: each rank writes its vocabulary range, then one barrier.
+      kernels::rmsnorm_f32(x.data(), output_norm.data(), d, eps, xn.data());
+      matvec(lm_head.data(), d, vocab1 - vocab0, xn.data(), shared->logits() + vocab0);
+      barrier();
+    }
+  }
+
+  ModelConfig cfg;
+  std::uint32_t rank = 0;
+  std::uint32_t ranks = 1;
+  std::uint32_t q_heads = 0;
+  std::uint32_t kv_heads = 0;
+  std::uint32_t ffn0 = 0, ffn1 = 0;
+  std::uint32_t vocab0 = 0, vocab1 = 0;
+  std::vector<Layer> layers;
+  const TensorF32* embd = nullptr;
+  std::vector<float> output_norm;
+  std::vector<float> lm_head;  // [d, rank's vocab range]
+
+  kernels::RoPECache rope;
+  kernels::RopeFn rope_fn = nullptr;
+  kernels::AttentionFn attention = nullptr;
+
+  std::vector<float> x, xn, q, k, v, attn, scores, gate, up;
+  Shared* shared = nullptr;
+  std::uint64_t collectives = 0;
+};
+
+namespace {
+
+void pin_rank(std::uint32_t rank, std::uint32_t ranks) {
+  const NumaTopology topo = NumaTopology::detect();
+  pin_current_thread(topo.node_cpus[static_cast<std::uint64_t>(rank) * topo.nodes() / ranks]);
+}
+
+}  // namespace
+
+void TensorParallel::worker_main(Weights& w, const ModelConfig& cfg, const TensorParallelOptions& opts,
+                                 Shared* shared, std::uint32_t rank) {
+  int status = 0;
+  try {
+    if (opts.pin_numa) {
+      pin_rank(rank, opts.ranks);
+    }
+    Rank self(w, cfg, shared, rank);
+    self.barrier();  // ready
+    for (std::uint64_t seen = 0;; seen++) {
+      shared->wait([&] { return shared->command.value.load(std::memory_order_acquire) > seen; });
+      if (shared->stop != 0) {
+        break;
+      }
+      self.run(shared->token, shared->pos, shared->want_logits != 0);
+    }
+  } catch (const std::exception& e) {
+    if (shared->failed.exchange(1) == 0) {
+      std::fprintf(stderr, "error: tensor parallel rank %u: %s\n", rank, e.what());
+    }
+    status = 1;
+  }
+  std::_Exit(status);
+}
+
+TensorParallel::TensorParallel(Weights& w, const ModelConfig& cfg, const TensorParallelOptions& opts)
+    : ranks_(opts.ranks), vocab_(cfg.vocab_size) {
+  if (ranks_ == 0 || ranks_ > kMaxRanks) {
+    throw std::runtime_error("tensor parallel: ranks must be 1.." + std::to_string(kMaxRanks));
+  }
+  if (cfg.n_kv_heads % ranks_ != 0) {
+    throw std::runtime_error("tensor parallel: n_kv_heads (" + std::to_string(cfg.n_kv_heads) +
+                             ") is not a multiple of the rank count");
+  }
+  if (!w.global.output || !w.global.output_norm) {
+    throw std::runtime_error("tensor parallel: LM head not loaded");
+  }
+  if (w.layers.size() != cfg.n_layers) {
+    throw std::runtime_error("tensor parallel: every layer must be loaded");
+  }
+
+  shared_bytes_ = Shared::bytes(ranks_, cfg.d_model, cfg.vocab_size);
+  shared_map_ = ::mmap(nullptr, shared_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared_map_ == MAP_FAILED) {
+    shared_map_ = nullptr;
+    throw std::runtime_error("tensor parallel: mmap of the shared region failed");
+  }
+  shared_ = new (shared_map_) Shared;
+  shared_->ranks = ranks_;
+  shared_->d_model = cfg.d_model;
+  shared_->owner = ::getpid();
+
+  // Buffered output would otherwise be flushed once per process.
+  std::cout.flush();
+  std::fflush(nullptr);
+  for (std::uint32_t r = 1; r < ranks_; r++) {
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+      shared_->failed.store(1);
+      stop_workers();
+      throw std::runtime_error("tensor parallel: fork failed");
+    }
+    if (pid == 0) {
+#if defined(__linux__)
+      ::prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+      worker_main(w, cfg, opts, shared_, r);
+    }
+    workers_.push_back(pid);
+    shared_->worker_pid[r] = pid;
+  }
+
+  try {
+    if (opts.pin_numa) {
+      pin_rank(0, ranks_);
+    }
+    rank0_ = std::make_unique<Rank>(w, cfg, shared_, 0);
+    rank0_->barrier();  // every worker has its slices
+  } catch (...) {
+    shared_->failed.store(1);
+    stop_workers();
+    throw;
+  }
+}
+
+TensorParallel::~TensorParallel() { stop_workers(); }
+
+std::size_t TensorParallel::slice_bytes() const { return rank0_ ? rank0_->slice_bytes() : 0; }
+
+void TensorParallel::step(std::uint32_t token, std::uint32_t pos, float* out_vocab) {
+  if (rank0_ == nullptr) {
+    throw std::runtime_error("tensor parallel: not running");
+  }
+  shared_->token = token;
+  shared_->pos = pos;
+  shared_->want_logits = out_vocab != nullptr ? 1 : 0;
+  shared_->command.value.store(++commands_, std::memory_order_release);
+  try {
+    rank0_->run(token, pos, out_vocab != nullptr);
+  } catch (...) {
+    shared_->failed.store(1);
+    throw;
+  }
+  if (out_vocab != nullptr) {
+    std::memcpy(out_vocab, shared_->logits(), static_cast<std::size_t>(vocab_) * sizeof(float));
+  }
+}
+
+void TensorParallel::stop_workers() {
+  if (shared_ != nullptr && !workers_.empty()) {
+    if (shared_->failed.load() != 0) {
+      for (const pid_t pid : workers_) {
+        ::kill(pid, SIGKILL);
+      }
+    } else {
+      shared_->stop = 1;
+      shared_->command.value.store(++commands_, std::memory_order_release);
+    }
+    for (const pid_t pid : workers_) {
+      int status = 0;
+      ::waitpid(pid, &status, 0);
+    }
+  }
+  workers_.clear();
+  rank0_.reset();
+  if (shared_map_ != nullptr) {
+    shared_->~Shared();
+    ::munmap(shared_map_, shared_bytes_);
+    shared_map_ = nullptr;
+    shared_ = nullptr;
+  }
+}
+
+}  // namespace cieft
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "gguf_loader.h"
+#include "weights.h"
+
+namespace cieft {
+
+struct TensorParallelOptions {
+  std::uint32_t ranks = 2;  // processes, including the calling one (rank 0)
+
+  // Pin rank r to NUMA node r * nodes / ranks before it copies its slices, so each rank's
+  // weights are first touched (and therefore placed) on its own node.
+  bool pin_numa = false;
+};
+
+// Tensor-parallel decoding across `ranks` local processes (Megatron-style). Rank r owns
+// kv heads [r * n_kv / ranks, ...) with their query heads, a contiguous share of the FFN
+// hidden units and of the vocabulary:
+//   - attn_q/k/v and ffn_gate/up: the rank's output columns,
+//   - attn_output and ffn_down: the rank's input rows, giving a partial residual update,
+//   - output (LM head): the rank's vocabulary columns.
+// Norms, RoPE and attention over the rank's own KV cache run locally; the residual stream
+// is replicated and kept identical on every rank by two all-reduces per layer, and logits
+// are all-gathered. Ranks exchange data through one MAP_SHARED region, sequenced by
+// per-rank atomic counters (no locks, no syscalls on the hot path), so it needs nothing
+// beyond one Linux box.
+//
+// Workers are fork()ed by the constructor: no other threads may be running then (create
+// thread pools afterwards). Each rank copies its slices into private memory and drops its
+// view of the full layer matrices and LM head in `w`.
+class TensorParallel {
+ public:
+  // `w` must hold every layer and the LM head, in float32 (no packed precision policy);
+  // cfg.n_kv_heads must be a multiple of `opts.ranks`. `cfg` may override context_length.
+  TensorParallel(Weights& w, const ModelConfig& cfg, const TensorParallelOptions& opts);
+  ~TensorParallel();
+
+  TensorParallel(const TensorParallel&) = delete;
+  TensorParallel& operator=(const TensorParallel&) = delete;
+
+  std::uint32_t ranks() const { return ranks_; }
+  // Bytes of matrix slices rank 0 holds (every rank holds about the same).
+  std::size_t slice_bytes() const;
+
+  // Embeds `token`, runs every layer at `pos` on all ranks and, if `out_vocab` is non-null,
+  // the LM head, gathered into `out_vocab`.
+  void step(std::uint32_t token, std::uint32_t pos, float* out_vocab);
+
+ private:
+  struct Rank;
+  struct Shared;
+
+  [[noreturn]] static void worker_main(Weights& w, const ModelConfig& cfg, const TensorParallelOptions& opts,
+                                       Shared* shared, std::uint32_t rank);
+  void stop_workers();
+
+  std::uint32_t ranks_ = 1;
+  std::uint32_t vocab_ = 0;
+  void* shared_map_ = nullptr;
+  std::size_t shared_bytes_ = 0;
+  Shared* shared_ = nullptr;
+  std::unique_ptr<Rank> rank0_;
+  std::vector<pid_t> workers_;
+  std::uint64_t commands_ = 0;
+};
+
+}  // namespace cieft
@@ -0,0 +1,451 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cieft {
+
+// Scheduler counters of one pool thread, summed over every parallel region it was woken
+// for since construction or `ThreadPool::reset_stats`.
+struct WorkerStats {
+  std::uint64_t tasks = 0;
+  std::uint64_t steals = 0;   // ranges taken from another thread's deque
+  std::uint64_t busy_ns = 0;  // inside task bodies
+  std::uint64_t idle_ns = 0;  // rest of each region: waking, searching, waiting on stragglers
+};
+
+// One line per thread, then the busiest thread's time over the mean (1.00 = balanced).
+inline std::string format_worker_stats(const std::vector<WorkerStats>& stats) {
+  std::string out;
+  char buf[160];
+  std::uint64_t max_busy = 0;
+  std::uint64_t sum_busy = 0;
+  for (std::size_t t = 0; t < stats.size(); t++) {
+    const WorkerStats& w = stats[t];
+    std::snprintf(buf, sizeof(buf), "  t%zu: %llu tasks, %llu steals, busy %.3f ms, idle %.3f ms\n", t,
+                  static_cast<unsigned long long>(w.tasks), static_cast<unsigned long long>(w.steals),
+                  static_cast<double>(w.busy_ns) / 1e6, static_cast<double>(w.idle_ns) / 1e6);
+    out += buf;
+    max_busy = std::max(max_busy, w.busy_ns);
+    sum_busy += w.busy_ns;
+  }
+  const double mean = stats.empty() ? 0.0 : static_cast<double>(sum_busy) / static_cast<double>(stats.size());
+  std::snprintf(buf, sizeof(buf), "  imbalance (max/mean busy): %.2f\n",
+                mean > 0.0 ? static_cast<double>(max_busy) / mean : 1.0);
+  out += buf;
+  return out;
+}
+
+// Fixed-size pool for data-parallel loops. The calling thread participates, so a pool of
+// size N spawns N-1 workers. Only one `parallel_for` runs at a time.
+//
+// By default `parallel_for` is work-stealing: every thread owns a deque of task indices,
+// seeded with one contiguous block, pops from its front and, once empty, steals the back
+// half of another thread's remainder. Neighbouring tasks (adjacent weight columns or rows)
+// therefore stay on one core unless the load is uneven.
+class ThreadPool {
+ public:
+  enum class Schedule {
+    Stealing,  // per-thread contiguous blocks, rebalanced by stealing
+    InOrder,   // one shared counter: tasks start in increasing index order
+  };
+
+  explicit ThreadPool(std::uint32_t n_threads = 0) {
+    if (n_threads == 0) {
+      n_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    size_ = n_threads;
+    slots_ = std::make_unique<Slot[]>(size_);
+    workers_.reserve(size_ - 1);
+    for (std::uint32_t i = 1; i < size_; i++) {
+      workers_.emplace_back([this, i] { worker_loop(i); });
+    }
+    set_thread_nodes(std::vector<std::uint32_t>(size_, 0));
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : workers_) {
+      t.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  std::uint32_t size() const { return size_; }
+
+  // Number of tasks to cut `n_items` items of `item_bytes` each into: about half an L2
+  // cache of data per task, so a task's block stays resident while it runs, but at least
+  // `min_tasks` (and at most `n_items`).
+  static std::size_t task_count(std::size_t n_items, std::size_t item_bytes, std::size_t min_tasks) {
+    const std::size_t per_task = std::max<std::size_t>(1, l2_cache_bytes() / 2 / std::max<std::size_t>(1, item_bytes));
+    return std::min(n_items, std::max(min_tasks, (n_items + per_task - 1) / per_task));
+  }
+
+  static std::size_t l2_cache_bytes() {
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    const long l2 = ::sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (l2 > 0) {
+      return static_cast<std::size_t>(l2);
+    }
+#endif
+    return 1u << 20;
+  }
+
+  // Per-thread counters (index = thread, 0 = caller). Call between parallel regions only.
+  std::vector<WorkerStats> stats() const {
+    std::vector<WorkerStats> out(size_);
+    for (std::uint32_t t = 0; t < size_; t++) {
+      out[t] = slots_[t].stats;
+    }
+    return out;
+  }
+  void reset_stats() {
+    for (std::uint32_t t = 0; t < size_; t++) {
+      slots_[t].stats = WorkerStats{};
+    }
+  }
+
+  // NUMA node each thread works for (see `assign_pool_to_nodes`); all 0 by default.
+  void set_thread_nodes(std::vector<std::uint32_t> nodes) {
+    if (nodes.size() != size_) {
+      throw std::runtime_error("ThreadPool::set_thread_nodes: size mismatch");
+    }
+    numa_nodes_ = 1 + *std::max_element(nodes.begin(), nodes.end());
+    node_threads_.assign(numa_nodes_, 0);
+    thread_rank_.resize(size_);
+    for (std::uint32_t t = 0; t < size_; t++) {
+      thread_rank_[t] = node_threads_[nodes[t]]++;
+    }
+    thread_node_ = std::move(nodes);
+  }
+  std::uint32_t numa_nodes() const { return numa_nodes_; }
+  std::uint32_t thread_node(std::uint32_t thread) const { return thread_node_[thread]; }
+  // Index of `thread` among the threads of its node, and how many threads a node has.
+  std::uint32_t thread_rank(std::uint32_t thread) const { return thread_rank_[thread]; }
+  std::uint32_t node_threads(std::uint32_t node) const { return node_threads_[node]; }
+
+  // Runs fn(t) exactly once on every thread t of the pool, with t = 0 on the caller and
+  // t = i on the i-th worker, so work can be assigned by thread identity (e.g. pinning, or
+  // processing data local to the thread's node). Rethrows the first exception.
+  void for_each_thread(const std::function<void(std::uint32_t)>& fn) {
+    if (size_ == 1) {
+      run_inline(1, [&](std::size_t) { fn(0); });
+      return;
+    }
+
+    std::lock_guard<std::mutex> run_lk(run_mu_);
+    begin_region([&] { thread_fn_ = &fn; });
+    run_thread_fn(0);
+    end_region([&] { thread_fn_ = nullptr; });
+  }
+
+  // Runs fn(i) for every i in [0, n) on up to `max_threads` threads (0 = all). Uneven task
+  // costs balance across threads either by stealing or, with `Schedule::InOrder`, through
+  // the shared counter. Rethrows the first exception after all tasks stop.
+  void parallel_for(std::size_t n, const std::function<void(std::size_t)>& fn, Schedule schedule = Schedule::Stealing,
+                    std::uint32_t max_threads = 0) {
+    if (n == 0) {
+      return;
+    }
+    const std::uint32_t threads = static_cast<std::uint32_t>(
+        std::min<std::size_t>(n, max_threads == 0 ? size_ : std::min(max_threads, size_)));
+    if (threads == 1) {
+      run_inline(n, fn);
+      return;
+    }
+    if (n > std::numeric_limits<std::uint32_t>::max()) {
+      schedule = Schedule::InOrder;  // deque ranges are packed as two 32-bit indices
+    }
+
+    std::lock_guard<std::mutex> run_lk(run_mu_);
+    begin_region([&] {
+      fn_ = &fn;
+      n_ = n;
+      schedule_ = schedule;
+      participants_ = threads;
+      node_local_ = false;
+      for (std::uint32_t t = 0; t < size_; t++) {
+        const std::uint64_t b = t < threads ? n * t / threads : 0;
+        const std::uint64_t e = t < threads ? n * (t + 1) / threads : 0;
+        slots_[t].range.store(pack(b, e), std::memory_order_relaxed);
+      }
+    });
+    run_tasks(0);
+    end_region([&] { fn_ = nullptr; });
+  }
+
+  // NUMA-local `parallel_for`: runs fn(i) for every i in [0, node_begin[numa_nodes()]),
+  // where node n's tasks are [node_begin[n], node_begin[n + 1]). They run only on the
+  // first `per_node` threads of node n (0 = all of them), seeded with contiguous blocks
+  // and stealing only from each other, so a node's tasks never leave its cores. Without
+  // a node split this is `parallel_for` on `per_node` threads.
+  void parallel_for_nodes(const std::size_t* node_begin, const std::function<void(std::size_t)>& fn,
+                          std::uint32_t per_node = 0) {
+    const std::size_t n = node_begin[numa_nodes_];
+    if (thread_node_.empty() || numa_nodes_ == 1) {
+      parallel_for(n, fn, Schedule::Stealing, per_node);
+      return;
+    }
+    if (n == 0) {
+      return;
+    }
+    if (n > std::numeric_limits<std::uint32_t>::max()) {
+      throw std::runtime_error("ThreadPool::parallel_for_nodes: too many tasks");
+    }
+
+    std::lock_guard<std::mutex> run_lk(run_mu_);
+    begin_region([&] {
+      fn_ = &fn;
+      n_ = n;
+      schedule_ = Schedule::Stealing;
+      participants_ = size_;
+      node_local_ = true;
+      per_node_ = per_node == 0 ? size_ : per_node;
+      for (std::uint32_t t = 0; t < size_; t++) {
+        const std::uint32_t node = thread_node_[t];
+        const std::uint32_t count = std::min(per_node_, node_threads_[node]);
+        const std::uint64_t tasks = node_begin[node + 1] - node_begin[node];
+        const std::uint64_t rank = thread_rank_[t];
+        const std::uint64_t b = rank < count ? node_begin[node] + tasks * rank / count : 0;
+        const std::uint64_t e = rank < count ? node_begin[node] + tasks * (rank + 1) / count : 0;
+        slots_[t].range.store(pack(b, e), std::memory_order_relaxed);
+      }
+    });
+    run_tasks(0);
+    end_region([&] { fn_ = nullptr; });
+  }
+
+ private:
+  // One thread's deque of task indices, [begin, end) packed into one word so the owner's
+  // pop and a thief's split are each a single CAS.
+  struct alignas(64) Slot {
+    std::atomic<std::uint64_t> range{0};
+    std::uint64_t region_busy_ns = 0;
+    WorkerStats stats;
+  };
+
+  static std::uint64_t pack(std::uint64_t begin, std::uint64_t end) { return begin << 32 | end; }
+  static std::uint64_t range_begin(std::uint64_t r) { return r >> 32; }
+  static std::uint64_t range_end(std::uint64_t r) { return r & 0xffffffffu; }
+
+  static std::uint64_t now_ns() {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  }
+
+  template <typename Fn>
+  void run_inline(std::size_t n, const Fn& fn) {
+    const std::uint64_t t0 = now_ns();
+    for (std::size_t i = 0; i < n; i++) {
+      fn(i);
+    }
+    slots_[0].stats.tasks += n;
+    slots_[0].stats.busy_ns += now_ns() - t0;
+  }
+
+  // Publishes a region (`setup` runs under the lock) and wakes every worker.
+  template <typename Setup>
+  void begin_region(const Setup& setup) {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      setup();
+      next_.store(0);
+      cancel_.store(false);
+      active_ = size_ - 1;
+      error_ = nullptr;
+      region_start_ns_ = now_ns();
+      generation_ += 1;
+    }
+    cv_.notify_all();
+  }
+
+  // Waits for every worker, books the region's idle time and rethrows a task's exception.
+  template <typename Teardown>
+  void end_region(const Teardown& teardown) {
+    std::unique_lock<std::mutex> lk(mu_);
+    done_cv_.wait(lk, [this] { return active_ == 0; });
+    teardown();
+    const std::uint64_t wall = now_ns() - region_start_ns_;
+    for (std::uint32_t t = 0; t < size_; t++) {
+      Slot& s = slots_[t];
+      s.stats.busy_ns += s.region_busy_ns;
+      s.stats.idle_ns += wall > s.region_busy_ns ? wall - s.region_busy_ns : 0;
+      s.region_busy_ns = 0;
+    }
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+  void record_error() {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!error_) {
+      error_ = std::current_exception();
+    }
+    cancel_.store(true);
+  }
+
+  void run_task(Slot& me, std::size_t i) {
+    const std::uint64_t t0 = now_ns();
+    try {
+      (*fn_)(i);
+    } catch (...) {
+      record_error();
+    }
+    me.region_busy_ns += now_ns() - t0;
+    me.stats.tasks += 1;
+  }
+
+  // Takes the front index of `slot`'s own range.
+  static bool pop(Slot& slot, std::size_t* i) {
+    std::uint64_t r = slot.range.load(std::memory_order_acquire);
+    while (range_begin(r) < range_end(r)) {
+      if (slot.range.compare_exchange_weak(r, pack(range_begin(r) + 1, range_end(r)), std::memory_order_acq_rel)) {
+        *i = static_cast<std::size_t>(range_begin(r));
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Moves the back half of the first non-empty range after `thread`'s into its own slot
+  // (of a thread on the same node, in a node-local region).
+  bool steal(std::uint32_t thread) {
+    for (std::uint32_t k = 1; k < size_; k++) {
+      const std::uint32_t v = (thread + k) % size_;
+      if (node_local_ && thread_node_[v] != thread_node_[thread]) {
+        continue;
+      }
+      Slot& victim = slots_[v];
+      std::uint64_t r = victim.range.load(std::memory_order_acquire);
+      while (range_begin(r) < range_end(r)) {
+        const std::uint64_t b = range_begin(r);
+        const std::uint64_t e = range_end(r);
+        const std::uint64_t mid = e - (e - b + 1) / 2;
+        if (victim.range.compare_exchange_weak(r, pack(b, mid), std::memory_order_acq_rel)) {
+          slots_[thread].range.store(pack(mid, e), std::memory_order_release);
+          slots_[thread].stats.steals += 1;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  void run_tasks(std::uint32_t thread) {
+    Slot& me = slots_[thread];
+    if (thread >= participants_ || (node_local_ && thread_rank_[thread] >= per_node_)) {
+      return;
+    }
+    if (schedule_ == Schedule::InOrder) {
+      for (;;) {
+        const std::size_t i = next_.fetch_add(1);
+        if (i >= n_ || cancel_.load(std::memory_order_relaxed)) {
+          return;
+        }
+        run_task(me, i);
+      }
+    }
+    for (;;) {
+      std::size_t i = 0;
+      if (pop(me, &i)) {
+        if (!cancel_.load(std::memory_order_relaxed)) {
+          run_task(me, i);
+        }
+      } else if (!steal(thread)) {
+        return;
+      }
+    }
+  }
+
+  void run_thread_fn(std::uint32_t thread) {
+    Slot& me = slots_[thread];
+    const std::uint64_t t0 = now_ns();
+    try {
+      (*thread_fn_)(thread);
+    } catch (...) {
+      record_error();
+    }
+    me.region_busy_ns += now_ns() - t0;
+    me.stats.tasks += 1;
+  }
+
+  void worker_loop(std::uint32_t thread) {
+    std::uint64_t seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lk(mu_);
+        cv_.wait(lk, [&] { return stop_ || generation_ != seen; });
+        if (stop_) {
+          return;
+        }
+        seen = generation_;
+      }
+
+      if (thread_fn_ != nullptr) {
+        run_thread_fn(thread);
+      } else {
+        run_tasks(thread);
+      }
+
+      std::lock_guard<std::mutex> lk(mu_);
+      if (--active_ == 0) {
+        done_cv_.notify_one();
+      }
+    }
+  }
+
+  std::uint32_t size_ = 1;
+  std::vector<std::thread> workers_;
+  std::unique_ptr<Slot[]> slots_;
+  std::vector<std::uint32_t> thread_node_;
+  std::vector<std::uint32_t> thread_rank_;
+  std::vector<std::uint32_t> node_threads_;
+  std::uint32_t numa_nodes_ = 1;
+
+  std::mutex run_mu_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::condition_variable done_cv_;
+  bool stop_ = false;
+  std::uint64_t generation_ = 0;
+  std::uint32_t active_ = 0;
+  std::uint64_t region_start_ns_ = 0;
+
+  const std::function<void(std::size_t)>* fn_ = nullptr;
+  const std::function<void(std::uint32_t)>* thread_fn_ = nullptr;
+  std::size_t n_ = 0;
+  Schedule schedule_ = Schedule::Stealing;
+  std::uint32_t participants_ = 0;
+  bool node_local_ = false;     // `parallel_for_nodes`: steal within a node only
+  std::uint32_t per_node_ = 0;  // `parallel_for_nodes`: threads per node taking part
+  std::atomic<std::size_t> next_{0};
+  std::atomic<bool> cancel_{false};
+  std::exception_ptr error_;
+};
+
+}  // namespace cieft
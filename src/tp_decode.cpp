@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cli_util.h"
+#include "forward.h"
+#include "gguf_loader.h"
+#include "tensor_parallel.h"
+#include "weights.h"
+
+namespace {
+
+// rms(a - ref) / rms(ref)
+double rel_rms(const std::vector<float>& a, const std::vector<float>& ref) {
+  double err = 0.0;
+  double norm = 0.0;
+  for (std::size_t i = 0; i < a.size(); i++) {
+    const double e = static_cast<double>(a[i]) - static_cast<double>(ref[i]);
+    err += e * e;
+    norm += static_cast<double>(ref[i]) * static_cast<double>(ref[i]);
+  }
+  return norm > 0.0 ? std::sqrt(err / norm) : std::sqrt(err);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  try {
+    if (argc < 2) {
+      std::cerr << "usage: " << (argc > 0 ? argv[0] : "tp_decode")
+                << " <model.gguf> --tokens <id,id,...> --ranks N [--max-seq N] [--threads N] [--numa] [--compare]\n";
+      return 2;
+    }
+
+    const std::string path = argv[1];
+    std::vector<std::uint32_t> tokens;
+    std::uint32_t max_seq = 0;
+    bool compare = false;
+    cieft::TensorParallelOptions tp_opts;
+    cieft::LoadOptions load_opts;
+
+    for (int i = 2; i < argc; i++) {
+      const std::string_view a = argv[i];
+      auto next = [&]() -> std::string {
+        if (i + 1 >= argc) throw std::runtime_error(std::string(a) + " requires an argument");
+        return argv[++i];
+      };
+      if (a == "--tokens") {
+        tokens = cieft::parse_tokens(next());
+      } else if (a == "--ranks") {
+        tp_opts.ranks = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--max-seq") {
+        max_seq = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--threads") {
+        load_opts.n_threads = static_cast<std::uint32_t>(std::stoul(next()));
+      } else if (a == "--numa") {
+        tp_opts.pin_numa = true;
+      } else if (a == "--compare") {
+        compare = true;
+      } else {
+        throw std::runtime_error("unknown arg: " + std::string(a));
+      }
+    }
+    if (tokens.empty()) {
+      throw std::runtime_error("missing --tokens");
+    }
+
+    const cieft::GGUFLoader loader(path);
+    std::vector<std::uint32_t> layer_ids(loader.config().n_layers);
+    std::iota(layer_ids.begin(), layer_ids.end(), 0u);
+    cieft::Weights w = cieft::load_weights(loader, layer_ids, true, load_opts);
+
+    cieft::ModelConfig cfg = w.cfg;
+    if (max_seq != 0) {
+      cfg.context_length = max_seq;
+    }
+    if (tokens.size() > (cfg.context_length != 0 ? cfg.context_length : 2048)) {
+      throw std::runtime_error("sequence longer than --max-seq / context_length");
+    }
+    for (const auto t : tokens) {
+      if (t >= cfg.vocab_size) {
+        throw std::runtime_error("token id out of range for vocab");
+      }
+    }
+
+    // The single-process reference runs first: the tensor-parallel ranks drop the full
+    // matrices once they hold their slices.
+    std::vector<std::vector<float>> ref;
+    double ref_s = 0.0;
+    if (compare) {
+      cieft::ForwardContext ctx(cfg, cfg.n_layers);
+      std::vector<float> x(cfg.d_model);
+      for (std::size_t pos = 0; pos < tokens.size(); pos++) {
+        const auto t0 = std::chrono::steady_clock::now();
+        cieft::gather_column(w.global.token_embd, tokens[pos], x.data());
+        ctx.step(w, static_cast<std::uint32_t>(pos), x.data());
+        std::vector<float> logits(cfg.vocab_size);
+        ctx.logits(w, x.data(), logits.data());
+        ref_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        ref.push_back(std::move(logits));
+      }
+    }
+
+    const auto t_setup = std::chrono::steady_clock::now();
+    cieft::TensorParallel tp(w, cfg, tp_opts);
+    std::cout << "tensor parallel: " << tp.ranks() << " ranks, " << std::fixed << std::setprecision(1)
+              << static_cast<double>(tp.slice_bytes()) / (1024.0 * 1024.0) << " MiB of slices per rank, setup "
+              << std::setprecision(3) << std::chrono::duration<double>(std::chrono::steady_clock::now() - t_setup).count()
+              << "s\n";
+
+    std::vector<float> logits(cfg.vocab_size);
+    double tp_s = 0.0;
+    std::size_t argmax_match = 0;
+    double worst_rel = 0.0;
+    for (std::size_t pos = 0; pos < tokens.size(); pos++) {
+      const auto t0 = std::chrono::steady_clock::now();
+      tp.step(tokens[pos], static_cast<std::uint32_t>(pos), logits.data());
+      const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+      tp_s += ms / 1000.0;
+      std::cout << "pos=" << pos << " token=" << tokens[pos] << " " << std::setprecision(3) << ms
+                << " ms argmax=" << cieft::argmax(logits);
+      if (compare) {
+        const double rel = rel_rms(logits, ref[pos]);
+        worst_rel = std::max(worst_rel, rel);
+        argmax_match += cieft::argmax(logits) == cieft::argmax(ref[pos]) ? 1 : 0;
+        std::cout << " ref_argmax=" << cieft::argmax(ref[pos]) << " rel_rms=" << std::scientific << std::setprecision(2)
+                  << rel << std::fixed;
+      }
+      std::cout << "\n";
+    }
+
+    const double n = static_cast<double>(tokens.size());
+    std::cout << "tp: " << std::setprecision(3) << tp_s * 1000.0 / n << " ms/token, " << std::setprecision(1)
+              << n / tp_s << " tok/s";
+    if (compare) {
+      std::cout << "; single process: " << std::setprecision(3) << ref_s * 1000.0 / n << " ms/token, "
+                << std::setprecision(1) << n / ref_s << " tok/s; speedup " << std::setprecision(2) << ref_s / tp_s
+                << "x; argmax_match=" << argmax_match << "/" << tokens.size() << " worst rel_rms=" << std::scientific
+                << std::setprecision(2) << worst_rel << std::fixed;
+    }
+    std::cout << "\n";
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
+}
@@ -0,0 +1,386 @@
+#include "tuning.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include "gguf.h"
+#include "kernels/matvec_quant.h"
+#include "numa.h"
+#include "thread_pool.h"
+#include "weight_cache.h"
+#include "weights.h"
+
+namespace cieft {
+
+namespace {
+
+constexpr const char* kMagic = "cieft-tuning";
+constexpr int kVersion = 1;
+constexpr std::size_t kNumVariants = std::size(kernels::kMatVecVariants);
+
+constexpr std::uint32_t kMaxNumaNodes = 64;
+
+// Calls fn(begin, end) over column ranges of [0, out_dim) run by up to `threads` threads of
+// `pool`, or once inline. Ranges are multiples of 8 columns so the blocked variants keep
+// full passes, and are sized by `ThreadPool::task_count` from `col_bytes` so each one's
+// weights fit in L2; with more ranges than threads, idle threads steal. On a pool split
+// across NUMA nodes, `threads` is spread evenly over the nodes and each node's ranges are
+// cut from the columns it holds (see `numa_column_range`), stolen only among its threads.
+template <typename Fn>
+void for_column_chunks(std::uint32_t threads, ThreadPool* pool, std::uint32_t out_dim, std::size_t col_bytes, Fn fn) {
+  if (threads == kPoolThreads) {
+    threads = pool != nullptr ? pool->size() : 1;
+  }
+  threads = std::min(threads, out_dim);
+  if (pool == nullptr || threads <= 1) {
+    fn(0u, out_dim);
+    return;
+  }
+  const std::uint32_t nodes = pool->numa_nodes();
+  if (nodes > 1 && nodes <= kMaxNumaNodes) {
+    const std::uint32_t per_node = (threads + nodes - 1) / nodes;
+    std::size_t node_begin[kMaxNumaNodes + 1] = {};
+    std::uint32_t col0[kMaxNumaNodes] = {};
+    std::uint32_t col1[kMaxNumaNodes] = {};
+    std::uint32_t per[kMaxNumaNodes] = {};
+    for (std::uint32_t n = 0; n < nodes; n++) {
+      const auto [c0, c1] = numa_column_range(out_dim, nodes, n);
+      col0[n] = static_cast<std::uint32_t>(c0);
+      col1[n] = static_cast<std::uint32_t>(c1);
+      const std::uint32_t blocks = (col1[n] - col0[n] + 7) / 8;
+      std::size_t chunks = 0;
+      if (blocks != 0) {
+        const std::size_t min_tasks = std::max(1u, std::min(per_node, pool->node_threads(n)));
+        const auto tasks = static_cast<std::uint32_t>(ThreadPool::task_count(blocks, 8 * col_bytes, min_tasks));
+        per[n] = (blocks + tasks - 1) / tasks * 8;
+        chunks = (col1[n] - col0[n] + per[n] - 1) / per[n];
+      }
+      node_begin[n + 1] = node_begin[n] + chunks;
+    }
+    pool->parallel_for_nodes(
+        node_begin,
+        [&](std::size_t c) {
+          std::uint32_t n = 0;
+          while (c >= node_begin[n + 1]) {
+            n++;
+          }
+          const std::uint32_t begin = col0[n] + static_cast<std::uint32_t>(c - node_begin[n]) * per[n];
+          fn(begin, std::min(col1[n], begin + per[n]));
+        },
+        per_node);
+    return;
+  }
+  const std::uint32_t blocks = (out_dim + 7) / 8;
+  const auto tasks = static_cast<std::uint32_t>(ThreadPool::task_count(blocks, 8 * col_bytes, threads));
+  const std::uint32_t per = (blocks + tasks - 1) / tasks * 8;
+  const std::uint32_t chunks = (out_dim + per - 1) / per;
+  pool->parallel_for(
+      chunks,
+      [&](std::size_t c) {
+        const std::uint32_t begin = static_cast<std::uint32_t>(c) * per;
+        fn(begin, std::min(out_dim, begin + per));
+      },
+      ThreadPool::Schedule::Stealing, threads);
+}
+
+// Inverse of `matvec_type_name` over the types the loader can produce.
+std::optional<std::uint32_t> parse_matvec_type(const std::string& name) {
+  for (std::uint32_t t = 0; t < 64; t++) {
+    if (gguf::ggml_type_traits(t) && matvec_type_name(t) == name) {
+      return t;
+    }
+  }
+  return std::nullopt;
+}
+
+}  // namespace
+
+std::string matvec_type_name(std::uint32_t ggml_type) {
+  if (ggml_type == 0) {
+    return "f32";
+  }
+  const auto traits = gguf::ggml_type_traits(ggml_type);
+  std::string name = traits ? traits->name : "type" + std::to_string(ggml_type);
+  for (auto& c : name) {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  return name;
+}
+
+std::uint32_t tensor_threads(const TensorF32& W, std::uint32_t f32_threads, const PackedThreads& packed) {
+  if (!W.packed()) {
+    return f32_threads;
+  }
+  for (const auto& [type, threads] : packed) {
+    if (type == W.ggml_type) {
+      return threads;
+    }
+  }
+  return kPoolThreads;
+}
+
+void matvec_parallel(kernels::MatVecFn fn, std::uint32_t threads, ThreadPool* pool, const float* W_in_out,
+                     std::uint32_t in_dim, std::uint32_t out_dim, const float* x_in, float* y_out) {
+  for_column_chunks(threads, pool, out_dim, in_dim * sizeof(float), [&](std::uint32_t begin, std::uint32_t end) {
+    fn(W_in_out + static_cast<std::size_t>(begin) * in_dim, in_dim, end - begin, x_in, y_out + begin);
+  });
+}
+
+void matvec_tensor(const TensorF32& W, kernels::MatVecFn fn, bool add, std::uint32_t threads, ThreadPool* pool,
+                   const float* x_in, float* y_out) {
+  const auto in_dim = static_cast<std::uint32_t>(W.dims.at(0));
+  const auto out_dim = static_cast<std::uint32_t>(W.numel / in_dim);
+  if (!W.packed()) {
+    matvec_parallel(fn, threads, pool, W.data(), in_dim, out_dim, x_in, y_out);
+    return;
+  }
+  const std::size_t col_bytes = W.row_bytes();
+  for_column_chunks(threads, pool, out_dim, col_bytes, [&](std::uint32_t begin, std::uint32_t end) {
+    const std::uint8_t* cols = W.bytes() + begin * col_bytes;
+    if (add) {
+      kernels::matvec_packed_f32<true>(W.ggml_type, cols, col_bytes, in_dim, end - begin, x_in, y_out + begin);
+    } else {
+      kernels::matvec_packed_f32<false>(W.ggml_type, cols, col_bytes, in_dim, end - begin, x_in, y_out + begin);
+    }
+  });
+}
+
+std::optional<TuningProfile> TuningProfile::load(const std::string& path, std::uint32_t pool_threads) {
+  std::ifstream in(path);
+  if (!in) {
+    return std::nullopt;
+  }
+  std::string magic;
+  int version = 0;
+  std::string key;
+  std::string cpu;
+  std::uint32_t threads = 0;
+  if (!(in >> magic >> version) || magic != kMagic || version != kVersion) {
+    return std::nullopt;
+  }
+  if (!(in >> key >> cpu) || key != "cpu" || cpu != cpu_feature_string()) {
+    return std::nullopt;
+  }
+  if (!(in >> key >> threads) || key != "threads" || threads != pool_threads) {
+    return std::nullopt;
+  }
+
+  TuningProfile p(cpu, threads);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream ls(line);
+    std::string type;
+    std::uint32_t in_dim = 0;
+    std::uint32_t out_dim = 0;
+    std::string variant;
+    MatVecChoice c;
+    if (!(ls >> key) || key != "matvec") {
+      continue;
+    }
+    if (!(ls >> type >> in_dim >> out_dim >> variant >> c.threads >> c.ns)) {
+      throw std::runtime_error("malformed tuning profile line: " + line);
+    }
+    c.variant = static_cast<std::uint32_t>(kNumVariants);
+    for (std::size_t i = 0; i < kNumVariants; i++) {
+      if (variant == kernels::kMatVecVariants[i].name) {
+        c.variant = static_cast<std::uint32_t>(i);
+      }
+    }
+    if (c.variant == kNumVariants || c.threads == 0) {
+      continue;  // a variant this build no longer has: fall back to the default
+    }
+    p.set(in_dim, out_dim, type, c);
+  }
+  return p;
+}
+
+void TuningProfile::save(const std::string& path) const {
+  const std::string tmp = path + ".tmp." + std::to_string(::getpid());
+  {
+    std::ofstream out(tmp, std::ios::trunc);
+    if (!out) {
+      throw std::runtime_error("cannot create tuning profile: " + tmp);
+    }
+    out << kMagic << " " << kVersion << "\n"
+        << "cpu " << cpu_ << "\n"
+        << "threads " << pool_threads_ << "\n";
+    for (const auto& [k, c] : matvec_) {
+      const auto& [type, in_dim, out_dim] = k;
+      out << "matvec " << type << " " << in_dim << " " << out_dim << " " << kernels::kMatVecVariants[c.variant].name
+          << " " << c.threads << " " << std::fixed << std::setprecision(0) << c.ns << "\n";
+    }
+    if (!out) {
+      std::remove(tmp.c_str());
+      throw std::runtime_error("write failed: " + tmp);
+    }
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    throw std::runtime_error("rename failed: " + path);
+  }
+}
+
+std::optional<MatVecChoice> TuningProfile::find(std::uint32_t in_dim, std::uint32_t out_dim,
+                                                const std::string& type) const {
+  const auto it = matvec_.find({type, in_dim, out_dim});
+  if (it == matvec_.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+void TuningProfile::set(std::uint32_t in_dim, std::uint32_t out_dim, const std::string& type, const MatVecChoice& c) {
+  matvec_[{type, in_dim, out_dim}] = c;
+}
+
+PackedThreads TuningProfile::packed_threads(std::uint32_t in_dim, std::uint32_t out_dim) const {
+  PackedThreads out;
+  for (const auto& [k, c] : matvec_) {
+    const auto& [type, k_in, k_out] = k;
+    if (k_in == in_dim && k_out == out_dim && type != "f32") {
+      if (const auto t = parse_matvec_type(type)) {
+        out.emplace_back(*t, c.threads);
+      }
+    }
+  }
+  return out;
+}
+
+std::string TuningProfile::describe() const {
+  std::ostringstream oss;
+  oss << "tuning: cpu=" << cpu_ << " threads=" << pool_threads_ << " shapes=" << matvec_.size() << "\n";
+  for (const auto& [k, c] : matvec_) {
+    const auto& [type, in_dim, out_dim] = k;
+    oss << "  " << type << " " << in_dim << "x" << out_dim << ": " << kernels::kMatVecVariants[c.variant].name
+        << " threads=" << c.threads << " " << std::fixed << std::setprecision(1) << c.ns / 1000.0 << " us\n";
+  }
+  return oss.str();
+}
+
+std::vector<MatVecShape> model_matvec_shapes(const ModelConfig& cfg, bool lm_head, const Weights* w) {
+  const std::uint32_t d = cfg.d_model;
+  const std::uint32_t kv = cfg.kv_dim;
+  const std::uint32_t ffn = cfg.ffn_hidden_dim;
+  auto shape = [](std::uint32_t in_dim, std::uint32_t out_dim, const TensorF32* t) {
+    MatVecShape s{in_dim, out_dim};
+    if (t != nullptr) {
+      s.type = matvec_type_name(t->ggml_type);
+      s.weights = t->packed() ? nullptr : t->data();
+      s.tensor = t->packed() ? t : nullptr;
+    }
+    return s;
+  };
+
+  // A precision policy may give every tensor (and layer) its own type, so each matrix of
+  // every held layer is a candidate.
+  std::vector<MatVecShape> all;
+  if (w == nullptr || w->layers.empty()) {
+    all = {shape(d, d, nullptr), shape(d, kv, nullptr), shape(d, ffn, nullptr), shape(ffn, d, nullptr)};
+  } else {
+    for (const auto& layer : w->layers) {
+      for (const auto& [t, in_dim, out_dim] : {std::tuple{&layer.attn_q, d, d}, std::tuple{&layer.attn_k, d, kv},
+                                               std::tuple{&layer.attn_v, d, kv}, std::tuple{&layer.attn_output, d, d},
+                                               std::tuple{&layer.ffn_gate, d, ffn}, std::tuple{&layer.ffn_up, d, ffn},
+                                               std::tuple{&layer.ffn_down, ffn, d}}) {
+        all.push_back(shape(in_dim, out_dim, t));
+      }
+    }
+  }
+  if (lm_head) {
+    all.push_back(shape(d, cfg.vocab_size, w != nullptr && w->global.output ? &*w->global.output : nullptr));
+  }
+
+  std::vector<MatVecShape> out;
+  std::set<std::tuple<std::string, std::uint32_t, std::uint32_t>> seen;
+  for (const auto& s : all) {
+    if (s.in_dim != 0 && s.out_dim != 0 && seen.insert({s.type, s.in_dim, s.out_dim}).second) {
+      out.push_back(s);
+    }
+  }
+  return out;
+}
+
+TuningProfile autotune_matvec(const std::vector<MatVecShape>& shapes, ThreadPool& pool, const AutotuneOptions& opts) {
+  TuningProfile profile(cpu_feature_string(), pool.size());
+  std::vector<std::uint32_t> thread_counts;
+  for (std::uint32_t t = 1; t < pool.size(); t *= 2) {
+    thread_counts.push_back(t);
+  }
+  thread_counts.push_back(pool.size());
+
+  // Runs one candidate until it has taken `min_seconds` and `min_reps` calls; ns per call.
+  auto measure = [&](const auto& call) {
+    call();  // warm-up
+    std::uint32_t reps = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    do {
+      call();
+      reps++;
+      elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    } while (reps < opts.min_reps || elapsed < opts.min_seconds);
+    return elapsed * 1e9 / reps;
+  };
+
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  for (const auto& s : shapes) {
+    std::vector<float> x(s.in_dim);
+    for (auto& v : x) {
+      v = dist(rng);
+    }
+    std::vector<float> y(s.out_dim);
+
+    MatVecChoice best;
+    best.ns = -1.0;
+    if (s.tensor != nullptr) {
+      for (const std::uint32_t t : thread_counts) {
+        const double ns = measure([&] { matvec_tensor(*s.tensor, nullptr, false, t, &pool, x.data(), y.data()); });
+        if (best.ns < 0.0 || ns < best.ns) {
+          best = {0, t, ns};
+        }
+      }
+    } else {
+      std::vector<float> synthetic;
+      const float* W = s.weights;
+      if (W == nullptr) {
+        synthetic.resize(static_cast<std::size_t>(s.in_dim) * s.out_dim);
+        for (auto& v : synthetic) {
+          v = dist(rng);
+        }
+        W = synthetic.data();
+      }
+      for (std::size_t vi = 0; vi < kNumVariants; vi++) {
+        for (const std::uint32_t t : thread_counts) {
+          const kernels::MatVecFn fn = kernels::kMatVecVariants[vi].set;
+          const double ns = measure([&] { matvec_parallel(fn, t, &pool, W, s.in_dim, s.out_dim, x.data(), y.data()); });
+          if (best.ns < 0.0 || ns < best.ns) {
+            best = {static_cast<std::uint32_t>(vi), t, ns};
+          }
+        }
+      }
+    }
+    profile.set(s.in_dim, s.out_dim, s.type, best);
+    if (opts.verbose) {
+      std::cout << "autotune: " << s.type << " " << s.in_dim << "x" << s.out_dim << " -> "
+                << (s.tensor != nullptr ? "packed" : kernels::kMatVecVariants[best.variant].name) << " threads=" << best.threads << " " << std::fixed
+                << std::setprecision(1) << best.ns / 1000.0 << " us"
+                << (s.weights != nullptr || s.tensor != nullptr ? "" : " (synthetic)") << "\n";
+    }
+  }
+  return profile;
+}
+
+}  // namespace cieft
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "gguf_loader.h"
+#include "kernels/matvec.h"
+
+namespace cieft {
+
+class ThreadPool;
+struct TensorF32;
+struct Weights;
+
+// Thread count meaning every thread of the pool a matmul runs on. Shapes without a tuned
+// count use it, so an attached pool (and its NUMA split) does the work rather than the caller.
+inline constexpr std::uint32_t kPoolThreads = 0;
+
+// How to run one matvec shape: an index into `kernels::kMatVecVariants` and how many
+// column chunks to split it into across the thread pool (1 = inline on the caller).
+struct MatVecChoice {
+  std::uint32_t variant = 0;
+  std::uint32_t threads = 1;
+  double ns = 0.0;  // measured time per call when tuned
+};
+
+// One weight matrix shape as the forward pass multiplies it. `type` is the runtime
+// element type of the weights (`matvec_type_name`). Float32 shapes optionally point at
+// real data in `weights` (random data is used otherwise); other types are benchmarked
+// on `tensor`, the packed matrix itself.
+struct MatVecShape {
+  std::uint32_t in_dim = 0;
+  std::uint32_t out_dim = 0;
+  std::string type = "f32";
+  const float* weights = nullptr;
+  const TensorF32* tensor = nullptr;
+};
+
+// Tuning key of a runtime ggml type: "f32" for 0, else the lower-case ggml name ("q8_0").
+std::string matvec_type_name(std::uint32_t ggml_type);
+
+// Thread counts tuned for the packed encodings of one shape, as (ggml type, threads).
+using PackedThreads = std::vector<std::pair<std::uint32_t, std::uint32_t>>;
+
+// Threads to run `W` with: `f32_threads` for float32 tensors, the entry of `packed`
+// matching a packed tensor's type, or `kPoolThreads` when that type was not tuned.
+std::uint32_t tensor_threads(const TensorF32& W, std::uint32_t f32_threads, const PackedThreads& packed);
+
+// Per-machine matvec tuning results, stored as a small text file keyed by
+// `cpu_feature_string()` and the pool size it was measured with.
+class TuningProfile {
+ public:
+  TuningProfile() = default;
+  TuningProfile(std::string cpu, std::uint32_t pool_threads) : cpu_(std::move(cpu)), pool_threads_(pool_threads) {}
+
+  // Returns nullopt if the file is missing, from another format version, or was tuned
+  // on a different CPU or pool size.
+  static std::optional<TuningProfile> load(const std::string& path, std::uint32_t pool_threads);
+  void save(const std::string& path) const;
+
+  std::optional<MatVecChoice> find(std::uint32_t in_dim, std::uint32_t out_dim, const std::string& type = "f32") const;
+  void set(std::uint32_t in_dim, std::uint32_t out_dim, const std::string& type, const MatVecChoice& c);
+  // Every non-f32 entry of a shape.
+  PackedThreads packed_threads(std::uint32_t in_dim, std::uint32_t out_dim) const;
+
+  std::size_t size() const { return matvec_.size(); }
+  std::string describe() const;
+
+ private:
+  std::string cpu_;
+  std::uint32_t pool_threads_ = 0;
+  std::map<std::tuple<std::string, std::uint32_t, std::uint32_t>, MatVecChoice> matvec_;
+};
+
+// The distinct (shape, runtime type) pairs of a model's layers and (with `lm_head`) its
+// output projection. Types and data come from `w` when it holds the tensors; without
+// them every shape is "f32".
+std::vector<MatVecShape> model_matvec_shapes(const ModelConfig& cfg, bool lm_head, const Weights* w = nullptr);
+
+struct AutotuneOptions {
+  double min_seconds = 0.02;  // per candidate
+  std::uint32_t min_reps = 3;
+  bool verbose = false;       // one line per shape to stdout
+};
+
+// Benchmarks every variant x thread count (1, 2, 4, ..., pool size) for each shape and
+// records the fastest in a new profile. Packed shapes have one kernel
+// (`kernels::matvec_packed_f32`), so only their thread count is tuned.
+TuningProfile autotune_matvec(const std::vector<MatVecShape>& shapes, ThreadPool& pool,
+                              const AutotuneOptions& opts = {});
+
+// Runs `fn` over `threads` contiguous column ranges on `pool` (`kPoolThreads`: one per pool
+// thread), or inline when `pool` is null or `threads` is 1.
+void matvec_parallel(kernels::MatVecFn fn, std::uint32_t threads, ThreadPool* pool, const float* W_in_out,
+                     std::uint32_t in_dim, std::uint32_t out_dim, const float* x_in, float* y_out);
+
+// y = W^T x (`add`: y += W^T x) for a [in, out] weight tensor: float32 tensors through
+// `fn`, which must match `add`; tensors a precision policy packed through
+// `kernels::matvec_packed_f32`, which always accumulates in double.
+void matvec_tensor(const TensorF32& W, kernels::MatVecFn fn, bool add, std::uint32_t threads, ThreadPool* pool,
+                   const float* x_in, float* y_out);
+
+}  // namespace cieft
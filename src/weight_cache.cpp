@@ -0,0 +1,333 @@
+#include "weight_cache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_file.h"
+#include "reader.h"
+
+namespace cieft {
+
+namespace {
+
+constexpr char kMagic[8] = {'C', 'I', 'E', 'F', 'T', 'W', 'C', '\0'};
+// Bump when the layout or the meaning of the cached representation changes.
+constexpr std::uint32_t kVersion = 1;
+constexpr std::size_t kDataAlignment = 4096;
+// Header flag bits.
+constexpr std::uint32_t kFlagFolded = 1u << 0;
+
+static_assert(std::is_trivially_copyable_v<ModelConfig>);
+
+std::uint64_t fnv1a(const void* data, std::size_t n, std::uint64_t h = 1469598103934665603ull) {
+  const auto* p = static_cast<const std::uint8_t*>(data);
+  for (std::size_t i = 0; i < n; i++) {
+    h ^= p[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+std::string hex64(std::uint64_t v) {
+  char buf[17];
+  std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(v));
+  return buf;
+}
+
+template <typename T>
+void put(std::string& out, const T& v) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+void put_string(std::string& out, const std::string& s) {
+  put<std::uint64_t>(out, s.size());
+  out.append(s);
+}
+
+struct Entry {
+  std::string name;
+  const TensorF32* tensor = nullptr;
+  std::uint64_t offset = 0;
+};
+
+std::vector<Entry> cache_entries(const Weights& w) {
+  std::vector<Entry> out;
+  out.push_back({"token_embd.weight", &w.global.token_embd});
+  if (w.global.output_norm) {
+    out.push_back({"output_norm.weight", &*w.global.output_norm});
+  }
+  if (w.global.output) {
+    out.push_back({"output.weight", &*w.global.output});
+  }
+  for (const auto& lw : w.layers) {
+    const auto tensors = layer_tensors(lw);
+    for (std::size_t k = 0; k < kLayerTensorSuffixes.size(); k++) {
+      out.push_back({layer_tensor_name(lw.index, kLayerTensorSuffixes[k]), tensors[k]});
+    }
+  }
+  return out;
+}
+
+}  // namespace
+
+std::string cpu_feature_string() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  std::string s = "x86_64:";
+  auto add = [&](bool has, const char* name) {
+    if (has) {
+      s += s.back() == ':' ? "" : ",";
+      s += name;
+    }
+  };
+  add(__builtin_cpu_supports("sse4.2"), "sse4.2");
+  add(__builtin_cpu_supports("avx"), "avx");
+  add(__builtin_cpu_supports("avx2"), "avx2");
+  add(__builtin_cpu_supports("fma"), "fma");
+  add(__builtin_cpu_supports("avx512f"), "avx512f");
+  return s;
+#elif defined(__aarch64__)
+#if defined(__ARM_FEATURE_SVE)
+  return "arm64:neon,sve";
+#else
+  return "arm64:neon";
+#endif
+#else
+  return "generic";
+#endif
+}
+
+std::uint64_t model_fingerprint(const GGUFLoader& loader) {
+  std::uint64_t h = 1469598103934665603ull;
+  for (std::size_t s = 0; s < loader.shard_count(); s++) {
+    const auto& mf = loader.mapped_file(s);
+    const std::size_t header = std::min(loader.file(s).data_section_offset, mf.size());
+
+    h = fnv1a(mf.data(), header, h);
+    const std::uint64_t size = mf.size();
+    h = fnv1a(&size, sizeof(size), h);
+
+    // 16 evenly spaced 4 KiB samples of tensor data.
+    constexpr std::size_t kSamples = 16;
+    constexpr std::size_t kSampleBytes = 4096;
+    const std::size_t data_bytes = mf.size() - header;
+    for (std::size_t i = 0; i < kSamples && data_bytes > 0; i++) {
+      const std::size_t off = header + data_bytes / kSamples * i;
+      const std::size_t n = std::min(kSampleBytes, mf.size() - off);
+      h = fnv1a(mf.data() + off, n, h);
+    }
+  }
+  return h;
+}
+
+WeightCacheKey weight_cache_key(const GGUFLoader& loader,
+                                const std::vector<std::uint32_t>& layer_indices,
+                                bool load_lm_head,
+                                const LoadOptions& opts) {
+  WeightCacheKey key;
+  std::ostringstream oss;
+  oss << "v" << kVersion << ";model=" << hex64(model_fingerprint(loader)) << ";cpu=" << cpu_feature_string()
+      << ";align=" << opts.alignment << ";lm_head=" << (load_lm_head ? 1 : 0)
+      << ";fold=" << (opts.fold_weights ? 1 : 0) << ";layers=";
+  for (std::size_t i = 0; i < layer_indices.size(); i++) {
+    oss << (i != 0 ? "," : "") << layer_indices[i];
+  }
+  key.text = oss.str();
+  key.hash = fnv1a(key.text.data(), key.text.size());
+  return key;
+}
+
+void save_weight_cache(const std::string& path, const Weights& w, const WeightCacheKey& key) {
+  auto entries = cache_entries(w);
+  for (const auto& e : entries) {
+    if (e.tensor->packed()) {
+      throw std::runtime_error("save_weight_cache: " + e.name + " is packed; the cache holds float32 tensors only");
+    }
+  }
+
+  std::string header;
+  header.append(kMagic, sizeof(kMagic));
+  put<std::uint32_t>(header, kVersion);
+  const bool folded = !w.layers.empty() && w.layers.front().folded;
+  for (const auto& lw : w.layers) {
+    if (lw.folded != folded) {
+      throw std::runtime_error("save_weight_cache: layers mix folded and unfolded weights");
+    }
+  }
+  put<std::uint32_t>(header, folded ? kFlagFolded : 0);
+  put<std::uint64_t>(header, key.hash);
+  put_string(header, key.text);
+  put<ModelConfig>(header, w.cfg);
+  put<std::uint64_t>(header, w.layers.size());
+  for (const auto& lw : w.layers) {
+    put<std::uint32_t>(header, lw.index);
+  }
+  put<std::uint64_t>(header, entries.size());
+
+  // Table size does not depend on offsets, so lay out data after a dry run.
+  std::size_t table_bytes = 0;
+  for (const auto& e : entries) {
+    table_bytes += sizeof(std::uint64_t) + e.name.size() + sizeof(std::uint32_t) +
+                   e.tensor->dims.size() * sizeof(std::uint64_t) + 2 * sizeof(std::uint64_t);
+  }
+  std::uint64_t off = align_up(header.size() + table_bytes, kDataAlignment);
+  for (auto& e : entries) {
+    e.offset = off;
+    off = align_up(off + e.tensor->numel * sizeof(float), kDataAlignment);
+  }
+  for (const auto& e : entries) {
+    put_string(header, e.name);
+    put<std::uint32_t>(header, static_cast<std::uint32_t>(e.tensor->dims.size()));
+    for (const auto d : e.tensor->dims) {
+      put<std::uint64_t>(header, d);
+    }
+    put<std::uint64_t>(header, e.offset);
+    put<std::uint64_t>(header, e.tensor->numel * sizeof(float));
+  }
+
+  const std::string tmp = path + ".tmp." + std::to_string(::getpid());
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      throw std::runtime_error("cannot create weight cache: " + tmp);
+    }
+    out.write(header.data(), static_cast<std::streamsize>(header.size()));
+    std::uint64_t pos = header.size();
+    const std::string zeros(kDataAlignment, '\0');
+    for (const auto& e : entries) {
+      out.write(zeros.data(), static_cast<std::streamsize>(e.offset - pos));
+      const std::uint64_t bytes = e.tensor->numel * sizeof(float);
+      out.write(reinterpret_cast<const char*>(e.tensor->data()), static_cast<std::streamsize>(bytes));
+      pos = e.offset + bytes;
+    }
+    if (!out) {
+      std::remove(tmp.c_str());
+      throw std::runtime_error("write failed: " + tmp);
+    }
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    throw std::runtime_error("rename failed: " + path);
+  }
+}
+
+std::optional<Weights> load_weight_cache(const std::string& path, const WeightCacheKey& key) {
+  struct stat st {};
+  if (::stat(path.c_str(), &st) != 0) {
+    return std::nullopt;
+  }
+
+  auto mf = std::make_shared<const MappedFile>(path);
+  Reader r(mf->data(), mf->size());
+
+  char magic[sizeof(kMagic)]{};
+  r.read_bytes(magic, sizeof(magic));
+  if (std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 || r.read<std::uint32_t>() != kVersion) {
+    return std::nullopt;
+  }
+  const std::uint32_t flags = r.read<std::uint32_t>();
+  if (r.read<std::uint64_t>() != key.hash || r.read_string() != key.text) {
+    return std::nullopt;
+  }
+
+  Weights w;
+  w.cfg = r.read<ModelConfig>();
+  const std::uint64_t n_layers = r.read<std::uint64_t>();
+  if (n_layers > w.cfg.n_layers) {
+    throw std::runtime_error("corrupt weight cache (layer count): " + path);
+  }
+  w.layers.resize(static_cast<std::size_t>(n_layers));
+  for (auto& lw : w.layers) {
+    lw.index = r.read<std::uint32_t>();
+    lw.folded = (flags & kFlagFolded) != 0;
+  }
+
+  std::unordered_map<std::string, TensorF32> tensors;
+  const std::uint64_t n_tensors = r.read<std::uint64_t>();
+  for (std::uint64_t i = 0; i < n_tensors; i++) {
+    std::string name = r.read_string();
+    TensorF32 t;
+    t.dims.resize(r.read<std::uint32_t>());
+    t.numel = 1;
+    for (auto& d : t.dims) {
+      d = r.read<std::uint64_t>();
+      t.numel = checked_mul_u64(t.numel, d);
+    }
+    const std::uint64_t off = r.read<std::uint64_t>();
+    const std::uint64_t bytes = r.read<std::uint64_t>();
+    if (bytes != checked_mul_u64(t.numel, sizeof(float)) || off > mf->size() || bytes > mf->size() - off) {
+      throw std::runtime_error("corrupt weight cache (tensor " + name + "): " + path);
+    }
+    t.storage = AlignedBuffer::borrow(mf->data() + off, static_cast<std::size_t>(bytes));
+    tensors.emplace(std::move(name), std::move(t));
+  }
+
+  auto take = [&](const std::string& name) {
+    auto it = tensors.find(name);
+    if (it == tensors.end()) {
+      throw std::runtime_error("weight cache missing tensor " + name + ": " + path);
+    }
+    return std::move(it->second);
+  };
+
+  w.global.token_embd = take("token_embd.weight");
+  if (tensors.count("output.weight") != 0) {
+    w.global.output_norm = take("output_norm.weight");
+    w.global.output = take("output.weight");
+  }
+  for (auto& lw : w.layers) {
+    const auto dst = layer_tensors(lw);
+    for (std::size_t k = 0; k < kLayerTensorSuffixes.size(); k++) {
+      *dst[k] = take(layer_tensor_name(lw.index, kLayerTensorSuffixes[k]));
+    }
+  }
+
+  w.backing = std::move(mf);
+  return w;
+}
+
+Weights load_weights_cached(const GGUFLoader& loader,
+                            const std::vector<std::uint32_t>& layer_indices,
+                            bool load_lm_head,
+                            const LoadOptions& opts,
+                            const std::string& cache_dir,
+                            bool* cache_hit) {
+  if (!opts.precision.empty()) {
+    throw std::runtime_error("weight cache does not support a precision policy");
+  }
+  const WeightCacheKey key = weight_cache_key(loader, layer_indices, load_lm_head, opts);
+  const std::string path = cache_dir + "/" + hex64(key.hash) + ".cwc";
+
+  if (auto cached = load_weight_cache(path, key)) {
+    if (cache_hit != nullptr) {
+      *cache_hit = true;
+    }
+    return std::move(*cached);
+  }
+
+  Weights w = load_weights(loader, layer_indices, load_lm_head, opts);
+  ::mkdir(cache_dir.c_str(), 0755);
+  save_weight_cache(path, w, key);
+  if (cache_hit != nullptr) {
+    *cache_hit = false;
+  }
+  return w;
+}
+
+}  // namespace cieft
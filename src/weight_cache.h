@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "gguf_loader.h"
+#include "weights.h"
+
+namespace cieft {
+
+// Identifies one runtime-ready weight set: source model, CPU features and load options.
+// `text` is stored in the cache file for diagnostics; `hash` names and validates it.
+struct WeightCacheKey {
+  std::string text;
+  std::uint64_t hash = 0;
+};
+
+// Compact description of the SIMD features this binary can use, e.g. "x86_64:avx2,fma".
+std::string cpu_feature_string();
+
+// Hashes the GGUF header/tensor table, the file size and sampled tensor data, so the key
+// changes with the model without reading every byte.
+std::uint64_t model_fingerprint(const GGUFLoader& loader);
+
+WeightCacheKey weight_cache_key(const GGUFLoader& loader,
+                                const std::vector<std::uint32_t>& layer_indices,
+                                bool load_lm_head,
+                                const LoadOptions& opts);
+
+// Writes the float32 tensors of `w` to `path` (via a temp file + rename). Tensor data is
+// page aligned so the file can be mapped and used in place.
+void save_weight_cache(const std::string& path, const Weights& w, const WeightCacheKey& key);
+
+// Maps `path` and returns weights whose tensors borrow from the mapping (read-only).
+// Returns nullopt if the file is missing, from another format version, or keyed differently.
+std::optional<Weights> load_weight_cache(const std::string& path, const WeightCacheKey& key);
+
+// `load_weights` behind a cache directory: maps `<dir>/<key hash>.cwc` if present,
+// otherwise loads from the GGUF and writes the cache file for next time.
+Weights load_weights_cached(const GGUFLoader& loader,
+                            const std::vector<std::uint32_t>& layer_indices,
+                            bool load_lm_head,
+                            const LoadOptions& opts,
+                            const std::string& cache_dir,
+                            bool* cache_hit = nullptr);
+
+}  // namespace cieft
@@ -1,10 +1,18 @@
 #include "weights.h"
 
+#include <unistd.h>
+
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <utility>
@@ -12,21 +20,15 @@
 
 #include "ggml_fp16.h"
 #include "ggml_quants.h"
+#include "gguf.h"
+#include "numa.h"
+#include "reader.h"
+#include "thread_pool.h"
 
 namespace cieft {
 
 namespace {
 
-std::uint64_t checked_mul_u64(std::uint64_t a, std::uint64_t b) {
-  if (a == 0 || b == 0) {
-    return 0;
-  }
-  if (a > std::numeric_limits<std::uint64_t>::max() / b) {
-    throw std::runtime_error("u64 overflow");
-  }
-  return a * b;
-}
-
 std::uint64_t numel_u64(const std::vector<std::uint64_t>& dims) {
   std::uint64_t n = 1;
   for (const auto d : dims) {
@@ -41,7 +43,9 @@ void expect_dims(const TensorView& t, const std::vector<std::uint64_t>& expected
   }
 }
 
-TensorF32 allocate_f32(const std::vector<std::uint64_t>& dims, std::size_t alignment) {
+}  // namespace
+
+TensorF32 allocate_tensor_f32(const std::vector<std::uint64_t>& dims, std::size_t alignment) {
   const std::uint64_t n = numel_u64(dims);
   const std::uint64_t bytes_u64 = checked_mul_u64(n, sizeof(float));
   if (bytes_u64 > std::numeric_limits<std::size_t>::max()) {
@@ -54,6 +58,35 @@ TensorF32 allocate_f32(const std::vector<std::uint64_t>& dims, std::size_t align
   return out;
 }
 
+std::uint64_t TensorF32::row_bytes() const {
+  if (dims.empty()) {
+    return 0;
+  }
+  const auto traits = gguf::ggml_type_traits(ggml_type);
+  if (!traits || dims[0] % traits->block_size != 0) {
+    throw std::runtime_error("TensorF32: rows do not fit ggml_type " + std::to_string(ggml_type));
+  }
+  return checked_mul_u64(dims[0] / traits->block_size, traits->type_size);
+}
+
+TensorF32 allocate_tensor(const std::vector<std::uint64_t>& dims, std::uint32_t ggml_type, std::size_t alignment) {
+  if (ggml_type == 0) {
+    return allocate_tensor_f32(dims, alignment);
+  }
+  TensorF32 out;
+  out.dims = dims;
+  out.numel = numel_u64(dims);
+  out.ggml_type = ggml_type;
+  const std::uint64_t bytes_u64 = dims.empty() ? 0 : checked_mul_u64(out.row_bytes(), out.numel / dims[0]);
+  if (bytes_u64 > std::numeric_limits<std::size_t>::max()) {
+    throw std::runtime_error("tensor too large for this process");
+  }
+  out.storage = AlignedBuffer::allocate(static_cast<std::size_t>(bytes_u64), alignment);
+  return out;
+}
+
+namespace {
+
 std::uint64_t product_tail_u64(const std::vector<std::uint64_t>& dims, std::size_t start) {
   std::uint64_t n = 1;
   for (std::size_t i = start; i < dims.size(); i++) {
@@ -62,95 +95,320 @@ std::uint64_t product_tail_u64(const std::vector<std::uint64_t>& dims, std::size
   return n;
 }
 
+// A validated source tensor plus its destination, addressable by row (dim0 is the row).
+// With `dst_type` != 0 the destination is `dst_packed`, rows re-encoded as that ggml type.
+struct DequantJob {
+  TensorView src;
+  float* dst = nullptr;
+  std::uint64_t row_len = 0;    // elements per row
+  std::uint64_t n_rows = 0;
+  std::uint64_t row_bytes = 0;  // source bytes per row
+
+  std::uint32_t dst_type = 0;
+  std::uint8_t* dst_packed = nullptr;
+  std::uint64_t dst_row_bytes = 0;
+};
+
+DequantJob make_dequant_job(const TensorView& t, float* dst) {
+  const std::string name(t.name);
+  if (t.dims.empty()) {
+    throw std::runtime_error("tensor has no dims: " + name);
+  }
+
+  DequantJob j;
+  j.src = t;
+  j.dst = dst;
+  j.row_len = t.dims[0];
+  j.n_rows = product_tail_u64(t.dims, 1);
+
+  switch (t.ggml_type) {
+    case 0:  // F32
+      j.row_bytes = checked_mul_u64(j.row_len, sizeof(float));
+      break;
+    case 1:  // F16
+      j.row_bytes = checked_mul_u64(j.row_len, sizeof(std::uint16_t));
+      break;
+    case 8:  // Q8_0
+      if (j.row_len % ggml::QK8_0 != 0) {
+        throw std::runtime_error("Q8_0 row_len not multiple of 32: " + name);
+      }
+      j.row_bytes = checked_mul_u64(j.row_len / ggml::QK8_0, sizeof(ggml::block_q8_0));
+      break;
+    case 12:  // Q4_K
+      if (j.row_len % ggml::QK_K != 0) {
+        throw std::runtime_error("Q4_K row_len not multiple of 256: " + name);
+      }
+      j.row_bytes = checked_mul_u64(j.row_len / ggml::QK_K, sizeof(ggml::block_q4_K));
+      break;
+    case 14:  // Q6_K
+      if (j.row_len % ggml::QK_K != 0) {
+        throw std::runtime_error("Q6_K row_len not multiple of 256: " + name);
+      }
+      j.row_bytes = checked_mul_u64(j.row_len / ggml::QK_K, sizeof(ggml::block_q6_K));
+      break;
+    default:
+      throw std::runtime_error("unsupported ggml_type " + std::to_string(t.ggml_type) + " for tensor " + name);
+  }
+
+  if (t.nbytes < checked_mul_u64(j.row_bytes, j.n_rows)) {
+    throw std::runtime_error("tensor truncated: " + name);
+  }
+  return j;
+}
+
+// Decodes `n` elements (whole blocks) of `ggml_type` at `src` into `dst`.
+void unpack_row(std::uint32_t ggml_type, const std::uint8_t* src, std::uint64_t n, float* dst) {
+  switch (ggml_type) {
+    case 0:
+      std::memcpy(dst, src, static_cast<std::size_t>(n * sizeof(float)));
+      return;
+    case 1: {
+      const auto* h = reinterpret_cast<const std::uint16_t*>(src);
+      for (std::uint64_t i = 0; i < n; i++) {
+        dst[i] = ggml::fp16_to_fp32(h[i]);
+      }
+      return;
+    }
+    case 8:
+      ggml::dequantize_row_q8_0(reinterpret_cast<const ggml::block_q8_0*>(src), dst, static_cast<std::int64_t>(n));
+      return;
+    case 12:
+      ggml::dequantize_row_q4_k(reinterpret_cast<const ggml::block_q4_K*>(src), dst, static_cast<std::int64_t>(n));
+      return;
+    case 14:
+      ggml::dequantize_row_q6_k(reinterpret_cast<const ggml::block_q6_K*>(src), dst, static_cast<std::int64_t>(n));
+      return;
+  }
+  throw std::runtime_error("unpack_row: unsupported ggml_type " + std::to_string(ggml_type));
+}
+
+// Encodes one row of `n` floats as F16 or Q8_0.
+void pack_row(std::uint32_t ggml_type, const float* src, std::uint64_t n, std::uint8_t* dst) {
+  switch (ggml_type) {
+    case 1: {
+      auto* h = reinterpret_cast<std::uint16_t*>(dst);
+      for (std::uint64_t i = 0; i < n; i++) {
+        h[i] = ggml::fp32_to_fp16(src[i]);
+      }
+      return;
+    }
+    case 8:
+      ggml::quantize_row_q8_0(src, reinterpret_cast<ggml::block_q8_0*>(dst), static_cast<std::int64_t>(n));
+      return;
+  }
+  throw std::runtime_error("pack_row: unsupported ggml_type " + std::to_string(ggml_type));
+}
+
+// Dequantizes (or, for a packed destination, re-encodes) rows [r0, r1) of `j`. Disjoint
+// row ranges may run concurrently.
+void dequant_rows(const DequantJob& j, std::uint64_t r0, std::uint64_t r1) {
+  const std::uint8_t* src = j.src.data + r0 * j.row_bytes;
+
+  if (j.dst_type != 0) {
+    std::uint8_t* dst = j.dst_packed + r0 * j.dst_row_bytes;
+    if (j.dst_type == j.src.ggml_type) {
+      std::memcpy(dst, src, static_cast<std::size_t>((r1 - r0) * j.row_bytes));
+      return;
+    }
+    std::vector<float> row(j.row_len);
+    for (std::uint64_t r = r0; r < r1; r++, src += j.row_bytes, dst += j.dst_row_bytes) {
+      unpack_row(j.src.ggml_type, src, j.row_len, row.data());
+      pack_row(j.dst_type, row.data(), j.row_len, dst);
+    }
+    return;
+  }
+
+  float* dst = j.dst + r0 * j.row_len;
+  if (j.src.ggml_type == 0) {
+    std::memcpy(dst, src, static_cast<std::size_t>((r1 - r0) * j.row_bytes));
+    return;
+  }
+  for (std::uint64_t r = r0; r < r1; r++, src += j.row_bytes, dst += j.row_len) {
+    unpack_row(j.src.ggml_type, src, j.row_len, dst);
+  }
+}
+
+// Target source bytes per task; small enough to balance, large enough to amortize dispatch.
+constexpr std::uint64_t kChunkSrcBytes = 512 * 1024;
+
+struct Chunk {
+  std::size_t job = 0;
+  std::uint64_t r0 = 0;
+  std::uint64_t r1 = 0;
+};
+
 }  // namespace
 
 TensorF32 load_tensor_as_f32(const GGUFLoader& loader, std::string_view name, std::size_t alignment) {
   const auto t = loader.get_tensor(name);
-
   if (t.dims.empty()) {
     throw std::runtime_error("tensor has no dims: " + std::string(name));
   }
 
-  TensorF32 out = allocate_f32(t.dims, alignment);
+  TensorF32 out = allocate_tensor_f32(t.dims, alignment);
+  const DequantJob j = make_dequant_job(t, out.data());
+  dequant_rows(j, 0, j.n_rows);
+  return out;
+}
 
-  // F32
-  if (t.ggml_type == 0) {
-    const std::uint64_t expected_bytes = checked_mul_u64(out.numel, sizeof(float));
-    if (t.nbytes < expected_bytes) {
-      throw std::runtime_error("tensor truncated: " + std::string(name));
-    }
-    std::memcpy(out.data(), t.data, static_cast<std::size_t>(expected_bytes));
-    return out;
+void dequantize_tensor(const TensorView& t, TensorF32& out, ThreadPool* pool) {
+  if (out.dims != t.dims || out.data() == nullptr) {
+    throw std::runtime_error("dequantize_tensor: destination shape mismatch for " + std::string(t.name));
   }
+  const DequantJob j = make_dequant_job(t, out.data());
+  if (pool == nullptr || pool->size() == 1) {
+    dequant_rows(j, 0, j.n_rows);
+    return;
+  }
+  const std::uint64_t rows_per_chunk = std::max<std::uint64_t>(1, kChunkSrcBytes / std::max<std::uint64_t>(1, j.row_bytes));
+  const std::uint64_t n_chunks = (j.n_rows + rows_per_chunk - 1) / rows_per_chunk;
+  pool->parallel_for(static_cast<std::size_t>(n_chunks), [&](std::size_t c) {
+    const std::uint64_t r0 = c * rows_per_chunk;
+    dequant_rows(j, r0, std::min(j.n_rows, r0 + rows_per_chunk));
+  });
+}
 
-  // F16 -> F32
-  if (t.ggml_type == 1) {
-    const std::uint64_t expected_bytes = checked_mul_u64(out.numel, sizeof(std::uint16_t));
-    if (t.nbytes < expected_bytes) {
-      throw std::runtime_error("tensor truncated: " + std::string(name));
-    }
-    const auto* src = reinterpret_cast<const std::uint16_t*>(t.data);
-    float* dst = out.data();
-    for (std::uint64_t i = 0; i < out.numel; i++) {
-      dst[i] = ggml::fp16_to_fp32(src[i]);
-    }
-    return out;
+std::uint64_t dequant_block_elements(std::uint32_t ggml_type) {
+  switch (ggml_type) {
+    case 8:
+      return ggml::QK8_0;
+    case 12:
+    case 14:
+      return ggml::QK_K;
+    default:
+      return 1;
   }
+}
 
-  // Q4_K -> F32
-  if (t.ggml_type == 12) {
-    const std::uint64_t row_len = t.dims[0];
-    if (row_len % ggml::QK_K != 0) {
-      throw std::runtime_error("Q4_K row_len not multiple of 256: " + std::string(name));
-    }
-    const std::uint64_t n_rows = product_tail_u64(t.dims, 1);
-    const std::uint64_t blocks_per_row = row_len / ggml::QK_K;
-    const std::uint64_t row_bytes = checked_mul_u64(blocks_per_row, sizeof(ggml::block_q4_K));
-    const std::uint64_t expected_bytes = checked_mul_u64(row_bytes, n_rows);
-    if (t.nbytes < expected_bytes) {
-      throw std::runtime_error("tensor truncated: " + std::string(name));
-    }
+void dequantize_elements(const TensorView& t, std::uint64_t e0, std::uint64_t e1, float* dst) {
+  const DequantJob j = make_dequant_job(t, nullptr);
+  const std::uint64_t numel = j.row_len * j.n_rows;
+  const std::uint64_t blk = dequant_block_elements(t.ggml_type);
+  if (e0 > e1 || e1 > numel || e0 % blk != 0 || (e1 % blk != 0 && e1 != numel)) {
+    throw std::runtime_error("dequantize_elements: range not block aligned for " + std::string(t.name));
+  }
 
-    const std::uint8_t* src_bytes = t.data;
-    float* dst = out.data();
-    for (std::uint64_t r = 0; r < n_rows; r++) {
-      const auto* row = reinterpret_cast<const ggml::block_q4_K*>(src_bytes + r * row_bytes);
-      ggml::dequantize_row_q4_k(row, dst + r * row_len, static_cast<std::int64_t>(row_len));
-    }
-    return out;
+  const auto traits = gguf::ggml_type_traits(t.ggml_type);
+  while (e0 < e1) {
+    const std::uint64_t c0 = e0 % j.row_len;
+    const std::uint64_t n = std::min(j.row_len - c0, e1 - e0);
+    const std::uint8_t* row = t.data + (e0 / j.row_len) * j.row_bytes;
+    unpack_row(t.ggml_type, row + c0 / traits->block_size * traits->type_size, n, dst);
+    dst += n;
+    e0 += n;
+  }
+}
+
+std::array<TensorF32*, 9> layer_tensors(LayerWeights& lw) {
+  return {&lw.attn_norm, &lw.attn_q, &lw.attn_k, &lw.attn_v, &lw.attn_output,
+          &lw.ffn_norm,  &lw.ffn_gate, &lw.ffn_up, &lw.ffn_down};
+}
+
+std::array<const TensorF32*, 9> layer_tensors(const LayerWeights& lw) {
+  return {&lw.attn_norm, &lw.attn_q, &lw.attn_k, &lw.attn_v, &lw.attn_output,
+          &lw.ffn_norm,  &lw.ffn_gate, &lw.ffn_up, &lw.ffn_down};
+}
+
+void check_layer_shapes(const GGUFLoader& loader, const ModelConfig& cfg, std::uint32_t layer) {
+  const std::string prefix = "blk." + std::to_string(layer) + ".";
+
+  // Shape checks (match the spec you provided).
+  expect_dims(loader.get_tensor(prefix + "attn_norm.weight"), {cfg.d_model});
+  expect_dims(loader.get_tensor(prefix + "attn_q.weight"), {cfg.d_model, cfg.d_model});
+  expect_dims(loader.get_tensor(prefix + "attn_k.weight"), {cfg.d_model, cfg.kv_dim});
+  expect_dims(loader.get_tensor(prefix + "attn_v.weight"), {cfg.d_model, cfg.kv_dim});
+  expect_dims(loader.get_tensor(prefix + "attn_output.weight"), {cfg.d_model, cfg.d_model});
+
+  expect_dims(loader.get_tensor(prefix + "ffn_norm.weight"), {cfg.d_model});
+  expect_dims(loader.get_tensor(prefix + "ffn_gate.weight"), {cfg.d_model, cfg.ffn_hidden_dim});
+  expect_dims(loader.get_tensor(prefix + "ffn_up.weight"), {cfg.d_model, cfg.ffn_hidden_dim});
+  expect_dims(loader.get_tensor(prefix + "ffn_down.weight"), {cfg.ffn_hidden_dim, cfg.d_model});
+}
+
+LayerWeights allocate_layer_f32(const GGUFLoader& loader, std::uint32_t layer, std::size_t alignment) {
+  LayerWeights lw;
+  lw.index = layer;
+  const auto dst = layer_tensors(lw);
+  for (std::size_t k = 0; k < kLayerTensorSuffixes.size(); k++) {
+    *dst[k] = allocate_tensor_f32(loader.get_tensor(layer_tensor_name(layer, kLayerTensorSuffixes[k])).dims, alignment);
   }
+  return lw;
+}
 
-  // Q6_K -> F32
-  if (t.ggml_type == 14) {
-    const std::uint64_t row_len = t.dims[0];
-    if (row_len % ggml::QK_K != 0) {
-      throw std::runtime_error("Q6_K row_len not multiple of 256: " + std::string(name));
+void fold_layer_weights(LayerWeights& lw, const ModelConfig& cfg, ThreadPool* pool) {
+  if (lw.folded) {
+    throw std::runtime_error("fold_layer_weights: layer already folded");
+  }
+  if (cfg.head_dim == 0 || lw.attn_norm.numel != cfg.d_model || lw.ffn_norm.numel != cfg.d_model) {
+    throw std::runtime_error("fold_layer_weights: layer does not match config");
+  }
+  for (const TensorF32* t : {&lw.attn_q, &lw.attn_k, &lw.attn_v, &lw.ffn_gate, &lw.ffn_up}) {
+    if (t->packed()) {
+      throw std::runtime_error("fold_layer_weights: attn_q/k/v and ffn_gate/up must be float32");
     }
-    const std::uint64_t n_rows = product_tail_u64(t.dims, 1);
-    const std::uint64_t blocks_per_row = row_len / ggml::QK_K;
-    const std::uint64_t row_bytes = checked_mul_u64(blocks_per_row, sizeof(ggml::block_q6_K));
-    const std::uint64_t expected_bytes = checked_mul_u64(row_bytes, n_rows);
-    if (t.nbytes < expected_bytes) {
-      throw std::runtime_error("tensor truncated: " + std::string(name));
+  }
+  const float inv_sqrt_hd = 1.0f / std::sqrt(static_cast<float>(cfg.head_dim));
+
+  // Columns are contiguous ([in, out]), so each one is scaled elementwise by the gain.
+  struct Fold {
+    TensorF32* w;
+    const float* gain;
+    float scale;
+  };
+  const Fold folds[] = {
+      {&lw.attn_q, lw.attn_norm.data(), inv_sqrt_hd}, {&lw.attn_k, lw.attn_norm.data(), 1.0f},
+      {&lw.attn_v, lw.attn_norm.data(), 1.0f},        {&lw.ffn_gate, lw.ffn_norm.data(), 1.0f},
+      {&lw.ffn_up, lw.ffn_norm.data(), 1.0f},
+  };
+  const std::uint64_t in_dim = cfg.d_model;
+  for (const auto& f : folds) {
+    const std::uint64_t n_cols = f.w->numel / in_dim;
+    std::vector<float> g(f.gain, f.gain + in_dim);
+    for (auto& v : g) {
+      v *= f.scale;
     }
-
-    const std::uint8_t* src_bytes = t.data;
-    float* dst = out.data();
-    for (std::uint64_t r = 0; r < n_rows; r++) {
-      const auto* row = reinterpret_cast<const ggml::block_q6_K*>(src_bytes + r * row_bytes);
-      ggml::dequantize_row_q6_k(row, dst + r * row_len, static_cast<std::int64_t>(row_len));
+    auto scale_cols = [&](std::uint64_t c0, std::uint64_t c1) {
+      for (std::uint64_t c = c0; c < c1; c++) {
+        float* col = f.w->data() + c * in_dim;
+        for (std::uint64_t i = 0; i < in_dim; i++) {
+          col[i] *= g[i];
+        }
+      }
+    };
+    if (pool == nullptr || pool->size() == 1) {
+      scale_cols(0, n_cols);
+      continue;
     }
-    return out;
+    const std::uint64_t cols_per_chunk = std::max<std::uint64_t>(1, kChunkSrcBytes / (in_dim * sizeof(float)));
+    const std::uint64_t n_chunks = (n_cols + cols_per_chunk - 1) / cols_per_chunk;
+    pool->parallel_for(static_cast<std::size_t>(n_chunks), [&](std::size_t c) {
+      const std::uint64_t c0 = c * cols_per_chunk;
+      scale_cols(c0, std::min(n_cols, c0 + cols_per_chunk));
+    });
   }
 
-  throw std::runtime_error("unsupported ggml_type " + std::to_string(t.ggml_type) + " for tensor " + std::string(name));
+  std::fill(lw.attn_norm.data(), lw.attn_norm.data() + lw.attn_norm.numel, 1.0f);
+  std::fill(lw.ffn_norm.data(), lw.ffn_norm.data() + lw.ffn_norm.numel, 1.0f);
+  lw.folded = true;
 }
 
 Weights load_weights(const GGUFLoader& loader,
                      const std::vector<std::uint32_t>& layer_indices,
                      bool load_lm_head,
-                     std::size_t alignment) {
+                     const LoadOptions& opts) {
   Weights w;
+  load_weights_into(w, loader, layer_indices, load_lm_head, opts);
+  return w;
+}
+
+void load_weights_into(Weights& w,
+                       const GGUFLoader& loader,
+                       const std::vector<std::uint32_t>& layer_indices,
+                       bool load_lm_head,
+                       const LoadOptions& opts) {
+  const auto t_start = std::chrono::steady_clock::now();
+
+  w = Weights{};
   w.cfg = loader.config();
   if (w.cfg.n_layers == 0 || w.cfg.d_model == 0 || w.cfg.n_heads == 0) {
     throw std::runtime_error("model config missing required metadata");
@@ -162,65 +420,316 @@ Weights load_weights(const GGUFLoader& loader,
     throw std::runtime_error("missing llama.feed_forward_length");
   }
 
+  // Pass 1 (serial): resolve, shape-check and allocate every tensor. Targets are grouped
+  // for `on_ready`: 0 = embedding, 1..n = layer positions, n+1 = LM head.
+  struct Target {
+    std::string name;
+    TensorF32* dst = nullptr;
+    std::size_t group = 0;
+    std::uint32_t packed_type = 0;  // runtime ggml type from `opts.precision`, 0 = float32
+  };
+  std::vector<Target> targets;
+  const std::size_t lm_head_group = layer_indices.size() + 1;
+
   // Globals
-  w.global.token_embd = load_tensor_as_f32(loader, "token_embd.weight", alignment);
-  if (w.global.token_embd.dims.size() != 2) {
+  const auto embd = loader.get_tensor("token_embd.weight");
+  if (embd.dims.size() != 2) {
     throw std::runtime_error("token_embd.weight is not 2D");
   }
   if (w.cfg.vocab_size == 0) {
-    if (w.global.token_embd.dims[1] > std::numeric_limits<std::uint32_t>::max()) {
+    if (embd.dims[1] > std::numeric_limits<std::uint32_t>::max()) {
       throw std::runtime_error("vocab too large");
     }
-    w.cfg.vocab_size = static_cast<std::uint32_t>(w.global.token_embd.dims[1]);
+    w.cfg.vocab_size = static_cast<std::uint32_t>(embd.dims[1]);
   }
-  expect_dims(loader.get_tensor("token_embd.weight"), {w.cfg.d_model, w.cfg.vocab_size});
+  expect_dims(embd, {w.cfg.d_model, w.cfg.vocab_size});
+  targets.push_back({"token_embd.weight", &w.global.token_embd, 0});
 
+  // Layers
+  w.layers.resize(layer_indices.size());
+  for (std::size_t li = 0; li < layer_indices.size(); li++) {
+    const auto i = layer_indices[li];
+    if (i >= w.cfg.n_layers) {
+      throw std::runtime_error("layer index out of range");
+    }
+
+    LayerWeights& lw = w.layers[li];
+    lw.index = i;
+
+    check_layer_shapes(loader, w.cfg, i);
+    const auto dst = layer_tensors(lw);
+    for (std::size_t k = 0; k < kLayerTensorSuffixes.size(); k++) {
+      targets.push_back({layer_tensor_name(i, kLayerTensorSuffixes[k]), dst[k], li + 1});
+    }
+  }
+
+  // The LM head goes last: it is only needed once every layer has run.
   if (load_lm_head) {
-    w.global.output_norm = load_tensor_as_f32(loader, "output_norm.weight", alignment);
     expect_dims(loader.get_tensor("output_norm.weight"), {w.cfg.d_model});
-
-    w.global.output = load_tensor_as_f32(loader, "output.weight", alignment);
     expect_dims(loader.get_tensor("output.weight"), {w.cfg.d_model, w.cfg.vocab_size});
+    w.global.output_norm.emplace();
+    w.global.output.emplace();
+    targets.push_back({"output_norm.weight", &*w.global.output_norm, lm_head_group});
+    targets.push_back({"output.weight", &*w.global.output, lm_head_group});
   }
 
-  // Layers
-  w.layers.reserve(layer_indices.size());
-  for (const auto i : layer_indices) {
-    if (i >= w.cfg.n_layers) {
-      throw std::runtime_error("layer index out of range");
+  std::vector<DequantJob> jobs;
+  std::vector<std::size_t> job_group;
+  std::vector<Chunk> chunks;
+  jobs.reserve(targets.size());
+  std::vector<std::uint64_t> group_rows_left(lm_head_group + 1, 0);
+
+  LoadProgress progress;
+  progress.tensors_total = targets.size();
+
+  for (auto& tg : targets) {
+    const auto t = loader.get_tensor(tg.name);
+    if (t.dims.size() < 2 || opts.precision.empty()) {
+      continue;
+    }
+    tg.packed_type = runtime_ggml_type(opts.precision.type_for(tg.name), t.ggml_type, t.dims[0]);
+    // Folding rescales the matrices that follow each norm, which needs them in float32.
+    const bool folded = opts.fold_weights && tg.group != 0 && tg.group != lm_head_group &&
+                        tg.name.find("ffn_down") == std::string::npos &&
+                        tg.name.find("attn_output") == std::string::npos;
+    if (tg.packed_type != 0 && folded) {
+      throw std::runtime_error("fold_weights needs attn_q/k/v and ffn_gate/up in float32, but the precision policy packs " +
+                               tg.name);
+    }
+  }
+  auto packed_bytes = [&](const TensorView& t, std::uint32_t type) {
+    TensorF32 shape;
+    shape.dims = t.dims;
+    shape.ggml_type = type;
+    return checked_mul_u64(shape.row_bytes(), product_tail_u64(t.dims, 1));
+  };
+
+  auto borrows = [&](const Target& tg, const TensorView& t) {
+    const bool layer_group = tg.group != 0 && tg.group != lm_head_group;
+    return opts.borrow_f32 && t.ggml_type == 0 && tg.packed_type == 0 && !(opts.fold_weights && layer_group);
+  };
+
+  // NUMA placement binds whole pages, so tensors must not share one.
+  const std::size_t alignment =
+      opts.numa_node_ids.size() > 1 ? std::max<std::size_t>(opts.alignment, static_cast<std::size_t>(::sysconf(_SC_PAGESIZE)))
+                          : opts.alignment;
+
+  // Arena: lay out every owned tensor back to back in `targets` (execution) order, then
+  // map the whole span at once.
+  std::vector<std::uint64_t> arena_offsets;
+  if (opts.arena != WeightArena::None) {
+    std::uint64_t off = 0;
+    arena_offsets.reserve(targets.size());
+    for (const auto& tg : targets) {
+      const auto t = loader.get_tensor(tg.name);
+      arena_offsets.push_back(off);
+      if (!t.dims.empty() && !borrows(tg, t)) {
+        const std::uint64_t bytes = tg.packed_type != 0 ? packed_bytes(t, tg.packed_type)
+                                                        : checked_mul_u64(numel_u64(t.dims), sizeof(float));
+        off = align_up(off + bytes, alignment);
+      }
     }
+    if (off > std::numeric_limits<std::size_t>::max()) {
+      throw std::runtime_error("weight arena too large for this process");
+    }
+    if (off != 0) {
+      w.arena = AlignedBuffer::allocate_huge(static_cast<std::size_t>(off), opts.arena == WeightArena::HugeTLB);
+      progress.arena_bytes = w.arena.bytes();
+      progress.arena_hugetlb = w.arena.hugetlb();
+    }
+  }
 
-    LayerWeights lw;
-    lw.index = i;
+  for (std::size_t ti = 0; ti < targets.size(); ti++) {
+    auto& [name, dst, group, packed_type] = targets[ti];
+    const auto t = loader.get_tensor(name);
+    if (t.dims.empty()) {
+      throw std::runtime_error("tensor has no dims: " + name);
+    }
+    if (borrows(targets[ti], t)) {
+      const std::uint64_t numel = numel_u64(t.dims);
+      const std::uint64_t bytes = checked_mul_u64(numel, sizeof(float));
+      if (t.nbytes < bytes) {
+        throw std::runtime_error("tensor truncated: " + name);
+      }
+      dst->dims = t.dims;
+      dst->numel = numel;
+      dst->storage = AlignedBuffer::borrow(t.data, static_cast<std::size_t>(bytes));
+      progress.tensors_total -= 1;
+      continue;
+    }
 
-    const std::string prefix = "blk." + std::to_string(i) + ".";
-    lw.attn_norm = load_tensor_as_f32(loader, prefix + "attn_norm.weight", alignment);
-    lw.attn_q = load_tensor_as_f32(loader, prefix + "attn_q.weight", alignment);
-    lw.attn_k = load_tensor_as_f32(loader, prefix + "attn_k.weight", alignment);
-    lw.attn_v = load_tensor_as_f32(loader, prefix + "attn_v.weight", alignment);
-    lw.attn_output = load_tensor_as_f32(loader, prefix + "attn_output.weight", alignment);
+    if (w.arena.data() != nullptr) {
+      dst->dims = t.dims;
+      dst->numel = numel_u64(t.dims);
+      dst->ggml_type = packed_type;
+      const std::uint64_t bytes = packed_type != 0 ? packed_bytes(t, packed_type) : dst->numel * sizeof(float);
+      dst->storage = AlignedBuffer::borrow(static_cast<std::uint8_t*>(w.arena.data()) + arena_offsets[ti],
+                                           static_cast<std::size_t>(bytes));
+    } else {
+      *dst = allocate_tensor(t.dims, packed_type, alignment);
+    }
+    if (opts.numa_node_ids.size() > 1 && t.dims.size() >= 2) {
+      const std::size_t col_bytes = packed_type != 0 ? dst->row_bytes() : t.dims[0] * sizeof(float);
+      progress.numa_refused +=
+          numa_place_columns(dst->storage.data(), col_bytes, product_tail_u64(t.dims, 1), opts.numa_node_ids);
+      progress.numa_tensors += 1;
+    }
+    jobs.push_back(make_dequant_job(t, packed_type != 0 ? nullptr : dst->data()));
+    if (packed_type != 0) {
+      jobs.back().dst_type = packed_type;
+      jobs.back().dst_packed = static_cast<std::uint8_t*>(dst->storage.data());
+      jobs.back().dst_row_bytes = dst->row_bytes();
+    }
+    job_group.push_back(group);
+    group_rows_left[group] += jobs.back().n_rows;
+    if (opts.tensor_advice != MapAdvice::Normal) {
+      loader.advise(t, opts.tensor_advice);
+    }
 
-    lw.ffn_norm = load_tensor_as_f32(loader, prefix + "ffn_norm.weight", alignment);
-    lw.ffn_gate = load_tensor_as_f32(loader, prefix + "ffn_gate.weight", alignment);
-    lw.ffn_up = load_tensor_as_f32(loader, prefix + "ffn_up.weight", alignment);
-    lw.ffn_down = load_tensor_as_f32(loader, prefix + "ffn_down.weight", alignment);
+    const DequantJob& j = jobs.back();
+    const std::uint64_t rows_per_chunk = std::max<std::uint64_t>(1, kChunkSrcBytes / std::max<std::uint64_t>(1, j.row_bytes));
+    for (std::uint64_t r0 = 0; r0 < j.n_rows; r0 += rows_per_chunk) {
+      chunks.push_back(Chunk{.job = jobs.size() - 1, .r0 = r0, .r1 = std::min(j.n_rows, r0 + rows_per_chunk)});
+    }
+    progress.src_bytes_total += checked_mul_u64(j.row_bytes, j.n_rows);
+    progress.dst_bytes_total += dst->storage.bytes();
+  }
 
-    // Shape checks (match the spec you provided).
-    expect_dims(loader.get_tensor(prefix + "attn_norm.weight"), {w.cfg.d_model});
-    expect_dims(loader.get_tensor(prefix + "attn_q.weight"), {w.cfg.d_model, w.cfg.d_model});
-    expect_dims(loader.get_tensor(prefix + "attn_k.weight"), {w.cfg.d_model, w.cfg.kv_dim});
-    expect_dims(loader.get_tensor(prefix + "attn_v.weight"), {w.cfg.d_model, w.cfg.kv_dim});
-    expect_dims(loader.get_tensor(prefix + "attn_output.weight"), {w.cfg.d_model, w.cfg.d_model});
+  // Bulk I/O: tensor bytes are read into staging memory instead of through the mapping.
+  // Chunks are processed in file order so dequant trails the reads. Each shard of a split
+  // model gets its own reader; they run concurrently.
+  std::vector<std::unique_ptr<BulkReader>> readers;
+  if (opts.bulk_io && !jobs.empty()) {
+    std::vector<std::vector<BulkReader::Range>> ranges(loader.shard_count());
+    for (const auto& j : jobs) {
+      ranges[j.src.shard].emplace_back(j.src.file_offset, j.row_bytes * j.n_rows);
+    }
+    readers.resize(loader.shard_count());
+    for (std::size_t s = 0; s < ranges.size(); s++) {
+      if (!ranges[s].empty()) {
+        readers[s] = std::make_unique<BulkReader>(loader.mapped_file(s).path(), ranges[s], opts.bulk);
+      }
+    }
+    for (auto& j : jobs) {
+      j.src.data = readers[j.src.shard]->data_at(j.src.file_offset);
+    }
+    std::sort(chunks.begin(), chunks.end(), [&](const Chunk& a, const Chunk& b) {
+      const DequantJob& ja = jobs[a.job];
+      const DequantJob& jb = jobs[b.job];
+      return std::pair(ja.src.shard, ja.src.file_offset + a.r0 * ja.row_bytes) <
+             std::pair(jb.src.shard, jb.src.file_offset + b.r0 * jb.row_bytes);
+    });
+  }
 
-    expect_dims(loader.get_tensor(prefix + "ffn_norm.weight"), {w.cfg.d_model});
-    expect_dims(loader.get_tensor(prefix + "ffn_gate.weight"), {w.cfg.d_model, w.cfg.ffn_hidden_dim});
-    expect_dims(loader.get_tensor(prefix + "ffn_up.weight"), {w.cfg.d_model, w.cfg.ffn_hidden_dim});
-    expect_dims(loader.get_tensor(prefix + "ffn_down.weight"), {w.cfg.ffn_hidden_dim, w.cfg.d_model});
+  // Pass 2 (parallel): dequantize row ranges.
+  ThreadPool pool(opts.n_threads);
+  progress.n_threads = pool.size();
 
-    w.layers.push_back(std::move(lw));
+  std::vector<std::atomic<std::uint64_t>> rows_left(jobs.size());
+  for (std::size_t i = 0; i < jobs.size(); i++) {
+    rows_left[i].store(jobs[i].n_rows);
   }
+  std::mutex progress_mu;
 
-  return w;
+  auto notify_ready = [&](std::size_t group) {
+    if (!opts.on_ready || (group == lm_head_group && !load_lm_head)) {
+      return;
+    }
+    if (group == 0) {
+      opts.on_ready(LoadStage::Embedding, 0);
+    } else if (group == lm_head_group) {
+      opts.on_ready(LoadStage::LmHead, 0);
+    } else {
+      opts.on_ready(LoadStage::Layer, group - 1);
+    }
+  };
+  // Groups made only of borrowed tensors are usable already.
+  for (std::size_t g = 0; g < group_rows_left.size(); g++) {
+    if (group_rows_left[g] == 0) {
+      notify_ready(g);
+    }
+  }
+
+  auto elapsed = [&] {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+  };
+
+  // In order, so groups complete (and `on_ready` fires) embedding first, then layer by layer.
+  pool.parallel_for(chunks.size(), [&](std::size_t ci) {
+    const Chunk& c = chunks[ci];
+    const DequantJob& j = jobs[c.job];
+    if (!readers.empty()) {
+      readers[j.src.shard]->wait(j.src.file_offset + c.r0 * j.row_bytes, (c.r1 - c.r0) * j.row_bytes);
+    }
+    dequant_rows(j, c.r0, c.r1);
+
+    const std::uint64_t n = c.r1 - c.r0;
+    const bool tensor_done = rows_left[c.job].fetch_sub(n) == n;
+
+    const std::size_t group = job_group[c.job];
+    std::unique_lock<std::mutex> lk(progress_mu);
+    progress.src_bytes_done += n * j.row_bytes;
+    if ((group_rows_left[group] -= n) == 0) {
+      // Only this worker sees the layer complete, so it folds without holding the lock.
+      if (opts.fold_weights && group != 0 && group != lm_head_group) {
+        lk.unlock();
+        fold_layer_weights(w.layers[group - 1], w.cfg);
+        lk.lock();
+      }
+      notify_ready(group);
+    }
+    if (tensor_done) {
+      progress.tensors_done += 1;
+      if (opts.progress) {
+        progress.elapsed_s = elapsed();
+        opts.progress(progress);
+      }
+    }
+  }, ThreadPool::Schedule::InOrder);
+
+  if (!readers.empty()) {
+    progress.io_direct = true;
+    for (auto& reader : readers) {
+      if (!reader) {
+        continue;
+      }
+      const BulkReadStats io = reader->finish();
+      progress.io_bytes += io.bytes;
+      progress.io_s = std::max(progress.io_s, io.seconds);
+      progress.io_direct = progress.io_direct && io.direct;
+    }
+  }
+
+  progress.workers = pool.stats();
+  if (opts.progress) {
+    progress.elapsed_s = elapsed();
+    opts.progress(progress);
+  }
+}
+
+std::string format_load_progress(const LoadProgress& p) {
+  constexpr double kMiB = 1024.0 * 1024.0;
+  const double src_mib = static_cast<double>(p.src_bytes_done) / kMiB;
+  const double rate = p.elapsed_s > 0.0 ? src_mib / p.elapsed_s : 0.0;
+
+  char buf[256];
+  std::snprintf(buf, sizeof(buf), "load: %llu/%llu tensors, %.1f/%.1f MiB src -> %.1f MiB f32, %.2fs, %.1f MiB/s (%u threads)",
+                static_cast<unsigned long long>(p.tensors_done), static_cast<unsigned long long>(p.tensors_total), src_mib,
+                static_cast<double>(p.src_bytes_total) / kMiB, static_cast<double>(p.dst_bytes_total) / kMiB, p.elapsed_s,
+                rate, p.n_threads);
+  std::string out = buf;
+  if (p.io_bytes != 0) {
+    const double io_mib = static_cast<double>(p.io_bytes) / kMiB;
+    std::snprintf(buf, sizeof(buf), "; io: %.1f MiB in %.2fs, %.1f MiB/s%s", io_mib, p.io_s,
+                  p.io_s > 0.0 ? io_mib / p.io_s : 0.0, p.io_direct ? " (direct)" : " (buffered)");
+    out += buf;
+  }
+  if (p.arena_bytes != 0) {
+    std::snprintf(buf, sizeof(buf), "; arena: %.1f MiB%s", static_cast<double>(p.arena_bytes) / kMiB,
+                  p.arena_hugetlb ? " (hugetlb)" : "");
+    out += buf;
+  }
+  return out;
 }
 
 void gather_column(const TensorF32& W_dim_vocab, std::uint32_t token_id, float* out_dim) {
@@ -232,8 +741,7 @@ void gather_column(const TensorF32& W_dim_vocab, std::uint32_t token_id, float*
   if (token_id >= vocab) {
     throw std::runtime_error("token_id out of range");
   }
-  const float* src = W_dim_vocab.data() + static_cast<std::uint64_t>(token_id) * dim;
-  std::memcpy(out_dim, src, static_cast<std::size_t>(dim) * sizeof(float));
+  unpack_row(W_dim_vocab.ggml_type, W_dim_vocab.bytes() + token_id * W_dim_vocab.row_bytes(), dim, out_dim);
 }
 
 }  // namespace cieft
@@ -1,23 +1,38 @@
 #pragma once
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <vector>
 
 #include "aligned_alloc.h"
+#include "bulk_read.h"
 #include "gguf_loader.h"
+#include "precision.h"
+#include "thread_pool.h"
 
 namespace cieft {
 
 struct TensorF32 {
   std::vector<std::uint64_t> dims;
   std::uint64_t numel = 0;
-  AlignedBuffer storage;
+  // ggml type of `storage`. 0 (F32) unless `LoadOptions::precision` packed the tensor: then
+  // each dim0 row is stored in that encoding and only `bytes()` / `row_bytes()` apply.
+  std::uint32_t ggml_type = 0;
+  AlignedBuffer storage;  // may borrow read-only mmap memory (see LoadOptions::borrow_f32)
+
+  bool packed() const { return ggml_type != 0; }
+  // Bytes of one dim0 row in `ggml_type`.
+  std::uint64_t row_bytes() const;
 
   float* data() { return static_cast<float*>(storage.data()); }
   const float* data() const { return static_cast<const float*>(storage.data()); }
+  const std::uint8_t* bytes() const { return static_cast<const std::uint8_t*>(storage.data()); }
 };
 
 struct GlobalWeights {
@@ -28,6 +43,8 @@ struct GlobalWeights {
 
 struct LayerWeights {
   std::uint32_t index = 0;
+  // Set by `fold_layer_weights`: norm gains are ones and baked into the matrices below.
+  bool folded = false;
 
   TensorF32 attn_norm;    // [d_model]
   TensorF32 attn_q;       // [d_model, d_model]
@@ -41,18 +58,177 @@ struct LayerWeights {
   TensorF32 ffn_down;  // [ffn_hidden, d_model]
 };
 
+// Per-layer tensor names, `blk.<i>.<suffix>`, in the order the forward pass uses them.
+inline constexpr std::array<std::string_view, 9> kLayerTensorSuffixes = {
+    "attn_norm.weight", "attn_q.weight",  "attn_k.weight", "attn_v.weight",   "attn_output.weight",
+    "ffn_norm.weight",  "ffn_gate.weight", "ffn_up.weight", "ffn_down.weight",
+};
+
+inline std::string layer_tensor_name(std::uint32_t layer, std::string_view suffix) {
+  return "blk." + std::to_string(layer) + "." + std::string(suffix);
+}
+
 struct Weights {
   ModelConfig cfg;
   GlobalWeights global;
   std::vector<LayerWeights> layers;
+
+  // Keeps memory alive that tensors borrow from (e.g. a mapped weight cache file).
+  std::shared_ptr<const MappedFile> backing;
+  // Single region holding every loaded tensor when `LoadOptions::arena` is set.
+  AlignedBuffer arena;
+};
+
+// Snapshot of a `load_weights` call. `src_bytes` are GGUF tensor bytes consumed,
+// `dst_bytes` the float32 bytes produced.
+struct LoadProgress {
+  std::uint64_t tensors_done = 0;
+  std::uint64_t tensors_total = 0;
+  std::uint64_t src_bytes_done = 0;
+  std::uint64_t src_bytes_total = 0;
+  std::uint64_t dst_bytes_total = 0;
+  std::uint32_t n_threads = 0;
+  double elapsed_s = 0.0;
+
+  // Only with LoadOptions::bulk_io, filled in on the final report.
+  std::uint64_t io_bytes = 0;
+  double io_s = 0.0;
+  bool io_direct = false;
+
+  // Only with LoadOptions::arena: mapped bytes, and whether they came from MAP_HUGETLB.
+  std::uint64_t arena_bytes = 0;
+  bool arena_hugetlb = false;
+
+  // Only with several LoadOptions::numa_node_ids: matrices placed, and column ranges the
+  // kernel refused to bind.
+  std::uint64_t numa_tensors = 0;
+  std::uint64_t numa_refused = 0;
+
+  // Per-thread scheduler counters of the dequant pool, filled in on the final report.
+  std::vector<WorkerStats> workers;
+};
+
+// What a `LoadOptions::on_ready` notification refers to.
+enum class LoadStage {
+  Embedding,  // `cfg` and `token_embd` are final
+  Layer,      // every tensor of one layer position is filled
+  LmHead,     // `output_norm` and `output` are filled
+};
+
+// Where `load_weights` puts float32 tensors.
+enum class WeightArena {
+  None,     // one aligned heap allocation per tensor
+  Huge,     // one 2 MiB-aligned anonymous mapping with MADV_HUGEPAGE, tensors in execution order
+  HugeTLB,  // as Huge, from explicit huge pages (MAP_HUGETLB) when the pool has enough
+};
+
+inline std::optional<WeightArena> parse_weight_arena(std::string_view s) {
+  if (s == "none") return WeightArena::None;
+  if (s == "thp" || s == "huge") return WeightArena::Huge;
+  if (s == "hugetlb") return WeightArena::HugeTLB;
+  return std::nullopt;
+}
+
+struct LoadOptions {
+  std::size_t alignment = 64;
+  std::uint32_t n_threads = 0;  // 0 = std::thread::hardware_concurrency()
+
+  // madvise hint issued on each source tensor's byte range before it is read.
+  MapAdvice tensor_advice = MapAdvice::Normal;
+
+  // F32 tensors are used straight from the file mapping instead of being copied. They stay
+  // page-cache backed (and read-only), which is what layer-ahead prefetching targets.
+  bool borrow_f32 = false;
+
+  // Read tensor bytes with many concurrent (direct) preads into huge-page staging memory
+  // instead of faulting them in 4 KiB at a time through the mapping. Dequantization of a
+  // row range starts as soon as its bytes have landed.
+  bool bulk_io = false;
+  BulkReadOptions bulk;
+
+  // Called after each tensor completes (serialized, possibly from a worker thread) and
+  // once more when loading has finished.
+  std::function<void(const LoadProgress&)> progress;
+
+  // Called as soon as a group of tensors is usable, before the rest of the load finishes.
+  // `layer_pos` indexes `layer_indices` for LoadStage::Layer and is 0 otherwise. Work is
+  // scheduled embedding, layers in order, then LM head, so groups tend to become ready in
+  // that order. Serialized with `progress`.
+  std::function<void(LoadStage stage, std::size_t layer_pos)> on_ready;
+
+  // Apply `fold_layer_weights` to every layer as it finishes (before `on_ready`). Layer
+  // tensors are then never borrowed, since folding writes to them.
+  bool fold_weights = false;
+
+  // With an arena, tensors are `AlignedBuffer::borrow` handles into `Weights::arena`,
+  // each starting at a multiple of `alignment`, so a whole layer shares a few huge pages
+  // instead of hundreds of separate 4 KiB-page heap blocks.
+  WeightArena arena = WeightArena::None;
+
+  // Runtime representation per tensor name (default: everything float32). Packed tensors
+  // are never borrowed and cannot be folded.
+  PrecisionPolicy precision;
+
+  // With more than one entry, each owned matrix's columns are split into one contiguous
+  // range per entry (`numa_column_range`) and range n is bound to kernel node
+  // `numa_node_ids[n]` (`NumaTopology::node_ids`) before it is first written, matching the
+  // column split of a pool from `assign_pool_to_nodes`. Borrowed tensors stay in the page
+  // cache wherever the kernel put them.
+  std::vector<int> numa_node_ids;
 };
 
+TensorF32 allocate_tensor_f32(const std::vector<std::uint64_t>& dims, std::size_t alignment = 64);
+
+// Storage for `dims` held as `ggml_type` (0 = float32), row by row.
+TensorF32 allocate_tensor(const std::vector<std::uint64_t>& dims, std::uint32_t ggml_type, std::size_t alignment = 64);
+
 TensorF32 load_tensor_as_f32(const GGUFLoader& loader, std::string_view name, std::size_t alignment = 64);
 
+// Dequantizes `t` into the preallocated `out` (same dims). `t.data` may point anywhere,
+// e.g. into a read buffer rather than the file mapping.
+void dequantize_tensor(const TensorView& t, TensorF32& out, ThreadPool* pool = nullptr);
+
+// Elements per quantization block of `ggml_type` (1 for F32/F16).
+std::uint64_t dequant_block_elements(std::uint32_t ggml_type);
+
+// Dequantizes the flat element range [e0, e1) of `t` into `dst`. Both ends must be
+// multiples of `dequant_block_elements` (or `e1` the element count).
+void dequantize_elements(const TensorView& t, std::uint64_t e0, std::uint64_t e1, float* dst);
+
+// The nine tensors of a layer, in `kLayerTensorSuffixes` order.
+std::array<TensorF32*, 9> layer_tensors(LayerWeights& lw);
+std::array<const TensorF32*, 9> layer_tensors(const LayerWeights& lw);
+
+// Throws unless every tensor of `blk.<layer>` has the shape `cfg` implies.
+void check_layer_shapes(const GGUFLoader& loader, const ModelConfig& cfg, std::uint32_t layer);
+
+// Allocates (but does not fill) float32 storage for every tensor of `blk.<layer>`.
+LayerWeights allocate_layer_f32(const GGUFLoader& loader, std::uint32_t layer, std::size_t alignment = 64);
+
+// Load-time algebraic folding: scales row i of `attn_q/k/v` by `attn_norm[i]` and of
+// `ffn_gate/up` by `ffn_norm[i]`, scales `attn_q` by 1/sqrt(head_dim) (RoPE is linear, so
+// the scale passes through it onto the scores), then sets both gains to one and `folded`.
+// A folded layer runs without the gain multiply and the score scale. Throws if `lw` is
+// already folded.
+void fold_layer_weights(LayerWeights& lw, const ModelConfig& cfg, ThreadPool* pool = nullptr);
+
+// Dequantizes the requested globals and layers to float32. Work is split into row ranges
+// of every tensor and spread over `opts.n_threads` threads.
 Weights load_weights(const GGUFLoader& loader,
                      const std::vector<std::uint32_t>& layer_indices,
                      bool load_lm_head,
-                     std::size_t alignment = 64);
+                     const LoadOptions& opts = {});
+
+// `load_weights` into a caller-owned `w`, so tensor addresses are stable while the load is
+// still running and parts of `w` can be used as `opts.on_ready` reports them.
+void load_weights_into(Weights& w,
+                       const GGUFLoader& loader,
+                       const std::vector<std::uint32_t>& layer_indices,
+                       bool load_lm_head,
+                       const LoadOptions& opts = {});
+
+// One-line human-readable summary, e.g. for `LoadOptions::progress`.
+std::string format_load_progress(const LoadProgress& p);
 
 // `W` is stored as [dim, vocab] with contiguous columns.
 void gather_column(const TensorF32& W_dim_vocab, std::uint32_t token_id, float* out_dim);